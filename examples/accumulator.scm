@@ -143,4 +143,40 @@
 ; status checker to block until the job is done. But for this
 ; single-thread demo, you'll just .. hang if you do this.
 
+; -------
+; Several kernels can be written at once, as a graph. Here, products
+; of random numbers are accumulated. The products are kept on the GPU;
+; they are never downloaded. The graph is a LinkValue of Sections; the
+; Sections are connected by the vectors that they share. Only the last
+; job, the one whose output is not used by any other, is reported.
+(cog-set-value!
+	(Anchor "some place") (Predicate "product")
+	(OpenclFloatValue 0 0 0 0 0))
+
+(define prod-location
+	(ValueOf (Anchor "some place") (Predicate "product")))
+
+(define graph
+	(LinkValue
+		(Section
+			(Item "vec_mult")
+			(ConnectorSeq prod-location source-location source-location))
+		(Section
+			(Item "vec_add")
+			(ConnectorSeq accum-location accum-location prod-location))))
+
+(cog-set-value! clnode (Predicate "*-write-*") graph)
+(cog-execute! get-status)
+(cog-execute! accum-location)
+
+;
+; The accumulator lives on the GPU; the host copy is refreshed only
+; when something looks at it. A vector of all zeros is never even
+; uploaded; the GPU fills it in. To free up GPU memory, a vector can
+; be evicted: it is copied back to the host, and its GPU buffer is
+; released. The next kernel that uses it uploads it again.
+(cog-execute! (SetValue clnode (Predicate "*-evict-*") accum-location))
+(cog-execute! run-kernel)
+(cog-execute! get-status)
+
 ; --------- The End! That's All, Folks! --------------
@@ -34,6 +34,95 @@
 ;
 ; Must be of the form 'opencl://platform/device/path/to/kernel.cl'
 ; Can also be clcpp or spv file.
+;
+; Several devices can be used at once, by giving a comma-separated
+; list of device substrings, as 'opencl://CUDA:RTX,RTX/tmp/vec-kernel.cl'
+; or a star, for all of the devices on the platform, as
+; 'opencl://CUDA:*/tmp/vec-kernel.cl'. Jobs go to whichever device is
+; least busy.
+;
+; Machines without any OpenCL at all can still run the stock kernels
+; and the reductions, on the CPU, with 'opencl://native:/tmp/vec-kernel.cl'
+; These use AVX2, AVX-512 or NEON, if available.
+;
+; Options can be appended to the URL, after a question mark, as
+; 'opencl://:/tmp/vec-kernel.cl?inflight=8&foo=bar'. These are:
+; * inflight=N -- maximum number of jobs that can be running on the
+;   device at the same time. Results are reported as soon as they
+;   are done. Default is 4; use 1 to run jobs strictly one at a time.
+; * queues=N -- number of command queue lanes. Each lane has a queue
+;   for running kernels, and another for moving data. Independent jobs
+;   are spread over the lanes, and may run concurrently on the device.
+;   One dispatch thread is used per lane. Default is 1.
+; * ooo -- ask for out-of-order command queues, if the device has them.
+; * zerocopy=0|1 -- buffers that alias host memory, kept coherent by
+;   mapping, instead of copying. Default is to use these if the device
+;   reports that it shares memory with the host.
+; * svm -- use OpenCL 2.0 Shared Virtual Memory for vector storage.
+;   Fine-grained SVM is used if the device has it, else coarse-grained.
+; * jobs=N -- number of Sections for which the built job is kept. Writing
+;   the same Section again reuses the kernel, and re-sends only those
+;   inputs that have changed. Default is 256; use 0 to disable.
+; * tune=0|1 -- try out several work-group sizes on the first few runs
+;   of each kernel, and then stick with the fastest. Only sizes that
+;   divide the vector length are tried, so kernels are never run past
+;   the end of their vectors. The results are saved with the cached
+;   program binary. Default is 1. A Section can fix its own work-group
+;   size, by including the launch option
+;   (Connector (Predicate "work-group-size") (Number 64))
+;   in its ConnectorSeq. The vectors are then padded up to a multiple
+;   of it, so the kernel must check the index against the length.
+; * split=N -- with several devices, or several queues, jobs working
+;   on vectors at least N long are split up, with a part of the vectors
+;   going to each queue. This only works for kernels where work-item i touches
+;   only element i of the vectors, as with all of the kernels here.
+;   Default is 1048576; use 0 to never split.
+; * cache-size=N -- compiled programs are kept in ~/.cache/opencog/opencl
+;   so that they need not be compiled again. This caps the size of that
+;   cache, in MiB; the programs used longest ago are deleted first.
+;   Default is 256. The message (Predicate "*-cache-stats-*") reports
+;   the number of cache hits, misses and deletions.
+; * stream-depth=N -- number of vectors from a streaming input that can
+;   be on the device at once. See `streaming.scm`. Default is 3.
+; * async=0|1 -- open the device and build the program in the
+;   background, so that the open returns at once. Jobs can be written
+;   right away; they run as soon as the program is ready. Opening
+;   several nodes this way compiles their programs in parallel. The
+;   message (Predicate "*-ready-*") gives a BoolValue saying if the
+;   program is ready yet; if building it failed, this reports why.
+;   Default is 0.
+; * memory=N -- device memory budget, in MiB, for the vectors used by
+;   jobs. When they take up more than this, the ones used longest ago
+;   are moved back to the host, and are uploaded again when next used.
+;   Default is three quarters of the memory of the smallest device.
+;   The message (Predicate "*-memory-*") reports the budget, the bytes
+;   and number of vectors on the device, the number of vectors and
+;   bytes moved off it, and how many of those were uploaded again.
+; * profile=0|1 -- time every upload, kernel and download on the
+;   device. The message (Predicate "*-stats-*") then reports, for each
+;   kernel, and for uploads and downloads, the number of runs, the
+;   median, 90th and 99th percentile and mean run times, the mean wait
+;   from being queued to starting, all in microseconds, and the bytes
+;   moved, GB/sec and GFLOP/sec. For the GFLOP/sec, the Section must
+;   say how many operations each work-item does, with the launch option
+;   (Connector (Predicate "flops") (Number 2))
+;   Setting *-stats-* to anything clears the numbers. Default is 0.
+; * trace=N -- keep a timeline of the last N spans of time spent in the
+;   dispatch threads, and on the device, for finding stalls. The message
+;   (Predicate "*-trace-*") gives it as a StringValue of Chrome trace
+;   JSON, for viewing in Perfetto or chrome://tracing; setting it to
+;   (StringValue "/tmp/trace.json") writes it to that file instead.
+;   This turns on `profile`, too. Default is 0.
+; * merge=N -- run up to N short jobs, written one after another for
+;   the same kernel, as one launch, laid end to end. This saves the
+;   launch overhead, which is most of the time taken by small jobs.
+;   As with `split`, this only works for kernels where work-item i
+;   touches only element i. Jobs are never held back waiting for
+;   others; whatever is there is launched when the writes stop.
+;   Default is 0, that is, no merging.
+; * merge-len=N -- the most elements that a merged launch may cover,
+;   all told. Longer jobs are launched alone. Default is 16384.
+;
 ; (define clurl "opencl://Clover:AMD Radeon/tmp/vec-kernel.cl")
 ; (define clurl "opencl://CUDA:NVIDIA RTX 4000/tmp/vec-kernel.cl")
 (define clurl "opencl://:/tmp/vec-kernel.cl")
@@ -174,4 +263,22 @@
 (cog-execute! vector-stream)
 (cog-execute! (ValueOf clnode (Predicate "*-read-*")))
 
+; ---------------------------------------------------------------
+; Reading without waiting. This runs the job, and downloads the
+; result, without blocking. The job is placed on a queue of its own
+; once the result has arrived; look at it whenever convenient.
+(cog-execute!
+	(SetValue clnode (Predicate "*-read-async-*")
+		(Section
+			(Item "vec_add")
+			(ConnectorSeq
+				result-location
+				first-vec-location
+				second-vec-location))))
+
+; ... do other things here ...
+
+; The queue of finished reads.
+(cog-execute! (ValueOf clnode (Predicate "*-read-async-*")))
+
 ; --------- The End! That's All, Folks! --------------
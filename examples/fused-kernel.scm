@@ -0,0 +1,70 @@
+;
+; fused-kernel.scm
+;
+; Running Atomese arithmetic on the GPU.
+;
+; The `atomese-kernel.scm` demo runs kernels that were written by hand,
+; in OpenCL C. Here, instead, the kernel is written in Atomese, as a
+; Lambda, and the OpenclNode compiles it into OpenCL C. The whole
+; expression becomes one kernel, making one pass over the data. So,
+; for example, `(Plus (Times A B) C)` does not store `(Times A B)`
+; anywhere; each element of it is used as soon as it is computed.
+;
+; The Lambda can use PlusLink, MinusLink, TimesLink and DivideLink,
+; as well as single numbers. It can be wrapped in an AccumulateLink,
+; in which case the elements are summed, and the result is a single
+; number. Everything is in double precision.
+;
+; The kernel is compiled the first time it is used, and the compiled
+; binary is kept in the same cache as the other programs.
+;
+; To run the demo, say `guile -s fused-kernel.scm`.
+;
+(use-modules (opencog) (opencog exec))
+(use-modules (opencog sensory) (opencog opencl))
+
+(copy-file "vec-kernel.cl" "/tmp/vec-kernel.cl")
+(define clnode (OpenclNode "opencl://:/tmp/vec-kernel.cl"))
+(cog-execute!
+	(SetValue clnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+; ---------------------------------------------------------------
+; Element-wise a*b + c, in one pass.
+; The Variables are bound to the vectors following the result,
+; in the order in which they are declared.
+(define mult-add
+	(Lambda
+		(VariableList (Variable "a") (Variable "b") (Variable "c"))
+		(Plus (Times (Variable "a") (Variable "b")) (Variable "c"))))
+
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			mult-add
+			(ConnectorSeq
+				(Number 0 0 0 0 0)       ; result goes here
+				(Number 1 2 3 4 5)       ; this is "a"
+				(Number 2 2 2 2 2)       ; this is "b"
+				(Number 10 20 30 40 50)))))
+
+; The result is (FloatValue 12 24 36 48 60)
+(define result (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(format #t "a*b+c is ~A\n" (cog-value-ref (cog-value-ref result 1) 0))
+
+; ---------------------------------------------------------------
+; The dot product, as `(Accumulate (Times A B))`. This is one kernel,
+; and not a vec_mult followed by a sum. Only one number comes back.
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Lambda
+				(VariableList (Variable "a") (Variable "b"))
+				(Accumulate (Times (Variable "a") (Variable "b"))))
+			(ConnectorSeq
+				(Number 0)
+				(Number 1 2 3 4 5)
+				(Number 1 1 1 2 2)))))
+
+; The result is (FloatValue 24)
+(define dot (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(format #t "The dot product is ~A\n" (cog-value-ref (cog-value-ref dot 1) 0))
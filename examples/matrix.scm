@@ -0,0 +1,62 @@
+;
+; matrix.scm
+;
+; Matrices: running kernels over a range of two (or three) dimensions,
+; as needed for matrix products, convolutions and attention blocks.
+;
+; A kernel argument can be given a shape, by wrapping it as
+;    (Connector (Number rows cols) vector)
+; The vector holds the matrix row after row. A third number, the
+; stride, gives the distance between the rows, if the rows are
+; padded. Plain numbers are padded with zeros to fill the matrix.
+;
+; The kernel is launched on a range of (cols, rows) of the first
+; output; one work-item per element. The range can also be given
+; explicitly, as the launch option
+;    (Connector (Predicate "global-size") (Number 256 128))
+; and the work-group size as
+;    (Connector (Predicate "work-group-size") (Number 16 16))
+; Kernels that declare a reqd_work_group_size get that one.
+;
+; The kernel only sees pointers; it has to be told the shapes. The
+; scalars, given as (Connector (Number 42)), are passed as-is, in the
+; order the kernel wants them.
+;
+; To run the demo, say `guile -s matrix.scm`.
+;
+(use-modules (opencog) (opencog exec))
+(use-modules (opencog sensory) (opencog opencl))
+
+(copy-file "vec-kernel.cl" "/tmp/vec-kernel.cl")
+(define clnode (OpenclNode "opencl://:/tmp/vec-kernel.cl"))
+(cog-execute!
+	(SetValue clnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+; ---------------------------------------------------------------
+; Two matrices. In real life, these would be weights and activations.
+(cog-set-value! (Anchor "layer") (Predicate "weights")
+	(FloatValue 1 2 3 4 5 6))
+(cog-set-value! (Anchor "layer") (Predicate "input")
+	(FloatValue 7 8 9 10 11 12))
+
+; The product of a 2x3 and a 3x2 matrix, with the tiled kernel in
+; `vec-kernel.cl`. The scalars are m, n, k, and the strides of the
+; three matrices.
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "mat_mult_f32")
+			(ConnectorSeq
+				(Connector (Number 2 2) (Number 0))
+				(Connector (Number 2 3)
+					(ValueOf (Anchor "layer") (Predicate "weights")))
+				(Connector (Number 3 2)
+					(ValueOf (Anchor "layer") (Predicate "input")))
+				(Connector (Number 2)) (Connector (Number 2)) (Connector (Number 3))
+				(Connector (Number 3)) (Connector (Number 2)) (Connector (Number 2))))))
+
+(define job (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(format #t "Product: ~A\n" (cog-value-ref (cog-value-ref job 1) 0))
+
+; Expect (58 64 139 154)
+; ---------------------------------------------------------------
@@ -0,0 +1,77 @@
+;
+; reductions.scm
+;
+; Reductions: taking a long vector, or a pair of them, and computing
+; a single number, such as a sum or a dot product.
+;
+; A reduction is a poor fit for the element-wise kernels of the
+; `atomese-kernel.scm` demo: every element of the result depends on
+; every element of the inputs. Doing this on the CPU means pulling
+; the entire vector back from the GPU, just to add it up. Instead,
+; every OpenclNode comes with a small library of reductions, that
+; run on the GPU, and return only the result. These are
+;
+;    reduce_sum     -- sum of all elements of a vector
+;    reduce_dot     -- dot product of two vectors
+;    reduce_max     -- largest element of a vector
+;    reduce_norm    -- Euclidean (L2) length of a vector
+;    reduce_cosine  -- cosine of the angle between two vectors
+;
+; They are available no matter what program the OpenclNode was opened
+; with, and are used just like any other kernel. The first argument
+; is where the result goes; it is always a vector of length one.
+;
+; To run the demo, say `guile -s reductions.scm`.
+;
+(use-modules (opencog) (opencog exec))
+(use-modules (opencog sensory) (opencog opencl))
+
+; Copy the kernel from here to /tmp. It's not used, but some program
+; is needed to open the device.
+(copy-file "vec-kernel.cl" "/tmp/vec-kernel.cl")
+(define clnode (OpenclNode "opencl://:/tmp/vec-kernel.cl"))
+(cog-execute!
+	(SetValue clnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+; The reductions are listed with the other kernels.
+(cog-execute! (ValueOf clnode (Predicate "*-description-*")))
+
+; ---------------------------------------------------------------
+; The dot product of a pair of vectors.
+(cog-set-value! (Anchor "location") (Predicate "vector-pairs")
+	(LinkValue
+		(FloatValue 1 2 3 4 5)
+		(FloatValue 1 1 1 2 2)))
+
+(define pair-location
+	(FloatValueOf (Anchor "location") (Predicate "vector-pairs")))
+
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "reduce_dot")
+			(ConnectorSeq
+				(Number 0)
+				(ElementOf (Number 0) pair-location)
+				(ElementOf (Number 1) pair-location)))))
+
+; The result is (FloatValue 24)
+(define result (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(format #t "The dot product is ~A\n" (cog-value-ref result 1))
+
+; ---------------------------------------------------------------
+; The length of a long vector.
+(cog-set-value! (Anchor "location") (Predicate "long vector")
+	(FloatValue (make-list 10000 0.5)))
+
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "reduce_norm")
+			(ConnectorSeq
+				(Number 0)
+				(ValueOf (Anchor "location") (Predicate "long vector"))))))
+
+; The result is (FloatValue 50)
+(define norm (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(format #t "The length is ~A\n" (cog-value-ref norm 1))
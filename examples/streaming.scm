@@ -0,0 +1,55 @@
+;
+; streaming.scm
+;
+; Streaming: running the same kernel over and over, on a series of
+; vectors that arrive one at a time, e.g. from a sensor.
+;
+; Writing a Section for each vector, and waiting for the answer,
+; costs a full round trip to the GPU each time. Instead, the stream
+; itself can be given as one of the kernel inputs. The OpenclNode
+; then pulls vectors from the stream as they arrive, and runs the
+; kernel on each, keeping several on the go at once: the upload of
+; the next one overlaps the kernel running on this one. The results
+; can be read in the usual way, one after another.
+;
+; The stream can be a QueueValue, as here, or any StreamNode. The
+; number of vectors kept in flight at once is set by the URL option
+; `stream-depth`; the default is 3.
+;
+; To run the demo, say `guile -s streaming.scm`.
+;
+(use-modules (opencog) (opencog exec))
+(use-modules (opencog sensory) (opencog opencl))
+
+(copy-file "vec-kernel.cl" "/tmp/vec-kernel.cl")
+(define clnode (OpenclNode "opencl://:/tmp/vec-kernel.cl?stream-depth=3"))
+(cog-execute!
+	(SetValue clnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+; ---------------------------------------------------------------
+; A queue of vectors. In real life, something else would be adding
+; these, as they come in.
+(cog-set-value! (Anchor "sensor") (Predicate "queue")
+	(QueueValue
+		(FloatValue 1 2 3 4)
+		(FloatValue 5 6 7 8)
+		(FloatValue 9 10 11 12)))
+
+; Double every vector that comes out of the queue.
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "vec_mult")
+			(ConnectorSeq
+				(Number 0 0 0 0)
+				(ValueOf (Anchor "sensor") (Predicate "queue"))
+				(Number 2 2 2 2)))))
+
+; One result for each vector in the queue, in order.
+(define (get-next)
+	(define job (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+	(cog-value-ref (cog-value-ref job 1) 0))
+
+(format #t "First: ~A\n" (get-next))
+(format #t "Second: ~A\n" (get-next))
+(format #t "Third: ~A\n" (get-next))
@@ -30,3 +30,66 @@ kernel void vec_mult(global double *prod,
 	if (i < sz)
 		prod[i] = a[i] * b[i];
 }
+
+// Single-precision product of two vectors. Use this on devices
+// where double precision is slow, or missing.
+kernel void vec_mult_f32(global float *prod,
+                         global const float *a,
+                         global const float *b,
+                         const unsigned long sz)
+{
+	size_t i = get_global_id(0);
+
+	if (i < sz)
+		prod[i] = a[i] * b[i];
+}
+
+// Single-precision matrix product, c = a b, of an m by k matrix a and
+// a k by n matrix b. The matrices are stored row after row; the rows
+// of a, b and c are lda, ldb and ldc elements apart. Launch it on a
+// range of (n, m); each work-item computes one element of c.
+//
+// Each work-group computes a TILE by TILE block of c. The blocks of a
+// and b that it needs are staged in local memory, one pair at a time,
+// so that each element of a and b is read from global memory n/TILE
+// and m/TILE times, instead of n and m times.
+#define TILE 16
+
+kernel __attribute__((reqd_work_group_size(TILE, TILE, 1)))
+void mat_mult_f32(global float *c,
+                  global const float *a,
+                  global const float *b,
+                  const unsigned long m,
+                  const unsigned long n,
+                  const unsigned long k,
+                  const unsigned long lda,
+                  const unsigned long ldb,
+                  const unsigned long ldc)
+{
+	size_t col = get_global_id(0);
+	size_t row = get_global_id(1);
+	size_t lc = get_local_id(0);
+	size_t lr = get_local_id(1);
+
+	local float ta[TILE][TILE];
+	local float tb[TILE][TILE];
+
+	float acc = 0.0f;
+	for (size_t t = 0; t < k; t += TILE)
+	{
+		// Work-items past the edges load zeros, but must still
+		// reach the barriers.
+		size_t ac = t + lc;
+		size_t br = t + lr;
+		ta[lr][lc] = (row < m && ac < k) ? a[row * lda + ac] : 0.0f;
+		tb[lr][lc] = (br < k && col < n) ? b[br * ldb + col] : 0.0f;
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		for (int i = 0; i < TILE; i++)
+			acc += ta[lr][i] * tb[i][lc];
+		barrier(CLK_LOCAL_MEM_FENCE);
+	}
+
+	if (row < m && col < n)
+		c[row * ldc + col] = acc;
+}
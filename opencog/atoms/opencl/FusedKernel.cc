@@ -0,0 +1,200 @@
+/*
+ * opencog/atoms/opencl/FusedKernel.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/core/NumberNode.h>
+#include <opencog/atoms/opencl/FusedKernel.h>
+#include <opencog/atoms/opencl/GenIDL.h>
+#include <opencog/atoms/opencl/Reductions.h>
+
+using namespace opencog;
+
+/// The Variables of the Lambda, in the order declared.
+static HandleSeq get_vars(const Handle& lambda)
+{
+	const Handle& decl = lambda->getOutgoingAtom(0);
+	HandleSeq decls;
+	if (decl->is_type(VARIABLE_LIST))
+		decls = decl->getOutgoingSet();
+	else
+		decls.push_back(decl);
+
+	// Strip off type restrictions, if any.
+	HandleSeq vars;
+	for (const Handle& h : decls)
+	{
+		if (h->is_type(TYPED_VARIABLE_LINK))
+			vars.push_back(h->getOutgoingAtom(0));
+		else
+			vars.push_back(h);
+	}
+	return vars;
+}
+
+/// Print a number so that the OpenCL compiler takes it to be a double,
+/// and not an int, which would break division.
+static std::string gen_number(double val)
+{
+	char buf[40];
+	snprintf(buf, sizeof(buf), "%.17g", val);
+	std::string num(buf);
+	if (std::string::npos == num.find_first_of(".en"))
+		num += ".0";
+	return num;
+}
+
+/// Join the code for the outgoing set of `h` with operator `op`.
+static std::string gen_expr(const Handle&, const HandleSeq&);
+static std::string gen_join(const Handle& h, const HandleSeq& vars,
+                            const char* op)
+{
+	if (0 == h->size())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting arguments, got %s", h->to_string().c_str());
+
+	std::string code = "(";
+	for (size_t i = 0; i < h->size(); i++)
+	{
+		if (0 < i) code += op;
+		code += gen_expr(h->getOutgoingAtom(i), vars);
+	}
+	return code + ")";
+}
+
+/// Write the code for the element `i` of the result.
+static std::string gen_expr(const Handle& h, const HandleSeq& vars)
+{
+	if (h->is_type(VARIABLE_NODE))
+	{
+		auto it = std::find(vars.begin(), vars.end(), h);
+		if (vars.end() == it)
+			throw RuntimeException(TRACE_INFO,
+				"Undeclared variable %s", h->to_string().c_str());
+		return "v" + std::to_string(it - vars.begin()) + "[i]";
+	}
+
+	if (h->is_type(NUMBER_NODE))
+	{
+		NumberNodePtr nn = NumberNodeCast(h);
+		if (1 != nn->size())
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a single number, got %s", h->to_string().c_str());
+		return gen_number(nn->get_value());
+	}
+
+	if (h->is_type(PLUS_LINK))
+		return gen_join(h, vars, " + ");
+	if (h->is_type(TIMES_LINK))
+		return gen_join(h, vars, " * ");
+	if (h->is_type(DIVIDE_LINK))
+		return gen_join(h, vars, " / ");
+	if (h->is_type(MINUS_LINK))
+	{
+		if (1 == h->size())
+			return "(-" + gen_expr(h->getOutgoingAtom(0), vars) + ")";
+		return gen_join(h, vars, " - ");
+	}
+
+	throw RuntimeException(TRACE_INFO,
+		"Unable to generate a kernel for %s", h->to_string().c_str());
+}
+
+/// Write the argument list; `first` is the pointer to the results,
+/// and `extra` goes just before the length.
+static std::string gen_args(const std::string& name, const char* first,
+                            size_t num_inputs, const char* extra)
+{
+	std::string indent(std::string("kernel void ").size() + name.size() + 1, ' ');
+	std::string code = "kernel void " + name + "(global double *" + first;
+	for (size_t i = 0; i < num_inputs; i++)
+		code += ",\n" + indent + "global const double *v" + std::to_string(i);
+	if (extra)
+		code += ",\n" + indent + extra;
+	code += ",\n" + indent + "const unsigned long sz)\n";
+	return code;
+}
+
+FusedKernel opencog::gen_fused_kernel(const Handle& lambda)
+{
+	if (not lambda->is_type(LAMBDA_LINK) or 2 != lambda->size())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting Lambda, got %s", lambda->to_string().c_str());
+
+	FusedKernel fk;
+	HandleSeq vars = get_vars(lambda);
+	fk.num_inputs = vars.size();
+
+	char buf[40];
+	snprintf(buf, sizeof(buf), "fused_%016llx",
+		(unsigned long long) lambda->get_hash());
+	fk.name = buf;
+
+	Handle body = lambda->getOutgoingAtom(1);
+	fk.accumulate = body->is_type(ACCUMULATE_LINK);
+	if (fk.accumulate)
+	{
+		if (1 != body->size())
+			throw RuntimeException(TRACE_INFO,
+				"Expecting one argument, got %s", body->to_string().c_str());
+		body = body->getOutgoingAtom(0);
+	}
+	std::string expr = gen_expr(body, vars);
+
+	// The first stage of a sum. The second is in the reduction library.
+	if (fk.accumulate)
+	{
+		fk.source = reduction_preamble() + "\n" +
+			gen_args(fk.name, "part", fk.num_inputs, "local double *scratch") +
+			"{\n"
+			"\tdouble acc = 0.0;\n"
+			"\tfor (size_t i = get_global_id(0); i < sz; i += get_global_size(0))\n"
+			"\t\tacc += " + expr + ";\n"
+			"\tacc = group_sum(acc, scratch);\n"
+			"\tif (0 == get_local_id(0)) part[get_group_id(0)] = acc;\n"
+			"}\n";
+		fk.iface = reduction_iface(fk.num_inputs);
+		return fk;
+	}
+
+	fk.source = reduction_preamble() + "\n" +
+		gen_args(fk.name, "out", fk.num_inputs, nullptr) +
+		"{\n"
+		"\tsize_t i = get_global_id(0);\n"
+		"\n"
+		"\tif (i < sz)\n"
+		"\t\tout[i] = " + expr + ";\n"
+		"}\n";
+
+	// The interface is what GenIDL says it is, same as for any
+	// other kernel.
+	GenIDL gidl;
+	HandleSeq ifcs = gidl.gen_idl(fk.source);
+	if (1 != ifcs.size())
+		throw RuntimeException(TRACE_INFO,
+			"Unable to describe the kernel for %s", lambda->to_string().c_str());
+	fk.iface = ifcs[0]->getOutgoingAtom(1);
+	return fk;
+}
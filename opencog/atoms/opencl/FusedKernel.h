@@ -0,0 +1,79 @@
+/*
+ * opencog/atoms/opencl/FusedKernel.h
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_OPENCL_FUSED_KERNEL_H
+#define _OPENCOG_OPENCL_FUSED_KERNEL_H
+
+#include <string>
+#include <opencog/atoms/base/Handle.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Fused kernels: OpenCL C generated from Atomese arithmetic.
+ *
+ * Running `(Accumulate (Times A B))` as a vec_mult kernel, followed
+ * by a sum, makes two passes over memory, and leaves an intermediate
+ * vector the size of A on the device, in between. Instead, the code
+ * here writes a single kernel, that does the whole thing in one pass,
+ * without the intermediate. The arithmetic is given as a Lambda, and
+ * used in place of the kernel name, like so:
+ *
+ *     (Section
+ *         (Lambda
+ *             (VariableList (Variable "a") (Variable "b"))
+ *             (Accumulate (Times (Variable "a") (Variable "b"))))
+ *         (ConnectorSeq
+ *             (Number 0)            ; result goes here
+ *             (Number 1 2 3 4 5)    ; this is "a"
+ *             (Number 1 1 1 2 2)))  ; this is "b"
+ *
+ * The Variables are vectors, bound to the arguments following the
+ * result, in the order in which they are declared. The body can use
+ * PlusLink, MinusLink, TimesLink and DivideLink, as well as single
+ * numbers, all of them applied element-wise. If the body is wrapped
+ * in an AccumulateLink, then the kernel is the first stage of a sum,
+ * and the result is a single number; see Reductions.h. Otherwise,
+ * the result is a vector.
+ *
+ * All arithmetic is in double precision.
+ */
+struct FusedKernel
+{
+	std::string name;      // Kernel name, derived from the hash of the Lambda
+	std::string source;    // OpenCL C source code
+	Handle iface;          // ConnectorSeq describing the arguments
+	size_t num_inputs;     // Number of input vectors
+	bool accumulate;       // True if the result is a sum
+};
+
+FusedKernel gen_fused_kernel(const Handle& lambda);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_OPENCL_FUSED_KERNEL_H
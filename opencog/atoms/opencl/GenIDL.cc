@@ -24,9 +24,11 @@
 #include <sstream>
 #include <algorithm>
 
+#include <opencog/atoms/atom_types/NameServer.h>
 #include <opencog/atoms/base/Node.h>
 #include <opencog/atoms/base/Link.h>
 #include <opencog/atoms/opencl/GenIDL.h>
+#include <opencog/opencl/types/atom_types.h>
 
 using namespace opencog;
 
@@ -41,8 +43,12 @@ GenIDL::~GenIDL()
 
 void GenIDL::init_common_connectors()
 {
-	// Pre-create the only three connectors we need
+	// Pre-create the only connectors we need
 	Handle fv_type = createNode(TYPE_NODE, "FloatValue");
+	Handle f32_type = createNode(TYPE_NODE,
+		nameserver().getTypeName(OPENCL_FLOAT32_VALUE));
+	Handle half_type = createNode(TYPE_NODE,
+		nameserver().getTypeName(OPENCL_HALF_VALUE));
 	Handle in_sex = createNode(SEX_NODE, "input");
 	Handle out_sex = createNode(SEX_NODE, "output");
 	Handle scalar_sex = createNode(SEX_NODE, "scalar");
@@ -50,6 +56,11 @@ void GenIDL::init_common_connectors()
 	_fv_in_cnctr = createLink(CONNECTOR, fv_type, in_sex);
 	_fv_out_cnctr = createLink(CONNECTOR, fv_type, out_sex);
 	_fv_scalar_cnctr = createLink(CONNECTOR, fv_type, scalar_sex);
+
+	_f32_in_cnctr = createLink(CONNECTOR, f32_type, in_sex);
+	_f32_out_cnctr = createLink(CONNECTOR, f32_type, out_sex);
+	_half_in_cnctr = createLink(CONNECTOR, half_type, in_sex);
+	_half_out_cnctr = createLink(CONNECTOR, half_type, out_sex);
 }
 
 
@@ -81,6 +92,22 @@ GenIDL::determine_sex(const std::string& param_type) const
 	return "scalar";
 }
 
+/// Return the element type of a pointer parameter: "half", "float"
+/// or "" for everything else. Vector types, such as float4, are not
+/// handled, yet, and fall into the latter category.
+std::string
+GenIDL::determine_precision(const std::string& param_type) const
+{
+	static const std::regex half_regex(R"(\bhalf\b)");
+	static const std::regex float_regex(R"(\bfloat\b)");
+
+	if (std::regex_search(param_type, half_regex))
+		return "half";
+	if (std::regex_search(param_type, float_regex))
+		return "float";
+	return "";
+}
+
 std::vector<std::string>
 GenIDL::parse_parameters(const std::string& kernel_decl) const
 {
@@ -147,8 +174,10 @@ GenIDL::extract_kernels(const std::string& opencl_src) const
 	std::vector<std::string> kernels;
 
 	// Regular expression to match kernel function declarations
-	// Matches "kernel void functionName(...)"
-	std::regex kernel_regex(R"(kernel\s+void\s+\w+\s*\([^)]*\))");
+	// Matches "kernel void functionName(...)", with an optional
+	// attribute, such as reqd_work_group_size, before the void.
+	std::regex kernel_regex(
+		R"(kernel\s+(?:__attribute__\s*\(\(.*?\)\)\s*)?void\s+\w+\s*\([^)]*\))");
 
 	auto kernels_begin = std::sregex_iterator(opencl_src.begin(), opencl_src.end(), kernel_regex);
 	auto kernels_end = std::sregex_iterator();
@@ -171,20 +200,31 @@ GenIDL::generate_kernel_section(const std::string& kernel_decl)
 		return Handle::UNDEFINED;
 
 	// Parse parameters
-	auto param_types = parse_parameters(kernel_decl);
+	return generate_kernel_section(
+		KernelDecl{kernel_name, parse_parameters(kernel_decl)});
+}
 
+Handle
+GenIDL::generate_kernel_section(const KernelDecl& decl)
+{
 	// Build connector sequence
 	HandleSeq connectors;
-	for (const auto& param_type : param_types)
+	for (const auto& param_type : decl.param_types)
 	{
 		std::string sex = determine_sex(param_type);
+		std::string prec = determine_precision(param_type);
 
-		// Use the appropriate pre-created connector
+		// Use the appropriate pre-created connector. Scalars are
+		// passed by value, and so are the same for all precisions.
 		Handle connector;
-		if (sex == "output")
-			connector = _fv_out_cnctr;
-		else if (sex == "scalar")
+		if (sex == "scalar")
 			connector = _fv_scalar_cnctr;
+		else if (prec == "half")
+			connector = (sex == "output") ? _half_out_cnctr : _half_in_cnctr;
+		else if (prec == "float")
+			connector = (sex == "output") ? _f32_out_cnctr : _f32_in_cnctr;
+		else if (sex == "output")
+			connector = _fv_out_cnctr;
 		else  // "input"
 			connector = _fv_in_cnctr;
 
@@ -192,7 +232,7 @@ GenIDL::generate_kernel_section(const std::string& kernel_decl)
 	}
 
 	return createLink(SECTION,
-		createNode(ITEM_NODE, kernel_name),
+		createNode(ITEM_NODE, decl.name),
 		createLink(connectors, CONNECTOR_SEQ));
 }
 
@@ -214,3 +254,12 @@ GenIDL::gen_idl(const std::string& opencl_src)
 
 	return sections;
 }
+
+HandleSeq
+GenIDL::gen_idl(const std::vector<KernelDecl>& decls)
+{
+	HandleSeq sections;
+	for (const KernelDecl& decl : decls)
+		sections.emplace_back(generate_kernel_section(decl));
+	return sections;
+}
@@ -60,10 +60,27 @@ namespace opencog
  *             (Connector (Type 'FloatValue) (Sex "input"))
  *             (Connector (Type 'FloatValue) (Sex "scalar"))))
  *
+ * Pointers to `float` and `half` are given the connector types
+ * OpenclFloat32Value and OpenclHalfValue, respectively, so that the
+ * vectors passed to them are converted to the right precision. All
+ * other pointers are taken to be pointers to double.
+ *
+ * Programs that are already built, including SPIR-V programs, for
+ * which there is no source, can be described without any parsing,
+ * from the argument info that OpenCL keeps for each kernel. This
+ * is passed in as a KernelDecl, with one type string per argument,
+ * such as "const float*" or "ulong".
+ *
  * See the notes in Design-C.md on why this is a good idea, and
  * Design-E.md as to why this is a bad idea.
  */
 
+struct KernelDecl
+{
+	std::string name;
+	std::vector<std::string> param_types;
+};
+
 class GenIDL
 {
 protected:
@@ -71,6 +88,10 @@ protected:
 	Handle _fv_in_cnctr;
 	Handle _fv_out_cnctr;
 	Handle _fv_scalar_cnctr;
+	Handle _f32_in_cnctr;
+	Handle _f32_out_cnctr;
+	Handle _half_in_cnctr;
+	Handle _half_out_cnctr;
 
 	// Helper methods for parsing
 	std::vector<std::string> extract_kernels(const std::string& opencl_src) const;
@@ -79,10 +100,12 @@ protected:
 
 	// Helper methods for Atomese generation
 	Handle generate_kernel_section(const std::string& kernel_decl);
+	Handle generate_kernel_section(const KernelDecl&);
 
 	// Utility methods
 	std::string trim(const std::string& str) const;
 	std::string determine_sex(const std::string& param_type) const;
+	std::string determine_precision(const std::string& param_type) const;
 
 	// Initialize common connectors
 	void init_common_connectors();
@@ -98,6 +121,14 @@ public:
 	 * @return HandleSeq containing Section for each kernel
 	 */
 	HandleSeq gen_idl(const std::string& opencl_src);
+
+	/**
+	 * Generate IDL from kernel argument types
+	 *
+	 * @param decls The name and argument types of each kernel
+	 * @return HandleSeq containing Section for each kernel
+	 */
+	HandleSeq gen_idl(const std::vector<KernelDecl>& decls);
 };
 
 /** @}*/
@@ -0,0 +1,381 @@
+/*
+ * opencog/atoms/opencl/NativeKernels.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define HAVE_X86_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define HAVE_NEON 1
+#endif
+
+#include <opencog/atoms/opencl/NativeKernels.h>
+
+using namespace opencog;
+
+// ==============================================================
+// The loops, in several flavors. Each one does the bulk of the vector
+// with SIMD, and the tail, if any, one element at a time.
+
+struct SimdOps
+{
+	const char* isa;
+	void (*add)(double*, const double*, const double*, size_t);
+	void (*mult)(double*, const double*, const double*, size_t);
+	double (*sum)(const double*, size_t);
+	double (*dot)(const double*, const double*, size_t);
+	double (*max)(const double*, size_t);
+};
+
+// --------------------------------------------------------------
+// Plain C++
+
+static void add_plain(double* out, const double* a, const double* b, size_t n)
+{
+	for (size_t i = 0; i < n; i++) out[i] = a[i] + b[i];
+}
+
+static void mult_plain(double* out, const double* a, const double* b, size_t n)
+{
+	for (size_t i = 0; i < n; i++) out[i] = a[i] * b[i];
+}
+
+static double sum_plain(const double* a, size_t n)
+{
+	double acc = 0.0;
+	for (size_t i = 0; i < n; i++) acc += a[i];
+	return acc;
+}
+
+static double dot_plain(const double* a, const double* b, size_t n)
+{
+	double acc = 0.0;
+	for (size_t i = 0; i < n; i++) acc += a[i] * b[i];
+	return acc;
+}
+
+static double max_plain(const double* a, size_t n)
+{
+	double acc = -std::numeric_limits<double>::infinity();
+	for (size_t i = 0; i < n; i++) acc = std::fmax(acc, a[i]);
+	return acc;
+}
+
+static const SimdOps plain_ops =
+	{"plain", add_plain, mult_plain, sum_plain, dot_plain, max_plain};
+
+// --------------------------------------------------------------
+#ifdef HAVE_X86_SIMD
+#define AVX2 __attribute__((target("avx2,fma")))
+
+AVX2 static double hsum256(__m256d v)
+{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_add_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+AVX2 static double hmax256(__m256d v)
+{
+	__m128d lo = _mm256_castpd256_pd128(v);
+	__m128d hi = _mm256_extractf128_pd(v, 1);
+	lo = _mm_max_pd(lo, hi);
+	return _mm_cvtsd_f64(_mm_max_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+AVX2 static void add_avx2(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(out+i,
+			_mm256_add_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+	for (; i < n; i++) out[i] = a[i] + b[i];
+}
+
+AVX2 static void mult_avx2(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		_mm256_storeu_pd(out+i,
+			_mm256_mul_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i)));
+	for (; i < n; i++) out[i] = a[i] * b[i];
+}
+
+AVX2 static double sum_avx2(const double* a, size_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm256_add_pd(acc, _mm256_loadu_pd(a+i));
+	double tot = hsum256(acc);
+	for (; i < n; i++) tot += a[i];
+	return tot;
+}
+
+AVX2 static double dot_avx2(const double* a, const double* b, size_t n)
+{
+	__m256d acc = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4)
+		acc = _mm256_fmadd_pd(_mm256_loadu_pd(a+i), _mm256_loadu_pd(b+i), acc);
+	double tot = hsum256(acc);
+	for (; i < n; i++) tot += a[i] * b[i];
+	return tot;
+}
+
+AVX2 static double max_avx2(const double* a, size_t n)
+{
+	double tot = -std::numeric_limits<double>::infinity();
+	size_t i = 0;
+	if (4 <= n)
+	{
+		__m256d acc = _mm256_set1_pd(tot);
+		for (; i + 4 <= n; i += 4)
+			acc = _mm256_max_pd(acc, _mm256_loadu_pd(a+i));
+		tot = hmax256(acc);
+	}
+	for (; i < n; i++) tot = std::fmax(tot, a[i]);
+	return tot;
+}
+
+static const SimdOps avx2_ops =
+	{"avx2", add_avx2, mult_avx2, sum_avx2, dot_avx2, max_avx2};
+
+// --------------------------------------------------------------
+#define AVX512 __attribute__((target("avx512f")))
+
+AVX512 static void add_avx512(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out+i,
+			_mm512_add_pd(_mm512_loadu_pd(a+i), _mm512_loadu_pd(b+i)));
+	for (; i < n; i++) out[i] = a[i] + b[i];
+}
+
+AVX512 static void mult_avx512(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		_mm512_storeu_pd(out+i,
+			_mm512_mul_pd(_mm512_loadu_pd(a+i), _mm512_loadu_pd(b+i)));
+	for (; i < n; i++) out[i] = a[i] * b[i];
+}
+
+AVX512 static double sum_avx512(const double* a, size_t n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm512_add_pd(acc, _mm512_loadu_pd(a+i));
+	double tot = _mm512_reduce_add_pd(acc);
+	for (; i < n; i++) tot += a[i];
+	return tot;
+}
+
+AVX512 static double dot_avx512(const double* a, const double* b, size_t n)
+{
+	__m512d acc = _mm512_setzero_pd();
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8)
+		acc = _mm512_fmadd_pd(_mm512_loadu_pd(a+i), _mm512_loadu_pd(b+i), acc);
+	double tot = _mm512_reduce_add_pd(acc);
+	for (; i < n; i++) tot += a[i] * b[i];
+	return tot;
+}
+
+AVX512 static double max_avx512(const double* a, size_t n)
+{
+	double tot = -std::numeric_limits<double>::infinity();
+	size_t i = 0;
+	if (8 <= n)
+	{
+		__m512d acc = _mm512_set1_pd(tot);
+		for (; i + 8 <= n; i += 8)
+			acc = _mm512_max_pd(acc, _mm512_loadu_pd(a+i));
+		tot = _mm512_reduce_max_pd(acc);
+	}
+	for (; i < n; i++) tot = std::fmax(tot, a[i]);
+	return tot;
+}
+
+static const SimdOps avx512_ops =
+	{"avx512", add_avx512, mult_avx512, sum_avx512, dot_avx512, max_avx512};
+#endif // HAVE_X86_SIMD
+
+// --------------------------------------------------------------
+#ifdef HAVE_NEON
+static void add_neon(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out+i, vaddq_f64(vld1q_f64(a+i), vld1q_f64(b+i)));
+	for (; i < n; i++) out[i] = a[i] + b[i];
+}
+
+static void mult_neon(double* out, const double* a, const double* b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+		vst1q_f64(out+i, vmulq_f64(vld1q_f64(a+i), vld1q_f64(b+i)));
+	for (; i < n; i++) out[i] = a[i] * b[i];
+}
+
+static double sum_neon(const double* a, size_t n)
+{
+	float64x2_t acc = vdupq_n_f64(0.0);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+		acc = vaddq_f64(acc, vld1q_f64(a+i));
+	double tot = vaddvq_f64(acc);
+	for (; i < n; i++) tot += a[i];
+	return tot;
+}
+
+static double dot_neon(const double* a, const double* b, size_t n)
+{
+	float64x2_t acc = vdupq_n_f64(0.0);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+		acc = vfmaq_f64(acc, vld1q_f64(a+i), vld1q_f64(b+i));
+	double tot = vaddvq_f64(acc);
+	for (; i < n; i++) tot += a[i] * b[i];
+	return tot;
+}
+
+static double max_neon(const double* a, size_t n)
+{
+	double tot = -std::numeric_limits<double>::infinity();
+	size_t i = 0;
+	if (2 <= n)
+	{
+		float64x2_t acc = vdupq_n_f64(tot);
+		for (; i + 2 <= n; i += 2)
+			acc = vmaxq_f64(acc, vld1q_f64(a+i));
+		tot = vmaxvq_f64(acc);
+	}
+	for (; i < n; i++) tot = std::fmax(tot, a[i]);
+	return tot;
+}
+
+static const SimdOps neon_ops =
+	{"neon", add_neon, mult_neon, sum_neon, dot_neon, max_neon};
+#endif // HAVE_NEON
+
+// --------------------------------------------------------------
+
+/// The best flavor that this CPU can run.
+static const SimdOps& simd(void)
+{
+	static const SimdOps* ops = []()
+	{
+#ifdef HAVE_X86_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return &avx512_ops;
+		if (__builtin_cpu_supports("avx2") and
+		    __builtin_cpu_supports("fma")) return &avx2_ops;
+#endif
+#ifdef HAVE_NEON
+		return &neon_ops;
+#endif
+		return &plain_ops;
+	}();
+	return *ops;
+}
+
+const char* opencog::native_isa(void)
+{
+	return simd().isa;
+}
+
+// ==============================================================
+// The kernels. The arguments are in the same order as for the
+// OpenCL kernels, with the output first.
+
+static void vec_add(double* out, const double* const* in, size_t n)
+{
+	simd().add(out, in[0], in[1], n);
+}
+
+static void vec_mult(double* out, const double* const* in, size_t n)
+{
+	simd().mult(out, in[0], in[1], n);
+}
+
+// Rounded to single precision, as the device would have done.
+static void vec_mult_f32(double* out, const double* const* in, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		out[i] = (float) in[0][i] * (float) in[1][i];
+}
+
+static void reduce_sum(double* out, const double* const* in, size_t n)
+{
+	out[0] = simd().sum(in[0], n);
+}
+
+static void reduce_dot(double* out, const double* const* in, size_t n)
+{
+	out[0] = simd().dot(in[0], in[1], n);
+}
+
+static void reduce_max(double* out, const double* const* in, size_t n)
+{
+	out[0] = simd().max(in[0], n);
+}
+
+static void reduce_norm(double* out, const double* const* in, size_t n)
+{
+	out[0] = std::sqrt(simd().dot(in[0], in[0], n));
+}
+
+static void reduce_cosine(double* out, const double* const* in, size_t n)
+{
+	double ab = simd().dot(in[0], in[1], n);
+	double aa = simd().dot(in[0], in[0], n);
+	double bb = simd().dot(in[1], in[1], n);
+	out[0] = (0.0 < aa*bb) ? ab / std::sqrt(aa*bb) : 0.0;
+}
+
+static const NativeKernel natives[] =
+{
+	{"vec_add",       2, vec_add},
+	{"vec_mult",      2, vec_mult},
+	{"vec_mult_f32",  2, vec_mult_f32},
+	{"reduce_sum",    1, reduce_sum},
+	{"reduce_dot",    2, reduce_dot},
+	{"reduce_max",    1, reduce_max},
+	{"reduce_norm",   1, reduce_norm},
+	{"reduce_cosine", 2, reduce_cosine},
+};
+
+const NativeKernel* opencog::find_native_kernel(const std::string& name)
+{
+	for (const NativeKernel& nk : natives)
+		if (0 == name.compare(nk.name)) return &nk;
+	return nullptr;
+}
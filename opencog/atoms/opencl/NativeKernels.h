@@ -0,0 +1,70 @@
+/*
+ * opencog/atoms/opencl/NativeKernels.h
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_OPENCL_NATIVE_KERNELS_H
+#define _OPENCOG_OPENCL_NATIVE_KERNELS_H
+
+#include <string>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Native kernels: host implementations of the stock kernels, for
+ * use when there is no OpenCL device at all. These are selected with
+ * a URL of the form
+ *
+ *     opencl://native:/path/to/vec-kernel.cl
+ *
+ * The program is still read, so that GenIDL can describe it, and the
+ * Sections are checked against these descriptions, as usual; but
+ * nothing is compiled. Instead, the kernels below are run directly
+ * over the host storage of the vectors, in the dispatch threads.
+ * There are no copies to or from device buffers.
+ *
+ * The loops use AVX-512 or AVX2 on x86, if the CPU has them; this is
+ * decided at run time, so that one build runs anywhere. On 64-bit ARM,
+ * they use NEON. Otherwise, they are plain C++.
+ *
+ * Only kernels that are known by name can be run: vec_add, vec_mult,
+ * vec_mult_f32 and the reductions of Reductions.h
+ */
+typedef void (*NativeFunc)(double* out, const double* const* in, size_t n);
+
+struct NativeKernel
+{
+	const char* name;
+	size_t num_inputs;
+	NativeFunc func;
+};
+
+const NativeKernel* find_native_kernel(const std::string&);
+const char* native_isa(void);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_OPENCL_NATIVE_KERNELS_H
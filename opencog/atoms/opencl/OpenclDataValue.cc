@@ -20,6 +20,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <opencog/util/exceptions.h>
 #include "OpenclDataValue.h"
 #include "OpenclNode.h"
@@ -29,66 +32,637 @@ using namespace opencog;
 OpenclDataValue::OpenclDataValue(void) :
 	_have_buff(false),
 	_buffer{},
-	_read_queue{},
-	_read_event{}
+	_bucket(0),
+	_pool_gen(0),
+	_offset(0),
+	_batch_members(0),
+	_zero_copy(false),
+	_svm_ptr(nullptr),
+	_svm_fine(false),
+	_last_event{},
+	_host_gen(1),
+	_sent_gen(0),
+	_dev_gen(0),
+	_fetched_gen(0),
+	_dirty_lo(0),
+	_dirty_hi(SIZE_MAX),
+	_range_gen(0),
+	_range_lo(0),
+	_range_hi(0),
+	_rows(0),
+	_cols(0),
+	_stride(0),
+	_lazy(false),
+	_fetching_gen(0),
+	_merge_busy(0)
 {
 }
 
 OpenclDataValue::~OpenclDataValue()
 {
+	if (_oclnode)
+		OpenclNodeCast(_oclnode)->forget_resident(this);
+	release_buffer();
+}
+
+/// Hand the buffer back to the pool, for use by someone else.
+void OpenclDataValue::release_buffer(void)
+{
+	// Sub-buffers are not pooled; the parent is released when the
+	// last of its sub-buffers is.
+	if (not _have_buff or _zero_copy or nullptr != _parent()) return;
+
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+
+	// The SVM free has to wait for whatever is still using the memory.
+	// This might be called from an event callback, where waiting is
+	// not allowed, so the free is enqueued, instead.
+	if (_svm_ptr)
+	{
+		std::vector<cl::Event> deps;
+		add_dependency(deps);
+		clEnqueueSVMFree(onp->get_read_queue()(), 1, &_svm_ptr,
+			nullptr, nullptr, deps.size(),
+			deps.size() ? (const cl_event*) deps.data() : nullptr,
+			nullptr);
+		return;
+	}
+
+	onp->free_buffer(_buffer, _bucket, _pool_gen, _last_event);
+}
+
+/// Give up the device storage. The host copy is brought up to date
+/// first. This must not run at the same time as a job using the
+/// vector is submitted; jobs built before this get a new buffer when
+/// they are submitted. Zero-copy vectors have nothing to give up.
+void OpenclDataValue::evict(void)
+{
+	if (not _have_buff or _zero_copy) return;
+	materialize();
+	fetch_buffer();
+
+	std::lock_guard<std::mutex> lck(_buf_mtx);
+	if (not _have_buff) return;
+	release_buffer();
+	_buffer = cl::Buffer();
+	_parent = cl::Buffer();
+	_svm_ptr = nullptr;
+	_svm_fine = false;
+	_bucket = 0;
+	_offset = 0;
+	_batch_members = 0;
+	_have_buff = false;
 }
 
 /// Set up info about the GPU for this instance.
 void OpenclDataValue::set_context(const Handle& oclno)
 {
+	std::lock_guard<std::mutex> lck(_buf_mtx);
 	if (_have_buff) return;
-	_have_buff = true;
 
 	OpenclNodePtr onp = OpenclNodeCast(oclno);
+	_oclnode = oclno;
 
-	// We use two different queues. For reads, we used our own queue
-	// and event handler. This allows data to be read async from the
-	// writers, avoiding getting accidentally blocked on the main
-	// OpenclNode::_queue, which used for running kernels, and might
-	// be busy for a long time.
-	_read_queue = cl::CommandQueue(onp->get_context(), onp->get_device());
-	_read_event = cl::Event();
-
+	// Make sure data() points at storage of the right size; the
+	// zero-copy buffer is wrapped around it, and so there must be
+	// host storage.
+	if (onp->_zero_copy and not onp->_use_svm)
+		materialize();
+	if (not _lazy)
+		pack();
 	size_t nbytes = reserve_size();
-	_buffer = cl::Buffer(onp->get_context(), CL_MEM_READ_WRITE, nbytes);
+
+	if (onp->_use_svm and 0 < nbytes)
+	{
+		cl_svm_mem_flags flags = CL_MEM_READ_WRITE;
+		if (onp->_svm_fine) flags |= CL_MEM_SVM_FINE_GRAIN_BUFFER;
+		_svm_ptr = clSVMAlloc(onp->get_context()(), flags, nbytes, 0);
+		if (nullptr == _svm_ptr)
+			throw RuntimeException(TRACE_INFO,
+				"Unable to allocate %zu bytes of SVM", nbytes);
+		_svm_fine = onp->_svm_fine;
+	}
+
+	// For zero-copy, the buffer is wrapped around the host memory.
+	// Most drivers need this to be page-aligned to avoid making a
+	// hidden copy; if it is not, things still work, just slower.
+	else if (onp->_zero_copy and 0 < nbytes)
+	{
+		_buffer = cl::Buffer(onp->get_context(),
+			CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, nbytes, data());
+		_zero_copy = true;
+	}
+	else
+		_buffer = onp->alloc_buffer(nbytes, _bucket, _pool_gen, _last_event);
+	_have_buff = true;
+
+	// The new buffer does not yet hold the host data.
+	_sent_gen = 0;
+	_fetched_gen = (size_t) _dev_gen;
 }
 
-/// Synchronously send data to the GPU
-void OpenclDataValue::send_buffer(const Handle& oclno) const
+/// Use a region of a shared buffer, starting at `offset`, instead of
+/// a buffer of our own. The parent holds `members` values, all told.
+void OpenclDataValue::set_sub_buffer(const Handle& oclno,
+                                     const cl::Buffer& parent,
+                                     size_t offset, size_t members)
+{
+	std::lock_guard<std::mutex> lck(_buf_mtx);
+	if (_have_buff) return;
+	_oclnode = oclno;
+
+	if (not _lazy)
+		pack();
+	cl_buffer_region region{offset, reserve_size()};
+	_parent = parent;
+	_buffer = _parent.createSubBuffer(CL_MEM_READ_WRITE,
+		CL_BUFFER_CREATE_TYPE_REGION, &region);
+	_offset = offset;
+	_batch_members = members;
+	_have_buff = true;
+
+	_sent_gen = 0;
+	_fetched_gen = (size_t) _dev_gen;
+}
+
+void OpenclDataValue::bind_arg(cl::Kernel& kern, size_t pos) const
+{
+	std::lock_guard<std::mutex> lck(_buf_mtx);
+	if (_svm_ptr)
+	{
+		cl_int rc = clSetKernelArgSVMPointer(kern(), pos, _svm_ptr);
+		if (CL_SUCCESS != rc)
+			throw RuntimeException(TRACE_INFO,
+				"SVM argument %zu failed: %d", pos, rc);
+	}
+	else
+		kern.setArg(pos, _buffer);
+}
+
+void OpenclDataValue::bind_part(cl::Kernel& kern, size_t pos,
+                                size_t offset, size_t nbytes) const
+{
+	std::lock_guard<std::mutex> lck(_buf_mtx);
+	cl_buffer_region region{offset, nbytes};
+	cl::Buffer part = _buffer.createSubBuffer(CL_MEM_READ_WRITE,
+		CL_BUFFER_CREATE_TYPE_REGION, &region);
+	kern.setArg(pos, part);
+}
+
+/// Append the most recent command on this buffer, if any, to the
+/// list of events that must complete before the next command can run.
+void OpenclDataValue::add_dependency(std::vector<cl::Event>& deps) const
+{
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	if (nullptr != _last_event())
+		deps.push_back(_last_event);
+}
+
+void OpenclDataValue::set_last_event(const cl::Event& evt) const
+{
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	_last_event = evt;
+}
+
+/// The whole of the host copy has changed.
+void OpenclDataValue::mark_host_dirty(void) const
+{
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	_dirty_lo = 0;
+	_dirty_hi = SIZE_MAX;
+	_host_gen++;
+}
+
+/// Elements `lo` up to `hi` of the host copy have changed. If there
+/// were changes already that haven't been sent, the range grows to
+/// cover those, too.
+void OpenclDataValue::mark_host_dirty(size_t lo, size_t hi) const
+{
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	if (_sent_gen == _host_gen)
+	{
+		_dirty_lo = lo;
+		_dirty_hi = hi;
+	}
+	else
+	{
+		_dirty_lo = std::min(_dirty_lo, lo);
+		_dirty_hi = std::max(_dirty_hi, hi);
+	}
+	_host_gen++;
+}
+
+/// Asynchronously send data to the GPU. The `done` event is signalled
+/// when the copy has completed. The host data must remain untouched
+/// until then.
+///
+/// If the host data has not changed since the last upload, nothing is
+/// sent, and `done` is set to the last command on the buffer. This is
+/// also the case if a kernel has written the buffer since then: the
+/// device copy is then newer than the host copy, and must not be
+/// clobbered by it.
+void OpenclDataValue::send_buffer(cl::CommandQueue& queue,
+                                  cl::Event& done) const
 {
 	if (not _have_buff)
 		throw RuntimeException(TRACE_INFO,
 			"No buffer!");
 
-	OpenclNodePtr onp = OpenclNodeCast(oclno);
-	cl::CommandQueue& queue = onp->get_queue();
-	cl::Event& event_handler = onp->get_handler();
+	size_t gen = _host_gen;
+	if (gen == _sent_gen or host_is_stale())
+	{
+		std::lock_guard<std::mutex> lck(_event_mtx);
+		done = _last_event;
+		if (nullptr != done()) return;
 
-	size_t nbytes = reserve_size();
-	const void* bytes = data();
+		// Nothing ever ran on this buffer; the done event must
+		// still be something that can be waited on.
+		cl::UserEvent uev(queue.getInfo<CL_QUEUE_CONTEXT>());
+		uev.setStatus(CL_COMPLETE);
+		done = uev;
+		return;
+	}
+
+	std::vector<cl::Event> deps;
+	add_dependency(deps);
+
+	// There's no host copy of a lazy vector; it's all zeros.
+	if (_lazy)
+	{
+		size_t nbytes = reserve_size();
+		if (_svm_ptr)
+		{
+			cl_uchar zero = 0;
+			cl_event evt;
+			cl_int rc = clEnqueueSVMMemFill(queue(), _svm_ptr,
+				&zero, 1, nbytes, deps.size(),
+				deps.size() ? (const cl_event*) deps.data() : nullptr,
+				&evt);
+			if (CL_SUCCESS != rc)
+				throw RuntimeException(TRACE_INFO,
+					"SVM fill failed: %d", rc);
+			done = cl::Event(evt);
+		}
+		else
+			queue.enqueueFillBuffer(_buffer, (cl_uchar) 0, 0, nbytes,
+				&deps, &done);
+		set_last_event(done);
+		_sent_gen = gen;
+		return;
+	}
+
+	// Only the changed part is sent, if the device already has the
+	// rest. The very first upload is always all of it.
+	size_t esz = elem_size();
+	size_t nelems = reserve_size() / esz;
+	size_t lo = 0;
+	size_t hi = nelems;
+	if (0 != _sent_gen)
+	{
+		std::lock_guard<std::mutex> lck(_event_mtx);
+		lo = std::min(_dirty_lo, nelems);
+		hi = std::min(_dirty_hi, nelems);
+		if (hi <= lo) { lo = 0; hi = nelems; }
+	}
+	if (0 == lo and nelems == hi)
+		pack();
+	else
+		pack_range(lo, hi);
+
+	size_t offset = lo * esz;
+	size_t nbytes = (hi - lo) * esz;
+	const void* bytes = (const char*) data() + offset;
+
+	// SVM copies are done with the SVM memcpy, which, unlike a host
+	// memcpy, can wait on the events, and so does not block.
+	if (_svm_ptr)
+	{
+		cl_event evt;
+		cl_int rc = clEnqueueSVMMemcpy(queue(), CL_FALSE,
+			(char*) _svm_ptr + offset, bytes, nbytes, deps.size(),
+			deps.size() ? (const cl_event*) deps.data() : nullptr,
+			&evt);
+		if (CL_SUCCESS != rc)
+			throw RuntimeException(TRACE_INFO,
+				"SVM upload failed: %d", rc);
+		done = cl::Event(evt);
+	}
+
+	// A map/unmap pair is what makes host writes to a USE_HOST_PTR
+	// buffer visible to the device. No bytes are moved on devices
+	// with unified memory.
+	else if (_zero_copy)
+	{
+		std::vector<cl::Event> mapped(1);
+		void* ptr = queue.enqueueMapBuffer(_buffer, CL_FALSE,
+			CL_MAP_WRITE, offset, nbytes, &deps, &mapped[0]);
+		queue.enqueueUnmapMemObject(_buffer, ptr, &mapped, &done);
+	}
+	else
+		queue.enqueueWriteBuffer(_buffer, CL_FALSE, offset,
+			nbytes, bytes, &deps, &done);
+
+	set_last_event(done);
+	_sent_gen = gen;
+	profile("*-upload-*", done, nbytes);
+}
 
-	queue.enqueueWriteBuffer(_buffer, CL_TRUE, 0,
-		nbytes, bytes, nullptr, &event_handler);
-	event_handler.wait();
+/// Have the OpenclNode time the transfer, if it is profiling.
+void OpenclDataValue::profile(const char* what, const cl::Event& evt,
+                              size_t nbytes) const
+{
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+	if (onp and onp->_profile)
+		onp->profile(what, evt, nbytes, 0.0);
 }
 
-/// Synchronously get data from the GPU
+/// Wait for the results of merged launches to be copied in.
+void OpenclDataValue::wait_merged(void) const
+{
+	if (0 == _merge_busy) return;
+	cl::Event pending;
+	{
+		std::lock_guard<std::mutex> lck(_event_mtx);
+		pending = _last_event;
+	}
+	pending.wait();
+}
+
+/// Synchronously get data from the GPU. This waits for whatever
+/// kernel was last writing to the buffer.
+///
+/// Reads are done on the read queues of the OpenclNode, and not on
+/// the queues used for running kernels. Those might be busy for a
+/// long time, and the read should not have to wait behind kernels
+/// that have nothing to do with this buffer.
 void OpenclDataValue::fetch_buffer(void) const
 {
+	wait_merged();
+
+	// The buffer must not be evicted while it is being read.
+	std::lock_guard<std::mutex> buf_lck(_buf_mtx);
+
 	// No-op if not yet tied to GPU.
 	if (not _have_buff) return;
 
+	// No-op if no kernel has written to the buffer since last time.
+	// The generation must be sampled before the dependency, so that
+	// a kernel launched in the meanwhile is not missed.
+	size_t gen = _dev_gen;
+	if (gen == _fetched_gen) return;
+	materialize();
+
+	// Someone already asked for this generation; it might even be here.
+	if (gen == _fetching_gen)
+	{
+		cl::Event pending;
+		{
+			std::lock_guard<std::mutex> lck(_event_mtx);
+			pending = _fetch_event;
+		}
+		pending.wait();
+		unpack();
+		_fetched_gen = gen;
+		return;
+	}
+
+	size_t nbytes = reserve_size();
+	void* bytes = data();
+
+	std::vector<cl::Event> deps;
+	add_dependency(deps);
+
+	// Fine-grained SVM is coherent with the host once the device is
+	// done with it; there is no need to go through a command queue.
+	if (_svm_fine)
+	{
+		if (0 < deps.size()) cl::WaitForEvents(deps);
+		memcpy(bytes, _svm_ptr, nbytes);
+		unpack();
+		_fetched_gen = gen;
+		return;
+	}
+
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+	cl::CommandQueue& queue = onp->get_read_queue();
+
+	if (_svm_ptr)
+	{
+		cl_int rc = clEnqueueSVMMemcpy(queue(), CL_TRUE,
+			bytes, _svm_ptr, nbytes, deps.size(),
+			deps.size() ? (const cl_event*) deps.data() : nullptr,
+			nullptr);
+		if (CL_SUCCESS != rc)
+			throw RuntimeException(TRACE_INFO,
+				"SVM download failed: %d", rc);
+		unpack();
+		_fetched_gen = gen;
+		return;
+	}
+
+	// For zero-copy buffers, mapping brings the host memory up to
+	// date. The unmap must finish before the device can touch the
+	// buffer again, so it becomes the last event on the buffer.
+	if (_zero_copy)
+	{
+		void* ptr = queue.enqueueMapBuffer(_buffer, CL_TRUE,
+			CL_MAP_READ, 0, nbytes, &deps);
+		unpack();
+		cl::Event unmapped;
+		queue.enqueueUnmapMemObject(_buffer, ptr, nullptr, &unmapped);
+		set_last_event(unmapped);
+		_fetched_gen = gen;
+		return;
+	}
+
+	cl::Event done;
+	queue.enqueueReadBuffer(_buffer, CL_TRUE, 0,
+		nbytes, bytes, &deps, &done);
+	unpack();
+	_fetched_gen = gen;
+	profile("*-download-*", done, nbytes);
+}
+
+/// Synchronously get elements `lo` up to `hi` from the GPU. The rest
+/// of the host copy is left as it is, and is still out of date.
+void OpenclDataValue::fetch_range(size_t lo, size_t hi) const
+{
+	wait_merged();
+	std::lock_guard<std::mutex> buf_lck(_buf_mtx);
+	do_fetch_range(lo, hi);
+}
+
+/// The body of fetch_range(); the buffer lock must be held.
+void OpenclDataValue::do_fetch_range(size_t lo, size_t hi) const
+{
+	if (not _have_buff) return;
+
+	size_t gen = _dev_gen;
+	if (gen == _fetched_gen) return;
+	materialize();
+
+	size_t esz = elem_size();
+	hi = std::min(hi, reserve_size() / esz);
+	if (hi <= lo) return;
+
+	std::vector<cl::Event> deps;
+	{
+		std::lock_guard<std::mutex> lck(_event_mtx);
+		if (gen == _range_gen and _range_lo <= lo and hi <= _range_hi)
+			return;
+		if (nullptr != _last_event())
+			deps.push_back(_last_event);
+	}
+
+	size_t offset = lo * esz;
+	size_t nbytes = (hi - lo) * esz;
+	char* bytes = (char*) data() + offset;
+
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+	cl::CommandQueue& queue = onp->get_read_queue();
+
+	if (_svm_fine)
+	{
+		if (0 < deps.size()) cl::WaitForEvents(deps);
+		memcpy(bytes, (char*) _svm_ptr + offset, nbytes);
+	}
+	else if (_svm_ptr)
+	{
+		cl_int rc = clEnqueueSVMMemcpy(queue(), CL_TRUE,
+			bytes, (char*) _svm_ptr + offset, nbytes, deps.size(),
+			deps.size() ? (const cl_event*) deps.data() : nullptr,
+			nullptr);
+		if (CL_SUCCESS != rc)
+			throw RuntimeException(TRACE_INFO,
+				"SVM download failed: %d", rc);
+	}
+	else if (_zero_copy)
+	{
+		void* ptr = queue.enqueueMapBuffer(_buffer, CL_TRUE,
+			CL_MAP_READ, offset, nbytes, &deps);
+		cl::Event unmapped;
+		queue.enqueueUnmapMemObject(_buffer, ptr, nullptr, &unmapped);
+		set_last_event(unmapped);
+	}
+	else
+		queue.enqueueReadBuffer(_buffer, CL_TRUE, offset,
+			nbytes, bytes, &deps);
+
+	unpack_range(lo, hi);
+
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	_range_gen = gen;
+	_range_lo = lo;
+	_range_hi = hi;
+}
+
+/// Synchronously get a block of a matrix from the GPU. The matrix is
+/// stored row after row, each `row_len` elements long; the block is
+/// `nrows` by `ncols`, with its corner at (`row`, `col`). The block
+/// lands in the same place in the host copy as on the device.
+void OpenclDataValue::fetch_rect(size_t row, size_t col,
+                                 size_t nrows, size_t ncols,
+                                 size_t row_len) const
+{
+	wait_merged();
+	std::lock_guard<std::mutex> buf_lck(_buf_mtx);
+	if (not _have_buff or 0 == nrows or 0 == ncols) return;
+	if (_dev_gen == _fetched_gen) return;
+	materialize();
+
+	size_t esz = elem_size();
+	size_t nelems = reserve_size() / esz;
+	if (row_len < col + ncols or nelems < (row + nrows) * row_len)
+		throw RuntimeException(TRACE_INFO,
+			"Block does not fit in the vector");
+
+	// Without a buffer, there's no rect read; get all of the rows,
+	// from the first element of the block to the last.
+	if (_svm_ptr or _zero_copy)
+	{
+		do_fetch_range(row * row_len + col,
+			(row + nrows - 1) * row_len + col + ncols);
+		return;
+	}
+
+	std::vector<cl::Event> deps;
+	add_dependency(deps);
+
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+	cl::CommandQueue& queue = onp->get_read_queue();
+
+	cl::array<cl::size_type, 3> origin = {col * esz, row, 0};
+	cl::array<cl::size_type, 3> region = {ncols * esz, nrows, 1};
+	size_t pitch = row_len * esz;
+	queue.enqueueReadBufferRect(_buffer, CL_TRUE, origin, origin, region,
+		pitch, 0, pitch, 0, data(), &deps);
+
+	for (size_t r = row; r < row + nrows; r++)
+		unpack_range(r * row_len + col, r * row_len + col + ncols);
+}
+
+/// Start getting data from the GPU, without waiting for it. The
+/// `done` event completes when the data has arrived in host memory.
+/// Returns false if there is nothing to get.
+///
+/// Zero-copy buffers and fine-grained SVM need no copy, just the
+/// kernel to finish; for these, `done` is a marker, and the cheap
+/// part, the map or the memcpy, is left to fetch_buffer().
+bool OpenclDataValue::fetch_async(cl::Event& done) const
+{
+	wait_merged();
+	if (not _have_buff) return false;
+
+	size_t gen = _dev_gen;
+	if (gen == _fetched_gen) return false;
+	materialize();
+
+	OpenclNodePtr onp = OpenclNodeCast(_oclnode);
+	cl::CommandQueue& queue = onp->get_read_queue();
+
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	if (gen == _fetching_gen)
+	{
+		done = _fetch_event;
+		return true;
+	}
+
+	std::vector<cl::Event> deps;
+	if (nullptr != _last_event())
+		deps.push_back(_last_event);
+
+	if (_zero_copy or _svm_fine)
+	{
+		queue.enqueueMarkerWithWaitList(&deps, &done);
+		queue.flush();
+		return true;
+	}
+
 	size_t nbytes = reserve_size();
 	void* bytes = data();
+	if (_svm_ptr)
+	{
+		cl_event ev;
+		cl_int rc = clEnqueueSVMMemcpy(queue(), CL_FALSE,
+			bytes, _svm_ptr, nbytes, deps.size(),
+			deps.size() ? (const cl_event*) deps.data() : nullptr,
+			&ev);
+		if (CL_SUCCESS != rc)
+			throw RuntimeException(TRACE_INFO,
+				"SVM download failed: %d", rc);
+		done = cl::Event(ev);
+	}
+	else
+		queue.enqueueReadBuffer(_buffer, CL_FALSE, 0,
+			nbytes, bytes, &deps, &done);
+	profile("*-download-*", done, nbytes);
 
-	_read_queue.enqueueReadBuffer(_buffer, CL_TRUE, 0,
-		nbytes, bytes, nullptr, &_read_event);
-	_read_event.wait();
+	// Later kernels writing to the buffer must wait for the read.
+	_last_event = done;
+	_fetch_event = done;
+	_fetching_gen = gen;
+	queue.flush();
+	return true;
 }
 
 // ==============================================================
@@ -23,6 +23,9 @@
 #ifndef _OPENCOG_OPENCL_DATA_VALUE_H
 #define _OPENCOG_OPENCL_DATA_VALUE_H
 
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <opencog/atoms/opencl/opencl-headers.h>
 #include <opencog/atoms/base/Handle.h>
 
@@ -48,18 +51,150 @@ protected:
 	OpenclDataValue(void);
 	bool _have_buff;
 
+	// Guards the buffer itself: creating it, binding it to kernels,
+	// and giving it up, in evict().
+	mutable std::mutex _buf_mtx;
+
+	// The buffer comes from the buffer pool of the OpenclNode, and
+	// might be larger than needed; `_bucket` is the actual size, and
+	// `_pool_gen` the pool generation it was handed out in.
 	mutable cl::Buffer _buffer;
+	size_t _bucket;
+	size_t _pool_gen;
 	const cl::Buffer& get_buffer(void) { return _buffer; }
 
-	mutable cl::CommandQueue _read_queue;
-	mutable cl::Event _read_event;
+	// Values written together in a batch share one parent buffer;
+	// each holds a sub-buffer of it, starting at `_offset`. There are
+	// `_batch_members` values in the parent, all told.
+	// See OpenclNode-batch.cc.
+	cl::Buffer _parent;
+	size_t _offset;
+	size_t _batch_members;
+
+	// True if the buffer aliases the host memory returned by data().
+	// Such buffers are not pooled, and transfers are map/unmap pairs,
+	// instead of copies.
+	bool _zero_copy;
+
+	// Shared Virtual Memory storage, used instead of `_buffer` when the
+	// OpenclNode is in SVM mode. For fine-grained SVM, the host can
+	// read the memory directly, once the last kernel on it is done.
+	void* _svm_ptr;
+	bool _svm_fine;
+
+	// Bind this as argument `pos` of the kernel, as either a buffer
+	// or an SVM pointer.
+	void bind_arg(cl::Kernel&, size_t) const;
+
+	// Bind a part of the buffer, `nbytes` long and starting `offset`
+	// bytes in, for jobs that are split across several devices. This
+	// cannot be done for SVM, or for buffers that are themselves part
+	// of a batch; can_split() says if it can be done.
+	bool can_split(void) const { return nullptr == _svm_ptr and
+		nullptr == _parent() and _have_buff; }
+	void bind_part(cl::Kernel&, size_t, size_t offset, size_t nbytes) const;
+
+	// The OpenclNode that owns the context that the buffer lives in.
+	// Reads are done on the read queues of this OpenclNode.
+	Handle _oclnode;
+
+	// The most recent device command that touched the buffer. The
+	// buffer may be shared by jobs running on different queues; any
+	// new command on the buffer must wait for this one to finish.
+	mutable std::mutex _event_mtx;
+	mutable cl::Event _last_event;
+	void add_dependency(std::vector<cl::Event>&) const;
+	void set_last_event(const cl::Event&) const;
+
+	// Coherence tracking. The host copy and the device copy each carry
+	// a generation count. The host count is bumped whenever the host
+	// data changes; the device count is bumped whenever a kernel that
+	// has the buffer bound as an output is launched. Uploads happen
+	// only if the host has changed since the last upload, and downloads
+	// only if the device has changed since the last download.
+	mutable std::atomic<size_t> _host_gen;
+	mutable std::atomic<size_t> _sent_gen;
+	mutable std::atomic<size_t> _dev_gen;
+	mutable std::atomic<size_t> _fetched_gen;
+	void mark_host_dirty(void) const;
+	void mark_device_dirty(void) const { _dev_gen++; }
+	bool host_is_stale(void) const { return _fetched_gen != _dev_gen; }
+	bool device_is_stale(void) const { return _sent_gen != _host_gen; }
+
+	// Ranged transfers. Host changes to part of the vector mark only
+	// the elements [_dirty_lo, _dirty_hi) as changed, and only these
+	// are sent on the next upload. Likewise, fetch_range() gets only
+	// part of the vector; the last range fetched is remembered, so
+	// that looking at it again costs nothing. Both are guarded by
+	// the event lock.
+	mutable size_t _dirty_lo;
+	mutable size_t _dirty_hi;
+	mutable size_t _range_gen;
+	mutable size_t _range_lo;
+	mutable size_t _range_hi;
+	void mark_host_dirty(size_t lo, size_t hi) const;
+	void fetch_range(size_t lo, size_t hi) const;
+	void do_fetch_range(size_t lo, size_t hi) const;
+	void fetch_rect(size_t row, size_t col, size_t nrows, size_t ncols,
+	                size_t row_len) const;
+
+	// Matrices. A vector may be given the shape of `_rows` by `_cols`,
+	// stored row after row, with the rows `_stride` elements apart.
+	// The stride can be more than the number of columns; the elements
+	// in between are padding. Zero rows means it's just a vector.
+	size_t _rows;
+	size_t _cols;
+	size_t _stride;
+
+	// Lazy host storage. A vector that starts out as all zeros has no
+	// host copy, until someone looks at it; on the device, it is filled
+	// with zeros, instead of being sent. materialize() makes the host
+	// copy. Vectors that are only ever passed from one kernel to the
+	// next never get one.
+	mutable bool _lazy;
+	virtual void materialize(void) const {}
 
 	void set_context(const Handle&);
+	void set_sub_buffer(const Handle&, const cl::Buffer&, size_t, size_t);
+
+	// Move the vector off the device: bring the host copy up to date,
+	// and give back the buffer. A new one is made the next time that
+	// the vector is used. See OpenclNode-memory.cc
+	void release_buffer(void);
+	void evict(void);
 	virtual size_t reserve_size(void) const = 0;
+	virtual size_t elem_size(void) const = 0;
 	virtual void* data(void) const = 0;
-	void send_buffer(const Handle&) const;
+
+	// Values that hold the host data in a different format than the
+	// device does (e.g. doubles on the host, floats on the device)
+	// convert between the two here. pack() fills the memory returned
+	// by data() just before an upload; unpack() converts the memory
+	// back, just after a download.
+	virtual void pack(void) const {}
+	virtual void unpack(void) const {}
+	virtual void pack_range(size_t, size_t) const {}
+	virtual void unpack_range(size_t, size_t) const {}
+
+	void send_buffer(cl::CommandQueue&, cl::Event&) const;
+	void profile(const char*, const cl::Event&, size_t) const;
 	void fetch_buffer(void) const;
 
+	// Downloads that don't wait. fetch_async() starts reading device
+	// generation `_fetching_gen` into host memory, and returns the
+	// event that signals when it's there. If fetch_buffer() is called
+	// for the same generation, it waits for that read to finish, and
+	// then only unpacks it, instead of reading again.
+	mutable cl::Event _fetch_event;
+	mutable std::atomic<size_t> _fetching_gen;
+	bool fetch_async(cl::Event&) const;
+
+	// The number of merged launches that this is an output of, and
+	// whose results are not yet copied in. Reads wait for these to be
+	// done. See OpenclNode-merge.cc
+	mutable std::atomic<size_t> _merge_busy;
+	void wait_merged(void) const;
+
 public:
 	virtual ~OpenclDataValue();
 };
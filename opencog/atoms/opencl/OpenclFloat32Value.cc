@@ -0,0 +1,72 @@
+/*
+ * opencog/atoms/opencl/OpenclFloat32Value.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/atoms/value/ValueFactory.h>
+#include <opencog/atoms/opencl/OpenclFloat32Value.h>
+#include <opencog/opencl/types/atom_types.h>
+
+using namespace opencog;
+
+OpenclFloat32Value::OpenclFloat32Value(size_t sz) :
+	OpenclFloatValue(OPENCL_FLOAT32_VALUE)
+{
+	make_lazy(sz);
+}
+
+OpenclFloat32Value::OpenclFloat32Value(const std::vector<double>& v) :
+	OpenclFloatValue(OPENCL_FLOAT32_VALUE, v)
+{
+	pack();
+}
+
+/// Convert the host doubles to floats, for upload.
+void OpenclFloat32Value::pack(void) const
+{
+	_staging.resize(_value.size());
+	pack_range(0, _value.size());
+}
+
+/// Convert the downloaded floats back to doubles.
+void OpenclFloat32Value::unpack(void) const
+{
+	unpack_range(0, _value.size());
+}
+
+void OpenclFloat32Value::pack_range(size_t lo, size_t hi) const
+{
+	for (size_t i = lo; i < hi; i++)
+		_staging[i] = (float) _value[i];
+}
+
+void OpenclFloat32Value::unpack_range(size_t lo, size_t hi) const
+{
+	for (size_t i = lo; i < hi; i++)
+		_value[i] = _staging[i];
+}
+
+// ==============================================================
+
+// Adds factory when the library is loaded.
+DEFINE_VALUE_FACTORY(OPENCL_FLOAT32_VALUE,
+                     createOpenclFloat32Value, size_t)
+DEFINE_VALUE_FACTORY(OPENCL_FLOAT32_VALUE,
+                     createOpenclFloat32Value, std::vector<double>)
@@ -0,0 +1,73 @@
+/*
+ * opencog/atoms/opencl/OpenclFloat32Value.h
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_OPENCL_FLOAT32_VALUE_H
+#define _OPENCOG_OPENCL_FLOAT32_VALUE_H
+
+#include <vector>
+#include <opencog/atoms/opencl/OpenclFloatValue.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * OpenclFloat32Values hold an ordered vector of doubles, just like
+ * OpenclFloatValues, but the device copy is single precision: it
+ * binds to `float*` kernel arguments. This halves the transfer size,
+ * and works on devices that do not support doubles at all.
+ *
+ * The data is converted when it is sent to, or fetched from, the
+ * device. Precision is lost in the round trip, of course.
+ */
+class OpenclFloat32Value
+	: public OpenclFloatValue
+{
+protected:
+	mutable std::vector<float> _staging;
+
+	virtual size_t reserve_size(void) const {
+		return sizeof(float) * length(); }
+	virtual size_t elem_size(void) const { return sizeof(float); }
+	virtual void* data(void) const { return _staging.data(); }
+	virtual void pack(void) const;
+	virtual void unpack(void) const;
+	virtual void pack_range(size_t, size_t) const;
+	virtual void unpack_range(size_t, size_t) const;
+
+public:
+	OpenclFloat32Value(size_t);
+	OpenclFloat32Value(const std::vector<double>&);
+
+	virtual ~OpenclFloat32Value() {}
+};
+
+VALUE_PTR_DECL(OpenclFloat32Value);
+CREATE_VALUE_DECL(OpenclFloat32Value);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_OPENCL_FLOAT32_VALUE_H
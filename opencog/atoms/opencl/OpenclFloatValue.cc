@@ -20,6 +20,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+
 #include <opencog/util/exceptions.h>
 #include <opencog/atoms/value/ValueFactory.h>
 #include <opencog/atoms/opencl/OpenclFloatValue.h>
@@ -27,28 +29,141 @@
 
 using namespace opencog;
 
+/// A vector of `sz` zeros. There's no host copy of it, until someone
+/// looks at it.
 OpenclFloatValue::OpenclFloatValue(size_t sz) :
-	FloatValue(OPENCL_FLOAT_VALUE)
+	FloatValue(OPENCL_FLOAT_VALUE),
+	_lazy_len(0)
 {
-	_value.resize(sz);
+	make_lazy(sz);
 }
 
 OpenclFloatValue::OpenclFloatValue(const std::vector<double>& v) :
-	FloatValue(OPENCL_FLOAT_VALUE, v)
+	FloatValue(OPENCL_FLOAT_VALUE, v),
+	_lazy_len(0)
 {
+	if (is_zero(_value)) make_lazy(_value.size());
 }
 
 OpenclFloatValue::OpenclFloatValue(std::vector<double>&& v) :
-	FloatValue(OPENCL_FLOAT_VALUE, std::move(v))
+	FloatValue(OPENCL_FLOAT_VALUE, std::move(v)),
+	_lazy_len(0)
+{
+	if (is_zero(_value)) make_lazy(_value.size());
+}
+
+bool OpenclFloatValue::is_zero(const std::vector<double>& v)
+{
+	return std::all_of(v.begin(), v.end(),
+		[](double x) { return 0.0 == x; });
+}
+
+void OpenclFloatValue::make_lazy(size_t sz)
+{
+	_value.clear();
+	_lazy_len = sz;
+	_lazy = true;
+}
+
+/// Make the host copy of a lazy vector; it's all zeros. Whatever the
+/// device has that is newer is fetched after this, as usual.
+void OpenclFloatValue::materialize(void) const
+{
+	std::lock_guard<std::mutex> lck(_event_mtx);
+	if (not _lazy) return;
+	_value.resize(_lazy_len);
+	pack();
+	_lazy = false;
+}
+
+void OpenclFloatValue::resize(size_t dim)
+{
+	// A zero-copy buffer is wrapped around the vector storage, which
+	// would move, if the vector was resized.
+	if (_zero_copy)
+		throw RuntimeException(TRACE_INFO,
+			"Cannot resize a vector that is bound to a zero-copy buffer");
+
+	materialize();
+	_value.resize(dim);
+	mark_host_dirty();
+}
+
+/// Get `count` elements, starting at `offset`. If the device has
+/// newer data, only these are downloaded.
+std::vector<double> OpenclFloatValue::get_range(size_t offset,
+                                                size_t count) const
+{
+	size_t end = std::min(offset + count, length());
+	if (end <= offset) return std::vector<double>();
+
+	materialize();
+	fetch_range(offset, end);
+	return std::vector<double>(_value.begin() + offset,
+	                           _value.begin() + end);
+}
+
+/// Get a block of a matrix stored in this vector, row by row. The
+/// block is returned row by row, too, each row `ncols` long.
+std::vector<double> OpenclFloatValue::get_rect(size_t row, size_t col,
+                                               size_t nrows, size_t ncols,
+                                               size_t row_len) const
+{
+	if (row_len < col + ncols or length() < (row + nrows) * row_len)
+		throw RuntimeException(TRACE_INFO,
+			"Block does not fit in the vector");
+
+	materialize();
+	fetch_rect(row, col, nrows, ncols, row_len);
+
+	std::vector<double> blk;
+	blk.reserve(nrows * ncols);
+	for (size_t r = row; r < row + nrows; r++)
+	{
+		auto start = _value.begin() + r * row_len + col;
+		blk.insert(blk.end(), start, start + ncols);
+	}
+	return blk;
+}
+
+/// Overwrite elements, starting at `offset`. Only these are sent on
+/// the next upload. Any newer data on the device is fetched first,
+/// so that it isn't lost.
+void OpenclFloatValue::set_range(size_t offset, const std::vector<double>& v)
+{
+	if (length() < offset + v.size())
+		throw RuntimeException(TRACE_INFO,
+			"Range does not fit in the vector");
+
+	materialize();
+	fetch_buffer();
+	std::copy(v.begin(), v.end(), _value.begin() + offset);
+	mark_host_dirty(offset, offset + v.size());
+}
+
+/// Say that the vector holds a `rows` by `cols` matrix, stored row
+/// after row, with the rows `stride` elements apart.
+void OpenclFloatValue::set_shape(size_t rows, size_t cols, size_t stride)
 {
+	if (0 == stride) stride = cols;
+	if (stride < cols or length() < rows * stride)
+		throw RuntimeException(TRACE_INFO,
+			"A %zu by %zu matrix, with a stride of %zu, does not fit"
+			" in a vector of %zu", rows, cols, stride, length());
+
+	_rows = rows;
+	_cols = cols;
+	_stride = stride;
 }
 
-// Right now, we will read from the GPU *every time*. Is this the
-// right thing to do? Well, as envisioned in the Value subsystem
-// design five years ago, the answer is "yes". Is this still the
-// right answer? So far, seems to still be "yes". ...
+// As envisioned in the Value subsystem design five years ago, the
+// value is re-read from the GPU every time it is looked at. However,
+// fetch_buffer() skips the actual read, unless some kernel has written
+// to the buffer since the last time. The answer is the same either
+// way; it's just cheaper.
 void OpenclFloatValue::update(void) const
 {
+	materialize();
 	fetch_buffer();
 }
 
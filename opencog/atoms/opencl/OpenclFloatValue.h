@@ -40,13 +40,27 @@ namespace opencog
 class OpenclFloatValue
 	: public FloatValue, public OpenclDataValue
 {
+	friend class OpenclJobValue;
+	friend class OpenclNode;
+
 protected:
 	virtual void update() const;
 
-	OpenclFloatValue(Type t) : FloatValue(t) {}
-	OpenclFloatValue(Type t, const std::vector<double>& v) : FloatValue(t, v) {}
+	OpenclFloatValue(Type t) : FloatValue(t), _lazy_len(0) {}
+	OpenclFloatValue(Type t, const std::vector<double>& v) :
+		FloatValue(t, v), _lazy_len(0) { if (is_zero(v)) make_lazy(v.size()); }
+
+	// Vectors made with just a length, or all zeros, are lazy; see
+	// OpenclDataValue.
+	mutable size_t _lazy_len;
+	static bool is_zero(const std::vector<double>&);
+	void make_lazy(size_t);
+	virtual void materialize(void) const;
+	size_t length(void) const { return _lazy ? _lazy_len : _value.size(); }
+
 	virtual size_t reserve_size(void) const {
-		return sizeof(double) * _value.size(); }
+		return sizeof(double) * length(); }
+	virtual size_t elem_size(void) const { return sizeof(double); }
 	virtual void* data(void) const { return _value.data(); }
 
 public:
@@ -57,9 +71,26 @@ public:
 	virtual ~OpenclFloatValue() {}
 
 	const std::vector<double>& value() const { update(); return _value; }
-	size_t size() const { return _value.size(); }
+	size_t size() const { return length(); }
+
+	void resize(size_t);
+
+	// Access to part of the vector. Only that part is moved to or
+	// from the device. The rect is a block of a matrix, stored row
+	// after row, with rows `row_len` long.
+	std::vector<double> get_range(size_t offset, size_t count) const;
+	std::vector<double> get_rect(size_t row, size_t col,
+	                             size_t nrows, size_t ncols,
+	                             size_t row_len) const;
+	void set_range(size_t offset, const std::vector<double>&);
 
-	void resize(size_t dim) { _value.resize(dim); }
+	// The shape, for vectors that hold a matrix. The stride defaults
+	// to the number of columns.
+	void set_shape(size_t rows, size_t cols, size_t stride = 0);
+	bool is_shaped(void) const { return 0 < _rows; }
+	size_t rows(void) const { return _rows; }
+	size_t cols(void) const { return _cols; }
+	size_t stride(void) const { return _stride; }
 };
 
 VALUE_PTR_DECL(OpenclFloatValue);
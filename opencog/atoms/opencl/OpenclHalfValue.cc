@@ -0,0 +1,151 @@
+/*
+ * opencog/atoms/opencl/OpenclHalfValue.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstring>
+#include <opencog/atoms/value/ValueFactory.h>
+#include <opencog/atoms/opencl/OpenclHalfValue.h>
+#include <opencog/opencl/types/atom_types.h>
+
+using namespace opencog;
+
+// ==============================================================
+// Conversion between single and half precision. There is no portable
+// C++ half type, and the hardware conversion instructions (F16C on
+// x86, and so on) are not available everywhere, so this is done by
+// hand. Rounding is round-to-nearest-even, same as the hardware.
+
+static uint16_t float_to_half(float f)
+{
+	uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t fexp = (x >> 23) & 0xff;
+	uint32_t mant = x & 0x7fffff;
+
+	// Infinity and NaN. Keep NaN's a NaN.
+	if (0xff == fexp)
+		return sign | 0x7c00 | (mant ? 0x200 : 0);
+
+	int exp = (int) fexp - 127 + 15;
+
+	// Too large; becomes infinity.
+	if (31 <= exp)
+		return sign | 0x7c00;
+
+	// Too small for a normal half; becomes subnormal, or zero.
+	if (exp <= 0)
+	{
+		if (exp < -10) return sign;
+		mant |= 0x800000;
+		uint32_t shift = 14 - exp;
+		uint32_t h = mant >> shift;
+		uint32_t rem = mant & ((1u << shift) - 1);
+		uint32_t mid = 1u << (shift - 1);
+		if (mid < rem or (mid == rem and (h & 1))) h++;
+		return sign | h;
+	}
+
+	// A carry out of the mantissa bumps the exponent, which is the
+	// right thing to do, even if it results in infinity.
+	uint32_t h = ((uint32_t) exp << 10) | (mant >> 13);
+	uint32_t rem = mant & 0x1fff;
+	if (0x1000 < rem or (0x1000 == rem and (h & 1))) h++;
+	return sign | h;
+}
+
+static float half_to_float(uint16_t h)
+{
+	uint32_t sign = ((uint32_t) h & 0x8000) << 16;
+	int exp = (h >> 10) & 0x1f;
+	uint32_t mant = h & 0x3ff;
+
+	uint32_t x;
+	if (0 == exp)
+	{
+		if (0 == mant)
+			x = sign;
+		else
+		{
+			// Subnormal; normalize it.
+			exp = 1;
+			while (0 == (mant & 0x400)) { mant <<= 1; exp--; }
+			mant &= 0x3ff;
+			x = sign | ((uint32_t) (exp + 127 - 15) << 23) | (mant << 13);
+		}
+	}
+	else if (31 == exp)
+		x = sign | 0x7f800000 | (mant << 13);
+	else
+		x = sign | ((uint32_t) (exp + 127 - 15) << 23) | (mant << 13);
+
+	float f;
+	memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+// ==============================================================
+
+OpenclHalfValue::OpenclHalfValue(size_t sz) :
+	OpenclFloatValue(OPENCL_HALF_VALUE)
+{
+	make_lazy(sz);
+}
+
+OpenclHalfValue::OpenclHalfValue(const std::vector<double>& v) :
+	OpenclFloatValue(OPENCL_HALF_VALUE, v)
+{
+	pack();
+}
+
+/// Convert the host doubles to halfs, for upload.
+void OpenclHalfValue::pack(void) const
+{
+	_staging.resize(_value.size());
+	pack_range(0, _value.size());
+}
+
+/// Convert the downloaded halfs back to doubles.
+void OpenclHalfValue::unpack(void) const
+{
+	unpack_range(0, _value.size());
+}
+
+void OpenclHalfValue::pack_range(size_t lo, size_t hi) const
+{
+	for (size_t i = lo; i < hi; i++)
+		_staging[i] = float_to_half((float) _value[i]);
+}
+
+void OpenclHalfValue::unpack_range(size_t lo, size_t hi) const
+{
+	for (size_t i = lo; i < hi; i++)
+		_value[i] = half_to_float(_staging[i]);
+}
+
+// ==============================================================
+
+// Adds factory when the library is loaded.
+DEFINE_VALUE_FACTORY(OPENCL_HALF_VALUE,
+                     createOpenclHalfValue, size_t)
+DEFINE_VALUE_FACTORY(OPENCL_HALF_VALUE,
+                     createOpenclHalfValue, std::vector<double>)
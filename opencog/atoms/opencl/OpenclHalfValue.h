@@ -0,0 +1,75 @@
+/*
+ * opencog/atoms/opencl/OpenclHalfValue.h
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_OPENCL_HALF_VALUE_H
+#define _OPENCOG_OPENCL_HALF_VALUE_H
+
+#include <cstdint>
+#include <vector>
+#include <opencog/atoms/opencl/OpenclFloatValue.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * OpenclHalfValues hold an ordered vector of doubles, just like
+ * OpenclFloatValues, but the device copy is IEEE 754 half precision:
+ * it binds to `half*` kernel arguments. Kernels on devices without
+ * the cl_khr_fp16 extension can still use these, via vload_half()
+ * and vstore_half().
+ *
+ * The data is converted when it is sent to, or fetched from, the
+ * device. Values that are too large for a half become infinities.
+ */
+class OpenclHalfValue
+	: public OpenclFloatValue
+{
+protected:
+	mutable std::vector<uint16_t> _staging;
+
+	virtual size_t reserve_size(void) const {
+		return sizeof(uint16_t) * length(); }
+	virtual size_t elem_size(void) const { return sizeof(uint16_t); }
+	virtual void* data(void) const { return _staging.data(); }
+	virtual void pack(void) const;
+	virtual void unpack(void) const;
+	virtual void pack_range(size_t, size_t) const;
+	virtual void unpack_range(size_t, size_t) const;
+
+public:
+	OpenclHalfValue(size_t);
+	OpenclHalfValue(const std::vector<double>&);
+
+	virtual ~OpenclHalfValue() {}
+};
+
+VALUE_PTR_DECL(OpenclHalfValue);
+CREATE_VALUE_DECL(OpenclHalfValue);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_OPENCL_HALF_VALUE_H
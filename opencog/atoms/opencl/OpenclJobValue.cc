@@ -20,6 +20,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+
 #include <opencog/util/exceptions.h>
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/atoms/base/Link.h>
@@ -29,15 +31,30 @@
 #include <opencog/atoms/value/ValueFactory.h>
 #include <opencog/opencl/types/atom_types.h>
 
+#include "OpenclFloat32Value.h"
 #include "OpenclFloatValue.h"
+#include "OpenclHalfValue.h"
 #include "OpenclJobValue.h"
+#include "NativeKernels.h"
 #include "OpenclNode.h"
+#include "Reductions.h"
 
 using namespace opencog;
 
 OpenclJobValue::OpenclJobValue(Handle defn) :
 	LinkValue(OPENCL_JOB_VALUE),
 	_kernel{},
+	_local_size(0),
+	_flops(0),
+	_nd(false),
+	_tune_bucket(0),
+	_tune_trial(OpenclNode::NO_TRIAL),
+	_read_async(false),
+	_slot(0),
+	_reduction(nullptr),
+	_red_local(0),
+	_red_groups(0),
+	_native(nullptr),
 	_is_built(false)
 {
 	if (not defn->is_type(SECTION))
@@ -46,9 +63,48 @@ OpenclJobValue::OpenclJobValue(Handle defn) :
 	_definition = defn;
 }
 
+/// Create a job for the same Section as `proto`, reusing the kernel
+/// and the arguments of that job. The arguments are re-evaluated and
+/// rebound just before the job is run; see rebind().
+OpenclJobValue::OpenclJobValue(const OpenclJobValuePtr& proto) :
+	LinkValue(OPENCL_JOB_VALUE),
+	_definition(proto->_definition),
+	_kname(proto->_kname),
+	_kernel(proto->_kernel),
+	_dim(0),
+	_kit(proto->_kit),
+	_iface(proto->_iface),
+	_local_size(proto->_local_size),
+	_flops(proto->_flops),
+	_nd(proto->_nd),
+	_global(proto->_global),
+	_local(proto->_local),
+	_tune_bucket(0),
+	_tune_trial(OpenclNode::NO_TRIAL),
+	_proto(proto),
+	_read_async(false),
+	_slot(0),
+	_reduction(proto->_reduction),
+	_kname2(proto->_kname2),
+	_kernel2(proto->_kernel2),
+	_red_local(proto->_red_local),
+	_red_groups(0),
+	_native(proto->_native),
+	_opencl_node(proto->_opencl_node),
+	_is_built(true)
+{
+}
+
+/// Hand the kernel back to the OpenclNode, for use by other jobs.
+/// Jobs made from a prototype share its kernel, and don't own it.
 OpenclJobValue::~OpenclJobValue()
 {
+	if (nullptr == _proto and nullptr != _kernel() and _opencl_node)
+		OpenclNodeCast(_opencl_node)->return_kernel(_kname, _kernel);
+	if (nullptr == _proto and nullptr != _kernel2() and _opencl_node)
+		OpenclNodeCast(_opencl_node)->return_kernel(_kname2, _kernel2);
 	_kernel = {};
+	_kernel2 = {};
 }
 
 // ==============================================================
@@ -74,17 +130,29 @@ OpenclJobValue::get_kern_name (void) const
 
 // ==============================================================
 
+/// True if position `i` of the interface is the result of a reduction.
+/// This is a single number, no matter how long the inputs are.
+static bool is_reduce(const HandleSeq& cons, size_t i)
+{
+	if (cons.size() <= i) return false;
+	const Handle& sex = cons[i]->getOutgoingAtom(1);
+	return 0 == sex->get_name().compare("reduce");
+}
+
 /// Find the vector length.
 /// Look either for a length specification embedded in the list,
-/// else obtain the shortest of all the vectors.
+/// else obtain the shortest of all the vectors. The results of
+/// reductions don't count.
 bool
-OpenclJobValue::get_vec_len(const ValueSeq& vsq)
+OpenclJobValue::get_vec_len(const ValueSeq& vsq, const HandleSeq& cons)
 {
 	bool have_length_spec = false;
 	_dim = UINT_MAX;
-	for (const ValuePtr& vp : vsq)
+	for (size_t i = 0; i < vsq.size(); i++)
 	{
+		const ValuePtr& vp = vsq[i];
 		if (vp->is_type(TYPE_NODE)) continue;
+		if (is_reduce(cons, i)) continue;
 
 		if (vp->is_type(NUMBER_NODE))
 		{
@@ -93,6 +161,14 @@ OpenclJobValue::get_vec_len(const ValueSeq& vsq)
 			continue;
 		}
 
+		// Lazy vectors have no host copy to take the length of.
+		if (vp->is_type(OPENCL_DATA_VALUE))
+		{
+			size_t sz = OpenclFloatValueCast(vp)->size();
+			if (sz < _dim) _dim = sz;
+			continue;
+		}
+
 		if (vp->is_type(FLOAT_VALUE))
 		{
 			size_t sz = FloatValueCast(vp)->size();
@@ -120,18 +196,48 @@ OpenclJobValue::get_vec_len(const ValueSeq& vsq)
 	return have_length_spec;
 }
 
-/// Unwrap vector.
+/// Create an OpenclFloatValue of the given type, holding `vals`.
+static OpenclFloatValuePtr make_float_value(Type t,
+                                           const std::vector<double>& vals)
+{
+	if (OPENCL_FLOAT32_VALUE == t)
+		return createOpenclFloat32Value(vals);
+	if (OPENCL_HALF_VALUE == t)
+		return createOpenclHalfValue(vals);
+	return createOpenclFloatValue(vals);
+}
+
+/// Create a lazy OpenclFloatValue of the given type, of `len` zeros.
+static OpenclFloatValuePtr make_zero_value(Type t, size_t len)
+{
+	if (OPENCL_FLOAT32_VALUE == t)
+		return createOpenclFloat32Value(len);
+	if (OPENCL_HALF_VALUE == t)
+		return createOpenclHalfValue(len);
+	return createOpenclFloatValue(len);
+}
+
+/// Unwrap vector. The `want` type is the type that the kernel
+/// interface asks for; this determines the precision of the vector
+/// on the device. Vectors are cut or padded to length `len`.
 ValuePtr
-OpenclJobValue::get_floats(const Handle& oclno, ValuePtr vp)
+OpenclJobValue::get_floats(const Handle& oclno, ValuePtr vp, Type want,
+                           size_t len)
 {
 	// If we're already the right format, we're done. Do nothing.
 	// Well, almost nothing. Make sure that the vector knows it's
 	// context. It might not know, if the user created it and did
 	// not explicitly do a *-write-* with it.
+	// Queue it for upload, too. Nothing will actually be sent, if
+	// the device already has the current data. Native kernels work
+	// on the host copy, and there is no device.
+	bool native = OpenclNodeCast(oclno)->_native;
 	if (vp->is_type(OPENCL_DATA_VALUE))
 	{
+		if (native) return vp;
 		OpenclFloatValuePtr ofv = OpenclFloatValueCast(vp);
 		ofv->set_context(oclno);
+		_pending_uploads.push_back(ofv);
 		return vp;
 	}
 
@@ -152,27 +258,85 @@ OpenclJobValue::get_floats(const Handle& oclno, ValuePtr vp)
 		throw RuntimeException(TRACE_INFO,
 			"Expecting vector of floats, got: %s", vp->to_string().c_str());
 
+	// Vectors of all zeros, such as the ones given for the outputs,
+	// are not copied; the device fills them in.
 	OpenclFloatValuePtr ofv;
-	if (vals->size() != _dim)
+	if (OpenclFloatValue::is_zero(*vals))
+		ofv = make_zero_value(want, len);
+	else if (vals->size() != len)
 	{
 		std::vector<double> cpy(*vals);
-		cpy.resize(_dim);
-		ofv = createOpenclFloatValue(cpy);
+		cpy.resize(len);
+		ofv = make_float_value(want, cpy);
 	}
 	else
-		ofv = createOpenclFloatValue(*vals);
+		ofv = make_float_value(want, *vals);
 
 	// Allocate a GPU buffer but don't upload yet. The upload is
 	// deferred to upload_inputs() which runs on the dispatch thread,
 	// avoiding races on the shared OpenCL command queue and event.
+	if (native) return ofv;
 	ofv->set_context(oclno);
 	_pending_uploads.push_back(ofv);
 	return ofv;
 }
 
-/// Unpack kernel arguments
+/// Copy the chunk of the stream into the staging vector of this job's
+/// slot. The first time around, or if the chunk doesn't fit, a new
+/// staging vector is made instead. Chunks that are already device
+/// vectors are used as they are.
+ValuePtr
+OpenclJobValue::stage(const Handle& oclno, Type want, size_t len)
+{
+	const std::vector<double>* vals = nullptr;
+	if (_chunk->is_type(OPENCL_DATA_VALUE))
+		return get_floats(oclno, _chunk, want, len);
+
+	if (_chunk->is_type(FLOAT_VALUE))
+		vals = &(FloatValueCast(_chunk)->value());
+	else if (_chunk->is_type(NUMBER_NODE))
+		vals = &(NumberNodeCast(_chunk)->value());
+
+	OpenclFloatValuePtr& stv = _feed->staging[_slot];
+	if (vals and stv and stv->get_type() == want and
+	    stv->_value.size() == len and len <= vals->size())
+	{
+		// Copy in place; the storage must not move, as the buffer
+		// might be wrapped around it.
+		std::copy(vals->begin(), vals->begin() + len, stv->_value.begin());
+		stv->mark_host_dirty();
+		if (not OpenclNodeCast(oclno)->_native)
+			_pending_uploads.push_back(stv);
+		return stv;
+	}
+
+	ValuePtr fv = get_floats(oclno, _chunk, want, len);
+	stv = OpenclFloatValueCast(fv);
+	return fv;
+}
+
+/// The vector type wanted by the kernel interface at position `i`.
+static Type wanted_type(const HandleSeq& cons, size_t i)
+{
+	if (cons.size() <= i) return OPENCL_FLOAT_VALUE;
+
+	Handle typ = cons[i]->getOutgoingAtom(0);
+	Type t = TypeNodeCast(typ)->get_kind();
+	if (OPENCL_FLOAT32_VALUE == t or OPENCL_HALF_VALUE == t)
+		return t;
+	return OPENCL_FLOAT_VALUE;
+}
+
+static bool is_output(const HandleSeq& cons, size_t i)
+{
+	if (cons.size() <= i) return false;
+	const Handle& sex = cons[i]->getOutgoingAtom(1);
+	return 0 == sex->get_name().compare("output") or is_reduce(cons, i);
+}
+
+/// Evaluate the kernel arguments given in the Section.
 ValueSeq
-OpenclJobValue::make_vectors(const Handle& oclno)
+OpenclJobValue::eval_args(void) const
 {
 	// We could check that conseq is actually of type ConnectorSeq
 	// and throw if not, but I don't see a need to enforce this yet.
@@ -183,17 +347,126 @@ OpenclJobValue::make_vectors(const Handle& oclno)
 	ValueSeq vsq;
 	for (const Handle& oh : oset)
 	{
-		if (oh->is_executable())
+		if (is_launch_option(oh)) continue;
+		if (_feed and oh == _feed->from)
+			vsq.push_back(_chunk);
+		else if (is_shape_spec(oh))
+			vsq.emplace_back(shaped(oh,
+				wanted_type(_iface->getOutgoingSet(), vsq.size())));
+		else if (oh->is_executable())
 			vsq.emplace_back(oh->execute());
 		else
 			vsq.push_back(oh);
 	}
+	return vsq;
+}
+
+/// Launch options are not kernel arguments; they have the form
+///    (Connector (Predicate "option-name") (Number ...))
+bool OpenclJobValue::is_launch_option(const Handle& h)
+{
+	return h->is_type(CONNECTOR) and 0 < h->size() and
+		h->getOutgoingAtom(0)->is_type(PREDICATE_NODE);
+}
+
+/// Matrix arguments have the form
+///    (Connector (Number rows cols) (FloatValueOf ...))
+/// See shaped().
+bool OpenclJobValue::is_shape_spec(const Handle& h)
+{
+	return h->is_type(CONNECTOR) and 2 == h->size() and
+		h->getOutgoingAtom(0)->is_type(NUMBER_NODE);
+}
+
+/// Round a list of numbers to sizes.
+static std::vector<size_t> to_sizes(const std::vector<double>& vals)
+{
+	std::vector<size_t> sizes;
+	for (double v : vals)
+		sizes.push_back((size_t) (v + 0.5));
+	return sizes;
+}
+
+/// Look for launch options in the Section. These are
+///    (Connector (Predicate "work-group-size") (Number 64))
+/// which overrides the work-group size picked by the autotuner, and
+///    (Connector (Predicate "global-size") (Number 512 256))
+/// which launches the kernel over a range of one to three dimensions.
+/// The work-group size may then also have several numbers. Finally,
+///    (Connector (Predicate "flops") (Number 2))
+/// says how many floating-point operations each work-item does; this
+/// is only used for profiling.
+void OpenclJobValue::get_launch_options(void)
+{
+	_local_size = 0;
+	_flops = 0;
+	_global.clear();
+	_local.clear();
+	const Handle& conseq = _definition->getOutgoingAtom(1);
+	for (const Handle& oh : conseq->getOutgoingSet())
+	{
+		if (not is_launch_option(oh)) continue;
+
+		const std::string& opt = oh->getOutgoingAtom(0)->get_name();
+		if (2 != oh->size() or
+		    not oh->getOutgoingAtom(1)->is_type(NUMBER_NODE))
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a number for launch option \"%s\"\n",
+				opt.c_str());
+		const std::vector<double>& vals =
+			NumberNodeCast(oh->getOutgoingAtom(1))->value();
+		std::vector<size_t> sizes = to_sizes(vals);
+		if (0 == sizes.size() or 3 < sizes.size() or
+		    (1 < sizes.size() and
+		     sizes.end() != std::find(sizes.begin(), sizes.end(), 0)))
+			throw RuntimeException(TRACE_INFO,
+				"Expecting one to three sizes for launch option \"%s\"\n",
+				opt.c_str());
+
+		if (0 == opt.compare("work-group-size"))
+		{
+			_local_size = sizes[0];
+			if (1 < sizes.size()) _local = sizes;
+		}
+		else if (0 == opt.compare("global-size"))
+			_global = sizes;
+		else if (0 == opt.compare("flops"))
+			_flops = sizes[0];
+		else
+			throw RuntimeException(TRACE_INFO,
+				"Unknown launch option \"%s\"\n", opt.c_str());
+	}
+}
+
+/// Unpack kernel arguments. The `iface` is the ConnectorSeq
+/// describing the kernel arguments.
+ValueSeq
+OpenclJobValue::make_vectors(const Handle& oclno, const Handle& iface)
+{
+	ValueSeq vsq = eval_args();
+	const HandleSeq& cons = iface->getOutgoingSet();
+
+	_nd = is_nd(vsq);
+	if (_nd)
+		return make_nd_vectors(oclno, vsq, cons);
 
 	// Find the shortest vector.
-	bool have_size_spec = get_vec_len(vsq);
+	bool have_size_spec = get_vec_len(vsq, cons);
 	ValueSeq flovec;
-	for (const ValuePtr& v: vsq)
-		flovec.emplace_back(get_floats(oclno, v));
+	_owned.clear();
+	for (size_t i = 0; i < vsq.size(); i++)
+	{
+		size_t len = is_reduce(cons, i) ? 1 : _dim;
+		if (_feed and vsq[i] == _chunk)
+		{
+			flovec.emplace_back(stage(oclno, wanted_type(cons, i), len));
+			_owned.push_back(false);
+			continue;
+		}
+		ValuePtr fv = get_floats(oclno, vsq[i], wanted_type(cons, i), len);
+		_owned.push_back(fv != vsq[i] and fv->is_type(OPENCL_DATA_VALUE));
+		flovec.emplace_back(fv);
+	}
 
 	// If the user never specified an explicit location in which to pass
 	// the vector size, assume it is the last location. Set it now.
@@ -203,11 +476,142 @@ OpenclJobValue::make_vectors(const Handle& oclno)
 		Handle hd = HandleCast(createNumberNode(_dim));
 		AtomSpace* as = oclno->getAtomSpace();
 		flovec.emplace_back(as->add_link(CONNECTOR, hd));
+		_owned.push_back(false);
 	}
 
 	return flovec;
 }
 
+/// Create the matrix given by a shape spec, of the form
+///    (Connector (Number rows cols) (FloatValueOf ...))
+/// with an optional third number, the stride between the rows, in
+/// elements. Plain numbers are padded with zeros to fill the matrix;
+/// device vectors are used as they are, and must be big enough and
+/// of the precision the kernel wants.
+ValuePtr OpenclJobValue::shaped(const Handle& spec, Type want) const
+{
+	std::vector<size_t> shp =
+		to_sizes(NumberNodeCast(spec->getOutgoingAtom(0))->value());
+	if (shp.size() < 2 or 3 < shp.size())
+		throw RuntimeException(TRACE_INFO,
+			"Expecting rows, columns and an optional stride, got %s\n",
+			spec->to_short_string().c_str());
+	size_t stride = (3 == shp.size()) ? shp[2] : shp[1];
+
+	const Handle& src = spec->getOutgoingAtom(1);
+	ValuePtr vp = src;
+	if (src->is_executable())
+		vp = src->execute();
+
+	OpenclFloatValuePtr ofv;
+	if (vp->is_type(OPENCL_DATA_VALUE) and vp->get_type() == want)
+		ofv = OpenclFloatValueCast(vp);
+	else if (vp->is_type(OPENCL_DATA_VALUE))
+		// A copy would leave the results out of the user's vector.
+		throw RuntimeException(TRACE_INFO,
+			"Matrix type mismatch: expected type %s, got %s",
+			nameserver().getTypeName(want).c_str(),
+			nameserver().getTypeName(vp->get_type()).c_str());
+	else if (vp->is_type(FLOAT_VALUE) or vp->is_type(NUMBER_NODE))
+	{
+		std::vector<double> vals = vp->is_type(FLOAT_VALUE) ?
+			FloatValueCast(vp)->value() : NumberNodeCast(vp)->value();
+		vals.resize(shp[0] * stride);
+		ofv = make_float_value(want, vals);
+	}
+	else
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a matrix of floats, got: %s", vp->to_string().c_str());
+
+	ofv->set_shape(shp[0], shp[1], stride);
+	return ofv;
+}
+
+/// True if the job runs on a range given in the Section, or has
+/// matrices for arguments. Reductions are always one-dimensional.
+bool OpenclJobValue::is_nd(const ValueSeq& vsq) const
+{
+	if (_reduction) return false;
+	if (0 < _global.size()) return true;
+	for (const ValuePtr& vp : vsq)
+		if (vp->is_type(OPENCL_DATA_VALUE) and
+		    OpenclFloatValueCast(vp)->is_shaped())
+			return true;
+	return false;
+}
+
+/// Unpack the arguments of a job on a range of several dimensions.
+/// Each vector keeps its own length, and each scalar must be given,
+/// as (Connector (Number 42)), in the place where the kernel wants it.
+ValueSeq
+OpenclJobValue::make_nd_vectors(const Handle& oclno, const ValueSeq& vsq,
+                                const HandleSeq& cons)
+{
+	ValueSeq flovec;
+	_owned.clear();
+	for (size_t i = 0; i < vsq.size(); i++)
+	{
+		const ValuePtr& vp = vsq[i];
+		if (vp->is_type(CONNECTOR))
+		{
+			const Handle& h = HandleCast(vp);
+			if (1 != h->size() or
+			    not h->getOutgoingAtom(0)->is_type(NUMBER_NODE))
+				throw RuntimeException(TRACE_INFO,
+					"Expecting a scalar of the form (Connector (Number 42)),"
+					" got %s\n", h->to_short_string().c_str());
+			flovec.push_back(vp);
+			_owned.push_back(false);
+			continue;
+		}
+
+		size_t len = 0;
+		if (vp->is_type(FLOAT_VALUE))
+			len = FloatValueCast(vp)->size();
+		else if (vp->is_type(NUMBER_NODE))
+			len = NumberNodeCast(vp)->size();
+
+		ValuePtr fv;
+		if (_feed and vp == _chunk)
+			fv = stage(oclno, wanted_type(cons, i), len);
+		else
+			fv = get_floats(oclno, vp, wanted_type(cons, i), len);
+		_owned.push_back(fv != vp and fv != _chunk and
+			fv->is_type(OPENCL_DATA_VALUE));
+		flovec.emplace_back(fv);
+	}
+
+	find_range(flovec, cons);
+	return flovec;
+}
+
+/// The range that the kernel is launched over. This is the global
+/// size given in the Section, or else the shape of the first output,
+/// as (cols, rows), so that dimension zero runs along the rows, and
+/// there is one work-item per element.
+void OpenclJobValue::find_range(const ValueSeq& flovecs,
+                                const HandleSeq& cons)
+{
+	_range = _global;
+	for (size_t i = 0; _range.empty() and i < flovecs.size(); i++)
+	{
+		if (not is_output(cons, i) or
+		    not flovecs[i]->is_type(OPENCL_DATA_VALUE))
+			continue;
+		OpenclFloatValuePtr ofv = OpenclFloatValueCast(flovecs[i]);
+		if (ofv->is_shaped())
+			_range = {ofv->cols(), ofv->rows()};
+	}
+
+	if (_range.empty())
+		throw RuntimeException(TRACE_INFO,
+			"No range for kernel \"%s\"; give it a shaped output,"
+			" or a global-size\n", _kit->get_name().c_str());
+
+	_dim = 1;
+	for (size_t sz : _range) _dim *= sz;
+}
+
 // ==============================================================
 
 /// Perform some rudimentary type checking. It's rudimentary mostly
@@ -227,7 +631,10 @@ OpenclJobValue::make_vectors(const Handle& oclno)
 ///    (Connector (Type 'FloatValue) (Sex "input"))
 ///    (Connector (Type 'FloatValue) (Sex "output"))
 ///    (Connector (Type 'FloatValue) (Sex "scalar"))
-/// Maybe more in the future.
+/// The type may also be OpenclFloat32Value or OpenclHalfValue, for
+/// kernels taking float or half pointers. Maybe more in the future.
+/// The kernel signature says nothing about shape; matrices are just
+/// pointers, and their shapes are passed to the kernel as scalars.
 ///
 /// Each item in the flovecs array is going to either be
 ///    (OpenclFloatValue ...)
@@ -259,13 +666,19 @@ void OpenclJobValue::check_signature(const Handle& kern,
 		// Is it a FloatValue?
 		bool is_ok = flovecs[i]->is_type(typ->get_kind());
 
-		// If not, is it a scalar?
-		if (not is_ok)
-		{
-			Handle sex = cons[i]->getOutgoingAtom(1);
-			is_ok = flovecs[i]->is_type(CONNECTOR) and
-				(0 == sex->get_name().compare("scalar"));
-		}
+		// Reduced-precision vectors are also FloatValues, but their
+		// device data is not an array of doubles. The precision must
+		// match exactly.
+		Type vt = flovecs[i]->get_type();
+		if (is_ok and (OPENCL_FLOAT32_VALUE == vt or OPENCL_HALF_VALUE == vt))
+			is_ok = (vt == typ->get_kind());
+
+		// If not, is it a scalar? Scalars can only be numbers; a
+		// vector, or a matrix, in the place of one is a mistake.
+		Handle sex = cons[i]->getOutgoingAtom(1);
+		bool is_scalar = (0 == sex->get_name().compare("scalar"));
+		if (is_scalar)
+			is_ok = flovecs[i]->is_type(CONNECTOR);
 
 		if (not is_ok)
 			throw RuntimeException(TRACE_INFO,
@@ -276,13 +689,31 @@ void OpenclJobValue::check_signature(const Handle& kern,
 
 // ==============================================================
 
-/// Upload input buffers to the GPU. This is called on the dispatch
-/// thread (from OpenclNode::queue_job) so that all GPU I/O happens
-/// on one thread, avoiding races on the shared command queue.
-void OpenclJobValue::upload_inputs(const Handle& oclno)
+/// Vectors evicted from the device since the job was built get a
+/// buffer again; run() binds the kernel to it. This is called in
+/// submission order, just before the uploads, so that nothing can
+/// evict them in between. See OpenclNode-memory.cc
+void OpenclJobValue::restore_evicted(const Handle& oclno)
+{
+	for (const OpenclFloatValuePtr& ofv : _bound)
+	{
+		if (ofv->_have_buff) continue;
+		ofv->set_context(oclno);
+		_pending_uploads.push_back(ofv);
+	}
+}
+
+/// Upload input buffers to the GPU. This is called on a dispatch
+/// thread (from OpenclNode::submit_job), in submission order, so
+/// that commands on shared buffers are issued in the right order.
+/// The uploads do not block; the kernel launch in run() waits on them.
+void OpenclJobValue::upload_inputs(cl::CommandQueue& queue)
 {
 	for (const OpenclFloatValuePtr& ofv : _pending_uploads)
-		ofv->send_buffer(oclno);
+	{
+		cl::Event done;
+		ofv->send_buffer(queue, done);
+	}
 	_pending_uploads.clear();
 }
 
@@ -292,58 +723,603 @@ void OpenclJobValue::build(const Handle& oclno)
 		throw RuntimeException(TRACE_INFO,
 			"Expecting OpenclNode, got: %s", oclno->to_string().c_str());
 
-	std::string kname = get_kern_name();
-
-	// See if its a kernel that we know.
-	// XXX FIXME this will fail for SPV files, because we don't
-	// (yet) generate signatures for them.
 	OpenclNodePtr ocn = OpenclNodeCast(oclno);
 	AtomSpace* as = ocn->getAtomSpace();
-	Handle kit = as->add_node(ITEM_NODE, std::string(kname));
-	const HandleMap& ifmap = ocn->_kernel_interfaces;
-	const auto& descr = ifmap.find(kit);
-	if (descr == ifmap.end())
+
+	// Arithmetic given as a Lambda is compiled to a kernel of its own.
+	// See FusedKernel.h
+	std::string kname;
+	Handle kit;
+	Handle iface;
+	const Handle& head = _definition->getOutgoingAtom(0);
+	if (head->is_type(LAMBDA_LINK) and ocn->_native)
 		throw RuntimeException(TRACE_INFO,
-			"This OpenclNode does not know about the kernel \"%s\"\n",
-			 kname.c_str());
+			"Arithmetic kernels need an OpenCL device; got %s\n",
+			ocn->get_name().c_str());
 
-	// Get our kernel from the program from the OpenclNode.
-	const cl::Program& proggy = ocn->get_program();
-	_kernel = cl::Kernel(proggy, kname.c_str());
+	if (head->is_type(LAMBDA_LINK))
+	{
+		const OpenclNode::FusedEntry& fused = ocn->get_fused(head);
+		kname = fused.kern.name;
+		kit = as->add_node(ITEM_NODE, std::string(kname));
+		iface = as->add_atom(fused.kern.iface);
+		_reduction = fused.kern.accumulate ? &fused.red : nullptr;
+	}
+	else
+	{
+		kname = get_kern_name();
+
+		// See if its a kernel that we know.
+		kit = as->add_node(ITEM_NODE, std::string(kname));
+		const HandleMap& ifmap = ocn->_kernel_interfaces;
+		const auto& descr = ifmap.find(kit);
+		if (descr == ifmap.end())
+			throw RuntimeException(TRACE_INFO,
+				"This OpenclNode does not know about the kernel \"%s\"\n",
+				 kname.c_str());
+		iface = descr->second;
+		_reduction = find_reduction(kname);
+	}
+
+	_kit = kit;
+	_iface = iface;
+	if (ocn->_native)
+	{
+		build_native(oclno, kname);
+		return;
+	}
+
+	// Get our kernel from the OpenclNode. Reductions need two.
+	if (_reduction)
+	{
+		_kname = _reduction->stage1;
+		_kname2 = _reduction->stage2;
+		_kernel = ocn->borrow_kernel(_kname);
+		_kernel2 = ocn->borrow_kernel(_kname2);
+	}
+	else
+	{
+		_kname = kname;
+		_kernel = ocn->borrow_kernel(kname);
+	}
 
 	// Build the OpenclJobValue itself.
-	ValueSeq flovecs = make_vectors (oclno);
-	check_signature(descr->first, descr->second, flovecs);
-	ValuePtr args = createLinkValue(flovecs);
-	_value = ValueSeq{kit, args};
+	get_launch_options();
+	ValueSeq flovecs = make_vectors (oclno, _iface);
+	check_signature(_kit, _iface, flovecs);
+	if (_reduction)
+		bind_reduction(flovecs);
+	else
+		bind_args(flovecs);
 
-	// Bind the kernel to the kernel arguments
+	// Kernels that declare a reqd_work_group_size, such as the tiled
+	// matrix products, must be launched with exactly that.
+	if (_nd and _local.empty() and 0 == _local_size)
+	{
+		auto req = _kernel.getWorkGroupInfo<CL_KERNEL_COMPILE_WORK_GROUP_SIZE>(
+			ocn->get_device());
+		if (0 < req[0])
+			_local = {req[0], req[1], req[2]};
+	}
+
+	_is_built = true;
+}
+
+/// Build a job that runs on the host. There is no kernel to bind;
+/// the arguments are just remembered, for run_native().
+void OpenclJobValue::build_native(const Handle& oclno,
+                                  const std::string& kname)
+{
+	_native = find_native_kernel(kname);
+	if (nullptr == _native)
+		throw RuntimeException(TRACE_INFO,
+			"There is no native version of the kernel \"%s\"\n",
+			kname.c_str());
+
+	_kname = kname;
+	get_launch_options();
+	ValueSeq flovecs = make_vectors (oclno, _iface);
+	if (_nd)
+		throw RuntimeException(TRACE_INFO,
+			"Native kernels run on vectors only; got a range for \"%s\"\n",
+			kname.c_str());
+	check_signature(_kit, _iface, flovecs);
+
+	_args = flovecs;
+	_value = ValueSeq{_kit, createLinkValue(flovecs)};
+	_is_built = true;
+}
+
+/// Bind the job to the kernel arguments. The kernel itself is given
+/// them by set_kernel_args(), just before it is run.
+void OpenclJobValue::bind_args(const ValueSeq& flovecs)
+{
+	_args = flovecs;
+	_value = ValueSeq{_kit, createLinkValue(flovecs)};
+
+	_bound.clear();
+	_outputs.clear();
+	_out_pos.clear();
+	const HandleSeq& cons = _iface->getOutgoingSet();
 	size_t pos = 0;
 	for (const ValuePtr& v: flovecs)
 	{
 		if (v->is_type(OPENCL_DATA_VALUE))
-			_kernel.setArg(pos, OpenclFloatValueCast(v)->get_buffer());
+		{
+			OpenclFloatValuePtr ofv = OpenclFloatValueCast(v);
+			_bound.push_back(ofv);
+
+			if (is_output(cons, pos))
+			{
+				_outputs.push_back(ofv);
+				_out_pos.push_back(pos);
+			}
+		}
+		pos++;
+	}
+}
+
+/// Set the arguments of the kernel from the ones bound to the job.
+/// Jobs made from the same prototype share one kernel, each binding
+/// it to its own arguments; so this is done again just before every
+/// launch, on the dispatch thread.
+void OpenclJobValue::set_kernel_args(void)
+{
+	if (_reduction)
+	{
+		cl::LocalSpaceArg scratch = cl::Local(_red_local * sizeof(cl_double));
+		_partials->bind_arg(_kernel, 0);
+		size_t nin = _reduction->num_inputs;
+		for (size_t i = 0; i < nin; i++)
+			OpenclFloatValueCast(_args[i+1])->bind_arg(_kernel, i+1);
+		_kernel.setArg(nin+1, scratch);
+		_kernel.setArg(nin+2, (cl_ulong) _dim);
+
+		OpenclFloatValueCast(_args[0])->bind_arg(_kernel2, 0);
+		_partials->bind_arg(_kernel2, 1);
+		_kernel2.setArg(2, scratch);
+		_kernel2.setArg(3, (cl_ulong) _red_groups);
+		return;
+	}
+
+	size_t pos = 0;
+	for (const ValuePtr& v: _args)
+	{
+		if (v->is_type(OPENCL_DATA_VALUE))
+			OpenclFloatValueCast(v)->bind_arg(_kernel, pos);
+		else if (_nd)
+			_kernel.setArg(pos, (cl_ulong) (0.5 + NumberNodeCast(
+				HandleCast(v)->getOutgoingAtom(0))->get_value()));
 		else
 			_kernel.setArg(pos, _dim);
 		pos++;
 	}
+}
 
-	_is_built = true;
+/// Bind the arguments of a reduction. The `flovecs` are laid out as
+/// the interface says: the result, then the inputs, then the length.
+/// The stage-one kernel gets the partials, the inputs, scratch space
+/// and the length; the stage-two kernel gets the result, the partials,
+/// scratch space and the number of partials.
+///
+/// The work-group size must be a power of two, for the tree reduction
+/// in local memory; if the Section gives one, it's rounded down. There
+/// are never more groups than work-items in a group, so that the
+/// second stage has at most one partial per work-item to start with,
+/// and each work-item of the first stage loops over the rest.
+void OpenclJobValue::bind_reduction(const ValueSeq& flovecs)
+{
+	_args = flovecs;
+	_value = ValueSeq{_kit, createLinkValue(flovecs)};
+
+	OpenclNodePtr ocn = OpenclNodeCast(_opencl_node);
+	if (0 == _red_local)
+	{
+		const cl::Device& dev = ocn->get_device();
+		size_t most = std::min(
+			_kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(dev),
+			_kernel2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(dev));
+		if (0 < _local_size and _local_size < most) most = _local_size;
+		if (256 < most) most = 256;
+
+		_red_local = 1;
+		while (2 * _red_local <= most) _red_local *= 2;
+	}
+
+	_red_groups = (_dim + _red_local - 1) / _red_local;
+	if (_red_local < _red_groups) _red_groups = _red_local;
+	if (0 == _red_groups) _red_groups = 1;
+
+	// The partials never leave the device, and are never sent to it.
+	size_t width = _reduction->width;
+	_partials = createOpenclFloatValue((size_t) (_red_groups * width));
+	_partials->set_context(_opencl_node);
+
+	OpenclFloatValuePtr out = OpenclFloatValueCast(flovecs[0]);
+
+	_bound.clear();
+	_outputs.clear();
+	_bound.push_back(out);
+	_outputs.push_back(out);
+	_out_pos.assign(1, 0);
+	_bound.push_back(_partials);
+
+	size_t nin = _reduction->num_inputs;
+	for (size_t i = 0; i < nin; i++)
+		_bound.push_back(OpenclFloatValueCast(flovecs[i+1]));
+}
+
+/// Return true if the vector `fresh`, cut or padded to length `dim`,
+/// holds exactly the same numbers as `prev`.
+static bool same_floats(const ValuePtr& prev, const ValuePtr& fresh,
+                        size_t dim)
+{
+	const std::vector<double>* vals = nullptr;
+	if (fresh->is_type(OPENCL_DATA_VALUE))
+		return false;
+	else if (fresh->is_type(FLOAT_VALUE))
+		vals = &(FloatValueCast(fresh)->value());
+	else if (fresh->is_type(NUMBER_NODE))
+		vals = &(NumberNodeCast(fresh)->value());
+	else
+		return false;
+
+	const std::vector<double>& old = FloatValueCast(prev)->value();
+	if (old.size() != dim) return false;
+
+	size_t n = std::min(dim, vals->size());
+	for (size_t i = 0; i < n; i++)
+		if (old[i] != (*vals)[i]) return false;
+	for (size_t i = n; i < dim; i++)
+		if (0.0 != old[i]) return false;
+	return true;
+}
+
+/// Bind the `_fresh` arguments to the kernel of the prototype job.
+/// This is called instead of build(), for Sections that have been
+/// run before. The kernel and the interface are already known, and
+/// the signature check is skipped, unless the argument types have
+/// changed. Input vectors that were created from plain numbers are
+/// kept on the device, if the numbers are the same as last time.
+///
+/// This must be called in submission order, as the kernel is shared
+/// with all other jobs for the same Section.
+void OpenclJobValue::rebind(const Handle& oclno)
+{
+	const HandleSeq& cons = _iface->getOutgoingSet();
+	const ValueSeq& prev = _proto->_args;
+	const std::vector<bool>& prev_owned = _proto->_owned;
+
+	_nd = is_nd(_fresh);
+	if (_nd)
+	{
+		ValueSeq flovecs = make_nd_vectors(oclno, _fresh, cons);
+		_fresh.clear();
+		check_signature(_kit, _iface, flovecs);
+		bind_args(flovecs);
+		_proto->_args = _args;
+		_proto->_owned = _owned;
+		return;
+	}
+
+	bool have_size_spec = get_vec_len(_fresh, cons);
+
+	bool retype = false;
+	ValueSeq flovecs;
+	_owned.clear();
+	for (size_t i = 0; i < _fresh.size(); i++)
+	{
+		// Outputs are never reused, as they might have been written
+		// to by the kernel, and the previous results might still be
+		// in use.
+		if (i < prev.size() and prev_owned[i] and
+		    not is_output(cons, i) and same_floats(prev[i], _fresh[i], _dim))
+		{
+			flovecs.push_back(prev[i]);
+			_owned.push_back(true);
+			continue;
+		}
+
+		size_t len = is_reduce(cons, i) ? 1 : _dim;
+		ValuePtr fv;
+		if (_feed and _fresh[i] == _chunk)
+			fv = stage(oclno, wanted_type(cons, i), len);
+		else
+			fv = get_floats(oclno, _fresh[i], wanted_type(cons, i), len);
+		_owned.push_back(fv != _fresh[i] and fv != _chunk and
+			fv->is_type(OPENCL_DATA_VALUE));
+		if (prev.size() <= i or prev[i]->get_type() != fv->get_type())
+			retype = true;
+		flovecs.emplace_back(fv);
+	}
+	_fresh.clear();
+
+	if (not have_size_spec)
+	{
+		Handle hd = HandleCast(createNumberNode(_dim));
+		AtomSpace* as = oclno->getAtomSpace();
+		flovecs.emplace_back(as->add_link(CONNECTOR, hd));
+		_owned.push_back(false);
+	}
+
+	if (retype or flovecs.size() != prev.size())
+		check_signature(_kit, _iface, flovecs);
+
+	if (_reduction)
+		bind_reduction(flovecs);
+	else
+		bind_args(flovecs);
+
+	// The next job for this Section compares against these.
+	_proto->_args = _args;
+	_proto->_owned = _owned;
+}
+
+/// Launch the kernel, after the inputs have arrived, and after
+/// whatever else was last using the buffers is done.
+///
+/// The work-group size is either given in the Section, or else picked
+/// by the autotuner of the OpenclNode. The autotuner only picks sizes
+/// that divide the vector length; a size given in the Section pads the
+/// global size up to a multiple of it, and the kernel must then check
+/// the index against the length.
+void OpenclJobValue::run(cl::CommandQueue& queue)
+{
+	// The kernel may be shared with other jobs; bind it to ours.
+	set_kernel_args();
+
+	if (_reduction)
+	{
+		run_reduction(queue);
+		return;
+	}
+	if (_nd)
+	{
+		run_nd(queue);
+		return;
+	}
+	if (can_split())
+	{
+		run_split(queue);
+		return;
+	}
+
+	std::vector<cl::Event> deps;
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->add_dependency(deps);
+
+	size_t local = _local_size;
+	_tune_trial = OpenclNode::NO_TRIAL;
+	if (0 == local)
+		local = OpenclNodeCast(_opencl_node)->pick_local_size(
+			_kname, _kernel, _dim, _tune_bucket, _tune_trial);
+
+	size_t global = _dim;
+	if (0 < local)
+		global = ((_dim + local - 1) / local) * local;
+
+	queue.enqueueNDRangeKernel(_kernel,
+		cl::NullRange,
+		cl::NDRange(global),
+		(0 < local) ? cl::NDRange(local) : cl::NullRange,
+		&deps, &_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->set_last_event(_run_event);
+
+	// This must come after the last event is set; see fetch_buffer().
+	for (const OpenclFloatValuePtr& ofv : _outputs)
+		ofv->mark_device_dirty();
+}
+
+/// Bytes in all of the vectors given to the kernel. Each is counted
+/// once, as if it were read or written just once.
+size_t OpenclJobValue::bytes_moved(void) const
+{
+	size_t bytes = 0;
+	for (const ValuePtr& v : _args)
+		if (v->is_type(OPENCL_DATA_VALUE))
+			bytes += OpenclFloatValueCast(v)->reserve_size();
+	return bytes;
+}
+
+/// Floating-point operations done by the whole launch, or zero, if
+/// the Section did not say.
+double OpenclJobValue::flops(void) const
+{
+	double items = (double) _dim;
+	if (_nd)
+	{
+		items = 1.0;
+		for (size_t sz : _range) items *= (double) sz;
+	}
+	return (double) _flops * items;
 }
 
-void OpenclJobValue::run(const Handle& oclno)
+/// True if the job is long enough to be split across several lanes,
+/// and all of its vectors can be cut into parts.
+/// See OpenclNode-multi.cc
+bool OpenclJobValue::can_split(void) const
 {
-	OpenclNodePtr onp = OpenclNodeCast(oclno);
+	if (_nd) return false;
+	OpenclNodePtr ocn = OpenclNodeCast(_opencl_node);
+	if (ocn->_num_lanes < 2) return false;
+	if (0 == ocn->_split_min or _dim < ocn->_split_min) return false;
 
-	// Launch kernel
-	cl::CommandQueue& queue = onp->get_queue();
-	cl::Event& event_handler = onp->get_handler();
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		if (not ofv->can_split()) return false;
+	return true;
+}
+
+/// Launch the kernel on all of the lanes, each on its own part of
+/// the vectors. The parts all wait on whatever the whole job would
+/// have waited on, and a marker on `queue` waits on all of the parts.
+/// The marker is the `_run_event` of the job. Each part has a kernel
+/// of its own, which is handed back as soon as the launch is enqueued,
+/// as the arguments are captured by the launch.
+void OpenclJobValue::run_split(cl::CommandQueue& queue)
+{
+	OpenclNodePtr ocn = OpenclNodeCast(_opencl_node);
+
+	std::vector<cl::Event> deps;
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->add_dependency(deps);
+
+	_tune_trial = OpenclNode::NO_TRIAL;
+
+	std::vector<cl::Event> parts;
+	std::vector<std::pair<size_t, size_t>> ranges = ocn->split_range(_dim);
+	for (size_t lane = 0; lane < ranges.size(); lane++)
+	{
+		size_t start = ranges[lane].first;
+		size_t count = ranges[lane].second;
+		if (0 == count) continue;
+
+		cl::Kernel kern = ocn->borrow_kernel(_kname);
+		for (size_t pos = 0; pos < _args.size(); pos++)
+		{
+			const ValuePtr& v = _args[pos];
+			if (v->is_type(OPENCL_DATA_VALUE))
+			{
+				OpenclFloatValuePtr ofv = OpenclFloatValueCast(v);
+				size_t esz = ofv->elem_size();
+				ofv->bind_part(kern, pos, start * esz, count * esz);
+			}
+			else
+				kern.setArg(pos, count);
+		}
+
+		size_t global = count;
+		if (0 < _local_size)
+			global = ((count + _local_size - 1) / _local_size) * _local_size;
+
+		cl::Event done;
+		cl::CommandQueue& pq = ocn->get_queue(lane);
+		pq.enqueueNDRangeKernel(kern,
+			cl::NullRange,
+			cl::NDRange(global),
+			(0 < _local_size) ? cl::NDRange(_local_size) : cl::NullRange,
+			&deps, &done);
+		pq.flush();
+		ocn->return_kernel(_kname, kern);
+		parts.push_back(done);
+	}
+
+	queue.enqueueMarkerWithWaitList(&parts, &_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->set_last_event(_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _outputs)
+		ofv->mark_device_dirty();
+}
+
+static cl::NDRange to_ndrange(const std::vector<size_t>& sz)
+{
+	if (1 == sz.size()) return cl::NDRange(sz[0]);
+	if (2 == sz.size()) return cl::NDRange(sz[0], sz[1]);
+	return cl::NDRange(sz[0], sz[1], sz[2]);
+}
+
+/// Launch the kernel over a range of up to three dimensions. In each
+/// dimension, the range is padded up to a multiple of the work-group
+/// size; the kernel must check its bounds. The autotuner is not used.
+void OpenclJobValue::run_nd(cl::CommandQueue& queue)
+{
+	std::vector<cl::Event> deps;
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->add_dependency(deps);
+
+	_tune_trial = OpenclNode::NO_TRIAL;
+
+	// A required size of (16, 16, 1) is fine for a 2-D range.
+	size_t nd = _range.size();
+	std::vector<size_t> local(_local.begin(),
+		_local.begin() + std::min(nd, _local.size()));
+	if (local.empty() and 1 == nd and 0 < _local_size)
+		local.push_back(_local_size);
+	if (0 < local.size() and local.size() != nd)
+		throw RuntimeException(TRACE_INFO,
+			"The range of \"%s\" has %zu dimensions, but the"
+			" work-group size has %zu\n", _kname.c_str(), nd, local.size());
+
+	std::vector<size_t> global(_range);
+	for (size_t d = 0; d < local.size(); d++)
+		global[d] = ((global[d] + local[d] - 1) / local[d]) * local[d];
 
 	queue.enqueueNDRangeKernel(_kernel,
 		cl::NullRange,
-		cl::NDRange(_dim),
+		to_ndrange(global),
+		local.empty() ? cl::NullRange : to_ndrange(local),
+		&deps, &_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->set_last_event(_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _outputs)
+		ofv->mark_device_dirty();
+}
+
+/// Launch both stages of a reduction. The second waits on the first,
+/// even on an out-of-order queue, and is the one that signals
+/// `_run_event`. The autotuner is not used.
+void OpenclJobValue::run_reduction(cl::CommandQueue& queue)
+{
+	std::vector<cl::Event> deps;
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->add_dependency(deps);
+
+	_tune_trial = OpenclNode::NO_TRIAL;
+
+	cl::Event partial_done;
+	queue.enqueueNDRangeKernel(_kernel,
+		cl::NullRange,
+		cl::NDRange(_red_groups * _red_local),
+		cl::NDRange(_red_local),
+		&deps, &partial_done);
+
+	std::vector<cl::Event> deps2{partial_done};
+	queue.enqueueNDRangeKernel(_kernel2,
 		cl::NullRange,
-		nullptr, &event_handler);
+		cl::NDRange(_red_local),
+		cl::NDRange(_red_local),
+		&deps2, &_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _bound)
+		ofv->set_last_event(_run_event);
+
+	for (const OpenclFloatValuePtr& ofv : _outputs)
+		ofv->mark_device_dirty();
+}
+
+/// Run the host version of the kernel. The result goes straight into
+/// the host storage of the first output; there's nothing to fetch.
+void OpenclJobValue::run_native(void)
+{
+	const HandleSeq& cons = _iface->getOutgoingSet();
+	OpenclFloatValuePtr out;
+	std::vector<const double*> ins;
+	for (size_t i = 0; i < _args.size(); i++)
+	{
+		if (not _args[i]->is_type(OPENCL_DATA_VALUE)) continue;
+		OpenclFloatValuePtr ofv = OpenclFloatValueCast(_args[i]);
+		if (is_output(cons, i))
+		{
+			if (nullptr == out) out = ofv;
+		}
+		else
+			ins.push_back(ofv->value().data());
+	}
+
+	if (nullptr == out or ins.size() < _native->num_inputs)
+		throw RuntimeException(TRACE_INFO,
+			"Wrong arguments for native kernel \"%s\"\n", _kname.c_str());
+
+	size_t len = _reduction ? 1 : _dim;
+	out->materialize();
+	if (out->_value.size() < len)
+		out->_value.resize(len);
+	_native->func(out->_value.data(), ins.data(), _dim);
 }
 
 // ==============================================================
@@ -23,6 +23,10 @@
 #ifndef _OPENCOG_OPENCL_JOB_VALUE_H
 #define _OPENCOG_OPENCL_JOB_VALUE_H
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <opencog/atoms/opencl/opencl-headers.h>
 #include <opencog/atoms/value/LinkValue.h>
@@ -35,6 +39,37 @@ namespace opencog
  *  @{
  */
 
+class OpenclJobValue;
+struct NativeKernel;
+struct Reduction;
+typedef std::shared_ptr<OpenclJobValue> OpenclJobValuePtr;
+
+/// Jobs written together, as one graph. Only the sinks of the graph
+/// are reported, once all of the jobs are done. See OpenclNode-graph.cc
+struct JobGraph
+{
+	std::atomic<size_t> pending;
+	ValuePtr sinks;
+};
+typedef std::shared_ptr<JobGraph> JobGraphPtr;
+
+/// A stream of vectors, fed chunk by chunk to the input `from` of the
+/// Section. The chunks are copied into a few staging vectors, used in
+/// rotation; a staging vector stays busy until the job using it is
+/// done. The feeder quits once `stop` is set. See OpenclNode-stream.cc
+struct StreamFeed
+{
+	Handle sect;
+	Handle from;
+	ValuePtr source;
+	std::vector<OpenclFloatValuePtr> staging;
+	std::vector<bool> busy;
+	std::atomic<bool> stop{false};
+	std::mutex mtx;
+	std::condition_variable cv;
+};
+typedef std::shared_ptr<StreamFeed> StreamFeedPtr;
+
 /**
  * OpenclJobValues hold OpenCL kernels bound to thier arguments.
  */
@@ -44,17 +79,110 @@ class OpenclJobValue :
 	friend class OpenclNode;
 
 protected:
-	OpenclJobValue(Type t) : LinkValue(t), _is_built(false) {}
+	OpenclJobValue(Type t) :
+		LinkValue(t), _local_size(0), _flops(0), _nd(false), _tune_bucket(0),
+		_tune_trial((size_t) -1), _read_async(false), _slot(0),
+		_reduction(nullptr), _red_local(0), _red_groups(0),
+		_native(nullptr), _is_built(false) {}
 
 	Handle _definition;
+	std::string _kname;
 	cl::Kernel _kernel;
 	size_t _dim;
 
+	// The kernel name and the interface description, as found by
+	// build(), and the kernel arguments, as last bound. The `_owned`
+	// flags mark those arguments that were created by the job itself,
+	// from plain numbers, as opposed to vectors provided by the user.
+	Handle _kit;
+	Handle _iface;
+	ValueSeq _args;
+	std::vector<bool> _owned;
+
+	// Work-group size given in the Section, or zero, if none. The
+	// bucket and trial record what the autotuner is timing, if it is
+	// timing this launch.
+	size_t _local_size;
+
+	// Floating-point operations per work-item, as given in the Section,
+	// for profiling; see OpenclNode-profile.cc
+	size_t _flops;
+	size_t bytes_moved(void) const;
+	double flops(void) const;
+
+	// Jobs on ranges of two or three dimensions, such as matrix
+	// products. These are launched over `_range`, which is either the
+	// `_global` size given in the Section, or the shape of the first
+	// output; `_local` is the work-group size, if several numbers are
+	// given for it. The vectors are not cut to a common length, and
+	// each scalar gets the number given for it.
+	bool _nd;
+	std::vector<size_t> _global;
+	std::vector<size_t> _local;
+	std::vector<size_t> _range;
+
+	size_t _tune_bucket;
+	size_t _tune_trial;
+	static bool is_launch_option(const Handle&);
+	static bool is_shape_spec(const Handle&);
+	void get_launch_options(void);
+
+	// Jobs for a Section that was seen before are not built from
+	// scratch. Instead, they share the kernel of the job that was
+	// first built for it, the `_proto`, and only rebind those
+	// arguments that changed. The `_fresh` arguments are the newly
+	// evaluated ones. Since the kernel is shared, its arguments are
+	// set again before every launch; see set_kernel_args().
+	OpenclJobValuePtr _proto;
+	ValueSeq _fresh;
+
+	// The graph that this job is a part of, if any.
+	JobGraphPtr _graph;
+
+	// True if the outputs are to be downloaded before the job is
+	// reported. See OpenclNode-async.cc
+	bool _read_async;
+
+	// The stream that this job is a part of, if any, the staging slot
+	// it is using, and its chunk of the stream.
+	StreamFeedPtr _feed;
+	size_t _slot;
+	ValuePtr _chunk;
+	ValuePtr stage(const Handle&, Type, size_t);
+
+	// Reductions from the built-in library run as two kernels: the
+	// first leaves one partial result per work-group in `_partials`,
+	// the second reduces these. `_red_local` is the work-group size
+	// for both, and `_red_groups` the number of groups in the first.
+	// See Reductions.h
+	const Reduction* _reduction;
+	std::string _kname2;
+	cl::Kernel _kernel2;
+	OpenclFloatValuePtr _partials;
+	size_t _red_local;
+	size_t _red_groups;
+
+	// The host version of the kernel, when the OpenclNode has no
+	// OpenCL device. See NativeKernels.h
+	const NativeKernel* _native;
+
 	// Buffers created during build() that need uploading to the GPU.
 	// Upload is deferred to upload_inputs(), which runs on the
 	// dispatch thread, avoiding races on the shared command queue.
 	std::vector<OpenclFloatValuePtr> _pending_uploads;
 
+	// All of the buffers bound to the kernel. The launch waits on the
+	// last command issued on each of these, and then becomes the last
+	// command on each. It signals `_run_event` when the kernel is done.
+	std::vector<OpenclFloatValuePtr> _bound;
+	cl::Event _run_event;
+
+	// The buffers bound to output connectors. These are marked as
+	// holding new data on the device, every time the kernel is run.
+	// `_out_pos` are their argument positions.
+	std::vector<OpenclFloatValuePtr> _outputs;
+	std::vector<size_t> _out_pos;
+
 	// Handle to OpenclNode, stored for deferred build in dispatch thread.
 	// This allows build() to be called from queue_job() instead of do_write(),
 	// ensuring all OpenCL kernel object creation happens in a single thread.
@@ -68,17 +196,35 @@ protected:
 	bool is_built(void) const { return _is_built; }
 
 	void build(const Handle&);
-	void upload_inputs(const Handle&);
-	void run(const Handle&);
+	void build_native(const Handle&, const std::string&);
+	void rebind(const Handle&);
+	void bind_args(const ValueSeq&);
+	void bind_reduction(const ValueSeq&);
+	void set_kernel_args(void);
+	void restore_evicted(const Handle&);
+	void upload_inputs(cl::CommandQueue&);
+	void run(cl::CommandQueue&);
+	void run_reduction(cl::CommandQueue&);
+	void run_nd(cl::CommandQueue&);
+	bool can_split(void) const;
+	void run_split(cl::CommandQueue&);
+	void run_native(void);
 	void check_signature(const Handle&, const Handle&, const ValueSeq&);
 
 	const std::string& get_kern_name (void) const;
-	bool get_vec_len(const ValueSeq&);
-	ValuePtr get_floats(const Handle&, ValuePtr);
-	ValueSeq make_vectors(const Handle&);
+	bool get_vec_len(const ValueSeq&, const HandleSeq&);
+	ValuePtr get_floats(const Handle&, ValuePtr, Type, size_t);
+	ValueSeq eval_args(void) const;
+	ValueSeq make_vectors(const Handle&, const Handle&);
+	ValuePtr shaped(const Handle&, Type) const;
+	bool is_nd(const ValueSeq&) const;
+	ValueSeq make_nd_vectors(const Handle&, const ValueSeq&,
+	                         const HandleSeq&);
+	void find_range(const ValueSeq&, const HandleSeq&);
 
 public:
 	OpenclJobValue(Handle);
+	OpenclJobValue(const OpenclJobValuePtr&);
 	virtual ~OpenclJobValue();
 };
 
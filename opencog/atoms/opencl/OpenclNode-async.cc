@@ -0,0 +1,139 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-async.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/Logger.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/opencl/types/atom_types.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Asynchronous reads.
+//
+// Reading a result normally means waiting twice: once in *-read-*,
+// for the job to be done, and again when the output vector is looked
+// at, for it to be downloaded. A thread in a CogServer waiting on
+// each of these can do nothing else in the meanwhile. Instead,
+//
+//    (SetValue clnode (Predicate "*-read-async-*") (Section ...))
+//
+// runs the job, and then downloads its outputs, without anyone
+// waiting on either. Once the outputs are in host memory, the job is
+// placed on the QueueValue given by
+//
+//    (ValueOf clnode (Predicate "*-read-async-*"))
+//
+// which can be looked at whenever convenient. Vectors, jobs that were
+// already read, and LinkValues of these can be given instead of a
+// Section; they are placed on the same QueueValue, once downloaded.
+//
+// Downloads count toward the in-flight window, so that close() waits
+// for them.
+
+namespace opencog {
+struct AsyncRead
+{
+	OpenclNode* node;
+	ValuePtr vp;
+	std::atomic<size_t> pending;
+};
+}
+
+/// Gather up the vectors that make up `vp`.
+void OpenclNode::get_fetchable(const ValuePtr& vp,
+                               std::vector<OpenclFloatValuePtr>& vecs)
+{
+	if (vp->is_type(OPENCL_JOB_VALUE))
+	{
+		for (const OpenclFloatValuePtr& ofv : OpenclJobValueCast(vp)->_outputs)
+			vecs.push_back(ofv);
+		return;
+	}
+	if (vp->is_type(OPENCL_DATA_VALUE))
+	{
+		vecs.push_back(OpenclFloatValueCast(vp));
+		return;
+	}
+	if (vp->is_type(LINK_VALUE))
+	{
+		for (const ValuePtr& v : LinkValueCast(vp)->value())
+			get_fetchable(v, vecs);
+	}
+}
+
+/// Start downloading everything in `vp`, and place it on the
+/// QueueValue of finished reads when it has all arrived. A Section
+/// is run first; its outputs are downloaded once it is done.
+void OpenclNode::read_async(const ValuePtr& vp)
+{
+	if (vp->is_type(SECTION))
+	{
+		OpenclJobValuePtr job = make_job(HandleCast(vp));
+		job->_read_async = true;
+		dispatch(job);
+		return;
+	}
+
+	std::vector<OpenclFloatValuePtr> vecs;
+	get_fetchable(vp, vecs);
+
+	std::vector<cl::Event> evs;
+	for (const OpenclFloatValuePtr& ofv : vecs)
+	{
+		cl::Event done;
+		if (ofv->fetch_async(done))
+			evs.push_back(done);
+	}
+
+	if (0 == evs.size())
+	{
+		if (_ready) _ready->add(vp);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(_inflight_mtx);
+		_num_inflight ++;
+	}
+	AsyncRead* ard = new AsyncRead{this, vp, {evs.size()}};
+	for (cl::Event& ev : evs)
+		ev.setCallback(CL_COMPLETE, fetch_done, ard);
+}
+
+/// OpenCL event callback for downloads.
+void CL_CALLBACK OpenclNode::fetch_done(cl_event ev, cl_int status,
+                                        void* data)
+{
+	AsyncRead* ard = (AsyncRead*) data;
+	if (CL_COMPLETE != status)
+		logger().warn("OpenclNode: read failed with status %d\n", status);
+
+	if (0 != --ard->pending) return;
+
+	OpenclNode* onp = ard->node;
+	if (onp->_ready)
+		onp->_ready->add(ard->vp);
+	delete ard;
+	onp->release_slot();
+}
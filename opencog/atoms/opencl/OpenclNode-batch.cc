@@ -0,0 +1,228 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-batch.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <set>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/LinkValue.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Batched writes.
+//
+// Writing a LinkValue of vectors sends all of them to the device in
+// one go. Vectors that don't yet have device storage are laid out,
+// one after the other, in a single new buffer, and each one gets a
+// sub-buffer of it as its own. When the same batch is written again,
+// the host data is gathered into one staging area, and sent with a
+// single write, instead of one write per vector. The LinkValue is
+// placed on the QueueValue, as a whole, when the write has completed.
+//
+// Vectors that are not part of such a batch, or whose batch-mates are
+// not all being written along with them, are sent one at a time.
+
+/// Unpack the batch, dropping duplicates.
+static std::vector<OpenclFloatValuePtr> get_members(const ValuePtr& vp)
+{
+	std::vector<OpenclFloatValuePtr> vecs;
+	std::set<const OpenclFloatValue*> seen;
+	for (const ValuePtr& v : LinkValueCast(vp)->value())
+	{
+		OpenclFloatValuePtr ofv = OpenclFloatValueCast(v);
+		if (nullptr == ofv)
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a list of OpenclFloatValues, got %s\n",
+				v->to_string().c_str());
+		if (seen.insert(ofv.get()).second)
+			vecs.push_back(ofv);
+	}
+	return vecs;
+}
+
+/// Give device storage to those vectors in the batch that don't have
+/// it yet. This runs in the writer's thread, so that bad batches are
+/// reported to the writer.
+void OpenclNode::bind_batch(const ValuePtr& vp)
+{
+	std::vector<OpenclFloatValuePtr> vecs = get_members(vp);
+
+	// SVM and zero-copy storage can't be carved out of a buffer.
+	std::vector<OpenclFloatValuePtr> fresh;
+	for (const OpenclFloatValuePtr& ofv : vecs)
+	{
+		if (_use_svm or _zero_copy or ofv->_have_buff or
+		    0 == ofv->reserve_size())
+			ofv->set_context(get_handle());
+		else
+			fresh.push_back(ofv);
+	}
+
+	if (1 == fresh.size())
+		fresh[0]->set_context(get_handle());
+	if (fresh.size() < 2) return;
+
+	// Sub-buffers must start on an aligned address.
+	std::vector<size_t> offsets;
+	size_t total = 0;
+	for (const OpenclFloatValuePtr& ofv : fresh)
+	{
+		total = ((total + _base_align - 1) / _base_align) * _base_align;
+		offsets.push_back(total);
+		total += ofv->reserve_size();
+	}
+
+	cl::Buffer parent(_context, CL_MEM_READ_WRITE, total);
+	for (size_t i = 0; i < fresh.size(); i++)
+		fresh[i]->set_sub_buffer(get_handle(), parent,
+			offsets[i], fresh.size());
+}
+
+/// Event callback; the staging area is no longer needed.
+void CL_CALLBACK OpenclNode::free_staging(cl_event ev, cl_int status,
+                                          void* data)
+{
+	delete (std::vector<char>*) data;
+}
+
+/// Send all of the vectors sharing one parent buffer with a single
+/// write. Returns false, if this can't be done. The write event is
+/// appended to `sent`.
+bool OpenclNode::send_parent(const std::vector<OpenclFloatValuePtr>& mates,
+                             cl::CommandQueue& queue,
+                             std::vector<cl::Event>& sent)
+{
+	// Everyone sharing the parent must be here. Anyone with newer
+	// data on the device than on the host would get clobbered.
+	if (mates.size() != mates[0]->_batch_members) return false;
+
+	bool changed = false;
+	for (const OpenclFloatValuePtr& ofv : mates)
+	{
+		if (ofv->host_is_stale() or ofv->_lazy) return false;
+		if (ofv->device_is_stale()) changed = true;
+	}
+
+	// Nothing to send; wait for whatever is still in progress.
+	if (not changed)
+	{
+		for (const OpenclFloatValuePtr& ofv : mates)
+			ofv->add_dependency(sent);
+		return true;
+	}
+
+	size_t total = 0;
+	for (const OpenclFloatValuePtr& ofv : mates)
+		total = std::max(total, ofv->_offset + ofv->reserve_size());
+
+	// The generation must be sampled before the data is copied;
+	// see send_buffer().
+	std::vector<char>* staging = new std::vector<char>(total);
+	std::vector<size_t> gens;
+	std::vector<cl::Event> deps;
+	for (const OpenclFloatValuePtr& ofv : mates)
+	{
+		gens.push_back(ofv->_host_gen);
+		ofv->pack();
+		memcpy(staging->data() + ofv->_offset, ofv->data(),
+			ofv->reserve_size());
+		ofv->add_dependency(deps);
+	}
+
+	cl::Event done;
+	try
+	{
+		queue.enqueueWriteBuffer(mates[0]->_parent, CL_FALSE, 0,
+			total, staging->data(), &deps, &done);
+		if (_profile)
+			profile("*-upload-*", done, total, 0.0);
+	}
+	catch (...)
+	{
+		delete staging;
+		throw;
+	}
+
+	try
+	{
+		done.setCallback(CL_COMPLETE, free_staging, staging);
+	}
+	catch (...)
+	{
+		done.wait();
+		delete staging;
+		throw;
+	}
+
+	for (size_t i = 0; i < mates.size(); i++)
+	{
+		mates[i]->set_last_event(done);
+		mates[i]->_sent_gen = gens[i];
+	}
+	sent.push_back(done);
+	return true;
+}
+
+/// Send the batch to the device. The `done` event is signalled when
+/// all of the vectors have arrived.
+void OpenclNode::send_batch(const ValuePtr& vp, cl::CommandQueue& queue,
+                            cl::Event& done)
+{
+	std::vector<OpenclFloatValuePtr> vecs = get_members(vp);
+
+	std::vector<cl::Event> sent;
+	std::map<cl_mem, std::vector<OpenclFloatValuePtr>> groups;
+	for (const OpenclFloatValuePtr& ofv : vecs)
+	{
+		if (nullptr != ofv->_parent())
+		{
+			groups[ofv->_parent()].push_back(ofv);
+			continue;
+		}
+		cl::Event evt;
+		ofv->send_buffer(queue, evt);
+		sent.push_back(evt);
+	}
+
+	for (const auto& grp : groups)
+	{
+		if (send_parent(grp.second, queue, sent)) continue;
+
+		for (const OpenclFloatValuePtr& ofv : grp.second)
+		{
+			cl::Event evt;
+			ofv->send_buffer(queue, evt);
+			sent.push_back(evt);
+		}
+	}
+
+	if (1 == sent.size())
+	{
+		done = sent[0];
+		return;
+	}
+	queue.enqueueMarkerWithWaitList(sent.size() ? &sent : nullptr, &done);
+}
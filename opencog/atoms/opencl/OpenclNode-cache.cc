@@ -20,12 +20,18 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <dirent.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
 #include <cstdlib>
-#include <functional>
+#include <thread>
 
 #include <opencog/util/Logger.h>
 
@@ -39,6 +45,13 @@ using namespace opencog;
 // compilation on subsequent runs. Cache files are stored in
 // ~/.cache/opencog/opencl/<device_hash>/<source_hash>.bin
 //
+// The hashes are SHA-256. The device hash covers the platform, the
+// device and the driver version; the source hash covers the source,
+// every file it #includes, and the build options. Entries are written
+// to a temp file, and then renamed, so that a reader never sees half
+// a file. Loading an entry touches it; when the cache grows past
+// `_cache_max` bytes, the entries touched longest ago are deleted.
+//
 // This follows the pattern used by hashcat, PyOpenCL, and game engines
 // to dramatically reduce startup time (from seconds to milliseconds).
 
@@ -56,60 +69,194 @@ using namespace opencog;
 // These not what Atomese is or how its supposed to work.
 // So XXX FIXME, review me, and maybe trash this code. The future is cloudy.
 
-/// Compute a simple hash of a string using std::hash.
+// --------------------------------------------------------------
+// SHA-256, as in FIPS 180-4. Hashing the source is a tiny part of
+// the cost of building it, so nothing clever is done here.
+
+static const uint32_t sha_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr(uint32_t x, int n)
+{
+	return (x >> n) | (x << (32 - n));
+}
+
+static void sha_block(uint32_t* h, const unsigned char* blk)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; i++)
+		w[i] = ((uint32_t) blk[4*i] << 24) | ((uint32_t) blk[4*i+1] << 16) |
+		       ((uint32_t) blk[4*i+2] << 8) | (uint32_t) blk[4*i+3];
+	for (int i = 16; i < 64; i++)
+	{
+		uint32_t s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+		uint32_t s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+	uint32_t e = h[4], f = h[5], g = h[6], k = h[7];
+	for (int i = 0; i < 64; i++)
+	{
+		uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		uint32_t ch = (e & f) ^ (~e & g);
+		uint32_t t1 = k + s1 + ch + sha_k[i] + w[i];
+		uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		uint32_t t2 = s0 + maj;
+		k = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+	h[4] += e; h[5] += f; h[6] += g; h[7] += k;
+}
+
+/// Compute the SHA-256 hash of a string.
 /// Returns a hex string representation.
 std::string OpenclNode::compute_hash(const std::string& data) const
 {
-	std::hash<std::string> hasher;
-	size_t hash = hasher(data);
+	uint32_t h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+	const unsigned char* bytes = (const unsigned char*) data.data();
+	size_t len = data.size();
+	size_t full = len / 64;
+	for (size_t i = 0; i < full; i++)
+		sha_block(h, bytes + 64*i);
+
+	// Padding: a one bit, zeros, and the length in bits.
+	unsigned char tail[128] = {0};
+	size_t rem = len - 64*full;
+	memcpy(tail, bytes + 64*full, rem);
+	tail[rem] = 0x80;
+	size_t tlen = (rem < 56) ? 64 : 128;
+	uint64_t bits = (uint64_t) len * 8;
+	for (int i = 0; i < 8; i++)
+		tail[tlen - 1 - i] = (unsigned char) (bits >> (8*i));
+	sha_block(h, tail);
+	if (128 == tlen) sha_block(h, tail + 64);
 
 	std::ostringstream oss;
-	oss << std::hex << std::setfill('0') << std::setw(16) << hash;
+	oss << std::hex << std::setfill('0');
+	for (int i = 0; i < 8; i++)
+		oss << std::setw(8) << h[i];
 	return oss.str();
 }
 
-/// Get the cache directory path.
-/// Creates ~/.cache/opencog/opencl/<device_hash>/ if it doesn't exist.
-std::string OpenclNode::get_cache_dir(void) const
+// --------------------------------------------------------------
+
+/// The root of the cache.
+static std::string cache_root(void)
 {
-	// Get home directory
 	const char* home = std::getenv("HOME");
 	if (nullptr == home) home = "/tmp";
+	return std::string(home) + "/.cache/opencog/opencl";
+}
 
+/// Get the cache directory path.
+/// Creates ~/.cache/opencog/opencl/<device_hash>/ if it doesn't exist.
+std::string OpenclNode::get_cache_dir(void) const
+{
 	// Build device identifier for cache directory
 	std::string device_id = _platform.getInfo<CL_PLATFORM_NAME>() + "_" +
+	                        _platform.getInfo<CL_PLATFORM_VERSION>() + "_" +
 	                        _device.getInfo<CL_DEVICE_NAME>() + "_" +
+	                        _device.getInfo<CL_DEVICE_VERSION>() + "_" +
 	                        _device.getInfo<CL_DRIVER_VERSION>();
 	std::string device_hash = compute_hash(device_id);
 
-	std::string cache_dir = std::string(home) + "/.cache/opencog/opencl/" + device_hash;
-
 	// Create directories if they don't exist (mkdir -p equivalent)
-	std::string path = std::string(home) + "/.cache";
-	mkdir(path.c_str(), 0755);
-	path += "/opencog";
-	mkdir(path.c_str(), 0755);
-	path += "/opencl";
-	mkdir(path.c_str(), 0755);
-	path += "/" + device_hash;
-	mkdir(path.c_str(), 0755);
+	std::string root = cache_root();
+	for (size_t pos = root.find('/', 1); std::string::npos != pos;
+	     pos = root.find('/', pos+1))
+		mkdir(root.substr(0, pos).c_str(), 0755);
+	mkdir(root.c_str(), 0755);
 
+	std::string cache_dir = root + "/" + device_hash;
+	mkdir(cache_dir.c_str(), 0755);
 	return cache_dir;
 }
 
+/// Append the contents of every file included with `#include "..."`
+/// to `out`, recursively. The files are looked for in `dir`; those
+/// that can't be found are left to the compiler to complain about.
+static void gather_includes(const std::string& src, const std::string& dir,
+                            std::string& out, int depth)
+{
+	if (8 < depth) return;
+
+	std::istringstream iss(src);
+	std::string line;
+	while (std::getline(iss, line))
+	{
+		size_t pos = line.find_first_not_of(" \t");
+		if (std::string::npos == pos or '#' != line[pos]) continue;
+		pos = line.find_first_not_of(" \t", pos+1);
+		if (std::string::npos == pos or 0 != line.compare(pos, 7, "include"))
+			continue;
+
+		size_t open = line.find('"', pos);
+		if (std::string::npos == open) continue;
+		size_t close = line.find('"', open+1);
+		if (std::string::npos == close) continue;
+
+		std::string name = line.substr(open+1, close-open-1);
+		std::ifstream incf(dir + "/" + name);
+		std::string inc(std::istreambuf_iterator<char>(incf),
+			(std::istreambuf_iterator<char>()));
+		out += '\0' + name + '\0' + inc;
+		gather_includes(inc, dir, out, depth+1);
+	}
+}
+
+/// The options that the program is built with. Sources that include
+/// other files get the directory of the source on the include path.
+std::string OpenclNode::get_build_options(const std::string& src) const
+{
+	std::string incs;
+	std::string dir = _filepath.substr(0, _filepath.find_last_of('/'));
+	gather_includes(src, dir, incs, 0);
+
+	// The argument info is what the kernels are described from.
+	std::string opts = "-cl-kernel-arg-info";
+	if (0 < incs.size()) opts += " -I " + dir;
+	return opts;
+}
+
 /// Get the full cache file path for a given source.
 std::string OpenclNode::get_cache_path(const std::string& src) const
 {
-	std::string source_hash = compute_hash(src);
-	return get_cache_dir() + "/" + source_hash + ".bin";
+	std::string incs;
+	std::string dir = _filepath.substr(0, _filepath.find_last_of('/'));
+	gather_includes(src, dir, incs, 0);
+
+	std::string key = src + '\0' + incs + '\0' + get_build_options(src);
+	return get_cache_dir() + "/" + compute_hash(key) + ".bin";
 }
 
 /// Try to load a cached binary. Returns true if successful.
-bool OpenclNode::load_cached_binary(const std::string& cache_path)
+bool OpenclNode::load_cached_binary(const std::string& cache_path,
+                                    cl::Program& prog)
 {
 	std::ifstream binfile(cache_path, std::ios::binary);
 	if (!binfile.is_open())
+	{
+		_cache_misses ++;
 		return false;
+	}
 
 	// Read the entire binary file
 	std::vector<char> binary((std::istreambuf_iterator<char>(binfile)),
@@ -117,7 +264,10 @@ bool OpenclNode::load_cached_binary(const std::string& cache_path)
 	binfile.close();
 
 	if (binary.empty())
+	{
+		_cache_misses ++;
 		return false;
+	}
 
 	try
 	{
@@ -128,17 +278,22 @@ bool OpenclNode::load_cached_binary(const std::string& cache_path)
 		std::vector<cl::Device> devices = {_device};
 		std::vector<cl_int> binary_status;
 
-		_program = cl::Program(_context, devices, binaries, &binary_status);
+		prog = cl::Program(_context, devices, binaries, &binary_status);
 
 		// Check if binary was valid for this device
 		if (binary_status[0] != CL_SUCCESS)
 		{
 			logger().info("OpenclNode: Cached binary invalid for device, will recompile\n");
+			_cache_misses ++;
 			return false;
 		}
 
 		// Build the program (links the binary, much faster than JIT compile)
-		_program.build("");
+		prog.build("");
+
+		// Mark it as recently used, for eviction.
+		utime(cache_path.c_str(), nullptr);
+		_cache_hits ++;
 
 		logger().info("OpenclNode: Loaded cached binary from %s\n", cache_path.c_str());
 		return true;
@@ -146,17 +301,29 @@ bool OpenclNode::load_cached_binary(const std::string& cache_path)
 	catch (const cl::Error& e)
 	{
 		logger().info("OpenclNode: Failed to load cached binary: %s\n", e.what());
+		_cache_misses ++;
 		return false;
 	}
 }
 
+/// The name of a temp file to write `path` to. It must differ for
+/// every writer.
+static std::string temp_path(const std::string& path)
+{
+	std::ostringstream tmp;
+	tmp << path << ".tmp." << getpid() << "."
+	    << std::hash<std::thread::id>()(std::this_thread::get_id());
+	return tmp.str();
+}
+
 /// Save the compiled program binary to cache.
-void OpenclNode::save_binary_to_cache(const std::string& cache_path)
+void OpenclNode::save_binary_to_cache(const std::string& cache_path,
+                                      const cl::Program& prog)
 {
 	try
 	{
 		// Get the binary sizes
-		std::vector<size_t> binary_sizes = _program.getInfo<CL_PROGRAM_BINARY_SIZES>();
+		std::vector<size_t> binary_sizes = prog.getInfo<CL_PROGRAM_BINARY_SIZES>();
 		if (binary_sizes.empty() || binary_sizes[0] == 0)
 		{
 			logger().info("OpenclNode: No binary available to cache\n");
@@ -174,23 +341,140 @@ void OpenclNode::save_binary_to_cache(const std::string& cache_path)
 		for (auto& b : binaries)
 			binary_ptrs.push_back(b.data());
 
-		clGetProgramInfo(_program(), CL_PROGRAM_BINARIES,
+		clGetProgramInfo(prog(), CL_PROGRAM_BINARIES,
 		                 binary_ptrs.size() * sizeof(unsigned char*),
 		                 binary_ptrs.data(), nullptr);
 
-		// Write to cache file
-		std::ofstream binfile(cache_path, std::ios::binary);
-		if (binfile.is_open())
+		// Write to a temp file, then rename it, so that other processes
+		// never load a partly written binary.
+		std::string tmp_path = temp_path(cache_path);
+
+		std::ofstream binfile(tmp_path, std::ios::binary);
+		if (not binfile.is_open()) return;
+		binfile.write(reinterpret_cast<const char*>(binaries[0].data()),
+		              binaries[0].size());
+		binfile.close();
+		if (binfile.fail() or
+		    0 != rename(tmp_path.c_str(), cache_path.c_str()))
 		{
-			binfile.write(reinterpret_cast<const char*>(binaries[0].data()),
-			              binaries[0].size());
-			binfile.close();
-			logger().info("OpenclNode: Saved binary to cache: %s (%zu bytes)\n",
-			              cache_path.c_str(), binaries[0].size());
+			unlink(tmp_path.c_str());
+			return;
 		}
+		logger().info("OpenclNode: Saved binary to cache: %s (%zu bytes)\n",
+		              cache_path.c_str(), binaries[0].size());
 	}
 	catch (const cl::Error& e)
 	{
 		logger().info("OpenclNode: Failed to save binary to cache: %s\n", e.what());
 	}
+
+	evict_cache();
+}
+
+/// Kernel signatures are kept next to the binary, one kernel per line:
+/// the kernel name, and then the type of each argument, separated by
+/// tabs. These are what get_kernel_decls() found, the first time
+/// around. Returns true if they were found.
+bool OpenclNode::load_cached_decls(const std::string& idl_path,
+                                   std::vector<KernelDecl>& decls)
+{
+	std::ifstream idlfile(idl_path);
+	if (not idlfile.is_open()) return false;
+
+	std::string line;
+	while (std::getline(idlfile, line))
+	{
+		if (0 == line.size()) continue;
+		KernelDecl decl;
+		std::stringstream ss(line);
+		std::getline(ss, decl.name, '\t');
+		std::string ptype;
+		while (std::getline(ss, ptype, '\t'))
+			decl.param_types.push_back(ptype);
+		decls.push_back(decl);
+	}
+	return 0 < decls.size();
+}
+
+void OpenclNode::save_decls_to_cache(const std::string& idl_path,
+                                     const std::vector<KernelDecl>& decls)
+{
+	std::string tmp_path = temp_path(idl_path);
+	std::ofstream idlfile(tmp_path);
+	if (not idlfile.is_open()) return;
+	for (const KernelDecl& decl : decls)
+	{
+		idlfile << decl.name;
+		for (const std::string& ptype : decl.param_types)
+			idlfile << '\t' << ptype;
+		idlfile << '\n';
+	}
+	idlfile.close();
+	if (idlfile.fail() or
+	    0 != rename(tmp_path.c_str(), idl_path.c_str()))
+		unlink(tmp_path.c_str());
+}
+
+/// Delete the least recently used binaries, until the cache holds no
+/// more than `_cache_max` bytes. The work-group sizes and signatures
+/// saved next to a binary go with it. All devices share the one budget.
+void OpenclNode::evict_cache(void)
+{
+	struct Entry
+	{
+		std::string path;
+		time_t used;
+		size_t size;
+	};
+	std::vector<Entry> entries;
+	size_t total = 0;
+
+	std::string root = cache_root();
+	DIR* rdir = opendir(root.c_str());
+	if (nullptr == rdir) return;
+	while (struct dirent* dev = readdir(rdir))
+	{
+		if ('.' == dev->d_name[0]) continue;
+		std::string dpath = root + "/" + dev->d_name;
+		DIR* ddir = opendir(dpath.c_str());
+		if (nullptr == ddir) continue;
+		while (struct dirent* ent = readdir(ddir))
+		{
+			std::string name = ent->d_name;
+			if (name.size() < 4 or 0 != name.compare(name.size()-4, 4, ".bin"))
+				continue;
+			std::string path = dpath + "/" + name;
+			struct stat st;
+			if (0 != stat(path.c_str(), &st)) continue;
+			entries.push_back({path, st.st_mtime, (size_t) st.st_size});
+			total += st.st_size;
+		}
+		closedir(ddir);
+	}
+	closedir(rdir);
+
+	if (total <= _cache_max) return;
+
+	std::sort(entries.begin(), entries.end(),
+		[](const Entry& a, const Entry& b) { return a.used < b.used; });
+	for (const Entry& ent : entries)
+	{
+		if (total <= _cache_max) break;
+		if (0 != unlink(ent.path.c_str())) continue;
+		std::string base = ent.path.substr(0, ent.path.size()-4);
+		unlink((base + ".wgs").c_str());
+		unlink((base + ".idl").c_str());
+		total -= ent.size;
+		_cache_evictions ++;
+	}
+}
+
+/// Report cache statistics, as a FloatValue of
+/// (hits, misses, evictions).
+ValuePtr OpenclNode::cache_stats(void) const
+{
+	return createFloatValue(std::vector<double>{
+		(double) _cache_hits,
+		(double) _cache_misses,
+		(double) _cache_evictions});
 }
@@ -0,0 +1,67 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-fuse.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/Logger.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Fused kernels.
+//
+// Kernels generated from Atomese arithmetic are compiled on first use,
+// in the dispatch thread, the same way as the program given in the
+// URL, and the binary is cached on disk the same way. The kernel name
+// is derived from the hash of the Lambda, so that the same arithmetic
+// always gets the same kernel; a Lambda that was seen before is not
+// generated again, nor is it recompiled, until the next close().
+
+/// Get the fused kernel for `lambda`, generating and compiling it,
+/// if needed.
+const OpenclNode::FusedEntry& OpenclNode::get_fused(const Handle& lambda)
+{
+	std::lock_guard<std::mutex> lck(_fused_mtx);
+
+	auto it = _fused.find(lambda);
+	if (_fused.end() == it)
+	{
+		FusedEntry ent;
+		ent.kern = gen_fused_kernel(lambda);
+		it = _fused.emplace(lambda, std::move(ent)).first;
+
+		// The names must point into the entry, which does not move.
+		// The second stage is the one from the reduction library.
+		const FusedKernel& fk = it->second.kern;
+		it->second.red = Reduction{fk.name.c_str(), fk.name.c_str(),
+			"rsum_final", 1, fk.num_inputs};
+
+		logger().debug("OpenclNode: generated %s for %s\n",
+			fk.name.c_str(), lambda->to_short_string().c_str());
+	}
+
+	const FusedKernel& fk = it->second.kern;
+	if (_fused_progs.end() == _fused_progs.find(fk.name))
+		_fused_progs.emplace(fk.name, compile_source(fk.source));
+
+	return it->second;
+}
@@ -0,0 +1,193 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-graph.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/opencl/types/atom_types.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Graphs of jobs.
+//
+// Chaining kernels, e.g. the output of vec_mult used as an input to
+// vec_add, used to mean writing one Section, reading back the result,
+// and then writing the next. Instead, a whole graph of Sections can be
+// written at once, as a LinkValue. Sections that share a vector are
+// connected by it: the one that has it as an output comes before the
+// ones that have it as an input. The vectors in between never leave
+// the device; only the sinks, the jobs whose outputs are not used by
+// any other job in the graph, are reported, as a LinkValue, once all
+// of the jobs are done.
+//
+// The ordering on the device needs nothing new: every command on a
+// buffer already waits for the last command that touched it. So it
+// is enough to dispatch the jobs in dependency order. They are dealt
+// out to the lanes as usual, so that independent branches of the
+// graph run concurrently, when there are several lanes.
+//
+// Vectors are shared by naming them with the same Atom, typically
+// (ValueOf (Anchor ...) (Predicate ...)). NumberNodes are not shared;
+// each job gets a vector of its own for each of these.
+
+/// Sort the arguments of the Section into inputs and outputs.
+OpenclNode::JobIO OpenclNode::job_io(const Handle& sect)
+{
+	const Handle& head = sect->getOutgoingAtom(0);
+	const HandleSeq& args = sect->getOutgoingAtom(1)->getOutgoingSet();
+
+	// For fused kernels, the first argument is the output, always.
+	HandleSeq cons;
+	if (not head->is_type(LAMBDA_LINK))
+	{
+		const auto& descr = _kernel_interfaces.find(head);
+		if (_kernel_interfaces.end() == descr)
+			throw RuntimeException(TRACE_INFO,
+				"This OpenclNode does not know about the kernel %s\n",
+				head->to_short_string().c_str());
+		cons = descr->second->getOutgoingSet();
+	}
+
+	JobIO io;
+	size_t pos = 0;
+	for (Handle arg : args)
+	{
+		if (OpenclJobValue::is_launch_option(arg)) continue;
+		if (OpenclJobValue::is_shape_spec(arg))
+			arg = arg->getOutgoingAtom(1);
+
+		bool is_out = (0 == pos);
+		if (pos < cons.size())
+		{
+			const std::string& sex =
+				cons[pos]->getOutgoingAtom(1)->get_name();
+			is_out = (0 == sex.compare("output") or
+				0 == sex.compare("reduce"));
+		}
+		pos++;
+
+		if (arg->is_type(NUMBER_NODE) or arg->is_type(CONNECTOR))
+			continue;
+
+		if (is_out)
+			io.outs.insert(arg);
+		else
+			io.ins.insert(arg);
+	}
+	return io;
+}
+
+static bool overlap(const HandleSet& a, const HandleSet& b)
+{
+	for (const Handle& h : a)
+		if (b.end() != b.find(h)) return true;
+	return false;
+}
+
+/// Put the Sections in dependency order, and dispatch them. Sections
+/// that don't depend on one another stay in the order given. Two
+/// Sections writing the same vector, or each reading what the other
+/// writes, also stay in the order given.
+void OpenclNode::write_graph(const ValuePtr& vp)
+{
+	// The kernel interfaces are found by open(); with the `async`
+	// option, it might still be busy.
+	wait_open();
+
+	const ValueSeq& vsq = LinkValueCast(vp)->value();
+	size_t nsect = vsq.size();
+
+	HandleSeq sects;
+	std::vector<JobIO> ios;
+	for (const ValuePtr& v : vsq)
+	{
+		if (not v->is_type(SECTION))
+			throw RuntimeException(TRACE_INFO,
+				"Expecting a graph of Sections, got %s\n",
+				v->to_string().c_str());
+		sects.push_back(HandleCast(v));
+		ios.emplace_back(job_io(HandleCast(v)));
+	}
+
+	// Edges, from each Section to those that must come after it.
+	std::vector<std::vector<size_t>> after(nsect);
+	std::vector<size_t> num_before(nsect, 0);
+	std::vector<bool> is_sink(nsect, true);
+	for (size_t i = 0; i < nsect; i++)
+	{
+		for (size_t j = 0; j < nsect; j++)
+		{
+			if (i == j) continue;
+			// When each reads what the other writes, as with
+			// acc = acc + a and then acc = acc + b, the given order
+			// is kept.
+			bool feeds = overlap(ios[i].outs, ios[j].ins);
+			if (feeds and j < i and overlap(ios[j].outs, ios[i].ins))
+				feeds = false;
+			if (feeds) is_sink[i] = false;
+			if (feeds or (i < j and overlap(ios[i].outs, ios[j].outs)))
+			{
+				after[i].push_back(j);
+				num_before[j]++;
+			}
+		}
+	}
+
+	// Topological sort; always take the earliest Section that is ready.
+	std::vector<size_t> order;
+	std::vector<bool> done(nsect, false);
+	while (order.size() < nsect)
+	{
+		size_t next = nsect;
+		for (size_t i = 0; i < nsect; i++)
+			if (not done[i] and 0 == num_before[i]) { next = i; break; }
+
+		if (nsect == next)
+			throw RuntimeException(TRACE_INFO,
+				"The graph of Sections has a cycle in it!\n");
+
+		done[next] = true;
+		order.push_back(next);
+		for (size_t j : after[next])
+			num_before[j]--;
+	}
+
+	// Create all of the jobs before dispatching any of them, so that
+	// the graph is complete before the first job can finish.
+	JobGraphPtr graph = std::make_shared<JobGraph>();
+	graph->pending = nsect;
+
+	std::vector<OpenclJobValuePtr> jobs(nsect);
+	ValueSeq sinks;
+	for (size_t i = 0; i < nsect; i++)
+	{
+		jobs[i] = make_job(sects[i]);
+		jobs[i]->_graph = graph;
+		if (is_sink[i]) sinks.push_back(jobs[i]);
+	}
+	graph->sinks = createLinkValue(std::move(sinks));
+
+	for (size_t i : order)
+		dispatch(jobs[i]);
+}
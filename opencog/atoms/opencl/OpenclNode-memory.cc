@@ -0,0 +1,315 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-memory.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cstdint>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/Logger.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/opencl/types/atom_types.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Device-resident vectors.
+//
+// Vectors can stay on the device for as long as they're needed; they
+// are passed from one job to the next by putting them in the
+// AtomSpace, e.g. with
+//    (SetValue (Anchor "layer") (Predicate "hidden") vec)
+// and naming them, in the Sections of later jobs, with
+//    (ValueOf (Anchor "layer") (Predicate "hidden"))
+// This never downloads them. They are downloaded only when someone
+// looks at the numbers, and vectors that start out as zeros don't
+// even have a host copy until then.
+//
+// When device memory runs short, vectors can be moved back to the
+// host, with
+//    (SetValue clnode (Predicate "*-evict-*") vec)
+// The vector can be used just as before; it's uploaded again, the
+// next time that a job uses it.
+
+/// Move the vector, or the list of vectors, off the device. This
+/// waits for a turn, just like the dispatch threads do, so that jobs
+/// written before this use the buffer, and jobs written after this
+/// get a new one.
+void OpenclNode::evict_value(const ValuePtr& vp)
+{
+	std::vector<OpenclFloatValuePtr> vecs;
+	if (vp->is_type(OPENCL_DATA_VALUE))
+		vecs.push_back(OpenclFloatValueCast(vp));
+	else if (vp->is_type(LINK_VALUE))
+	{
+		for (const ValuePtr& v : LinkValueCast(vp)->value())
+			if (v->is_type(OPENCL_DATA_VALUE))
+				vecs.push_back(OpenclFloatValueCast(v));
+	}
+	else
+		throw RuntimeException(TRACE_INFO,
+			"Expecting an OpenclFloatValue to evict, got %s\n",
+			vp->to_string().c_str());
+
+	if (_native) return;
+
+	size_t ticket;
+	{
+		std::lock_guard<std::mutex> lck(_ticket_mtx);
+		ticket = _next_ticket++;
+	}
+	wait_turn(ticket);
+	try
+	{
+		flush_merge();
+		for (const OpenclFloatValuePtr& ofv : vecs)
+		{
+			ofv->evict();
+			std::lock_guard<std::mutex> lck(_mem_mtx);
+			touch_resident(ofv);
+		}
+	}
+	catch (...)
+	{
+		end_turn();
+		throw;
+	}
+	end_turn();
+}
+
+// ==============================================================
+// Memory budget.
+//
+// Nothing stops a long-running program from creating vectors until
+// the device runs out of memory, and then some allocation fails, in
+// some job that has nothing to do with it. So instead, the vectors
+// used by jobs are tracked here, in order of last use. When they take
+// up more than the budget, the ones used longest ago are evicted, as
+// above. Nothing has to be done to get them back; the next job to use
+// one uploads it again.
+//
+// The spilling is done in submit_job(), in turn, so it is safe in
+// the same way that evict_value() is. Vectors that are part of a
+// batch, and zero-copy vectors, are not tracked; evicting them would
+// not free anything.
+
+/// The default budget is three quarters of the memory of the smallest
+/// device; the driver and other programs need some, too.
+void OpenclNode::find_budget(void)
+{
+	if (0 < _mem_budget) return;
+
+	size_t least = SIZE_MAX;
+	for (const cl::Device& dev : _devices)
+		least = std::min(least,
+			(size_t) dev.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>());
+	_mem_budget = (least / 4) * 3;
+}
+
+/// Bytes of device memory held by the vector itself.
+size_t OpenclNode::device_bytes(const OpenclFloatValuePtr& ofv)
+{
+	if (not ofv->_have_buff or ofv->_zero_copy or nullptr != ofv->_parent())
+		return 0;
+	if (ofv->_svm_ptr) return ofv->reserve_size();
+	return ofv->_bucket;
+}
+
+/// Called when a vector is destroyed. It is taken off the list
+/// later, by prune_resident().
+void OpenclNode::forget_resident(const OpenclDataValue* dv)
+{
+	std::lock_guard<std::mutex> lck(_dead_mtx);
+	_mem_dead.push_back(dv);
+}
+
+/// Take the vectors that are gone off the list. The address might
+/// already be that of a new vector, made in the same place; such
+/// entries are left alone. Must be called with `_mem_mtx` held.
+void OpenclNode::prune_resident(void)
+{
+	std::vector<const OpenclDataValue*> dead;
+	{
+		std::lock_guard<std::mutex> lck(_dead_mtx);
+		dead.swap(_mem_dead);
+	}
+	for (const OpenclDataValue* dv : dead)
+	{
+		auto it = _resident_at.find(dv);
+		if (_resident_at.end() == it or not it->second->vec.expired())
+			continue;
+		_mem_resident -= it->second->bytes;
+		_resident.erase(it->second);
+		_resident_at.erase(it);
+	}
+}
+
+/// Move the vector to the front of the list. Must be called with
+/// `_mem_mtx` held.
+void OpenclNode::touch_resident(const OpenclFloatValuePtr& ofv)
+{
+	size_t bytes = device_bytes(ofv);
+	auto it = _resident_at.find(ofv.get());
+	if (_resident_at.end() == it)
+	{
+		if (0 == bytes) return;
+		_resident.push_front(Resident{ofv.get(), ofv, bytes, false});
+		_resident_at[ofv.get()] = _resident.begin();
+		_mem_resident += bytes;
+		return;
+	}
+
+	// The address might be that of a vector that's gone, and this is
+	// a new one, made in the same place.
+	Resident& res = *it->second;
+	if (res.vec.expired())
+	{
+		res.vec = ofv;
+		res.spilled = false;
+	}
+	else if (res.spilled and 0 < bytes)
+	{
+		res.spilled = false;
+		_mem_refills ++;
+	}
+
+	_mem_resident -= res.bytes;
+	res.bytes = bytes;
+	_mem_resident += bytes;
+	_resident.splice(_resident.begin(), _resident, it->second);
+}
+
+/// Note that the vectors for this job are used, and make room, if
+/// needed. Called from submit_job(), in turn.
+void OpenclNode::keep_resident(const ValuePtr& vp)
+{
+	std::vector<OpenclFloatValuePtr> vecs;
+	if (vp->is_type(OPENCL_JOB_VALUE))
+	{
+		for (const ValuePtr& v : OpenclJobValueCast(vp)->_args)
+			if (v->is_type(OPENCL_DATA_VALUE))
+				vecs.push_back(OpenclFloatValueCast(v));
+	}
+	else if (vp->is_type(OPENCL_DATA_VALUE))
+		vecs.push_back(OpenclFloatValueCast(vp));
+
+	std::lock_guard<std::mutex> lck(_mem_mtx);
+	prune_resident();
+	std::set<const OpenclDataValue*> keep;
+	for (const OpenclFloatValuePtr& ofv : vecs)
+	{
+		touch_resident(ofv);
+		keep.insert(ofv.get());
+	}
+
+	size_t idle;
+	{
+		std::lock_guard<std::mutex> plck(_pool_mtx);
+		idle = _pool_bytes_idle;
+	}
+	if (_mem_resident + idle <= _mem_budget) return;
+
+	// Letting go of idle pool buffers might be enough.
+	if (_mem_resident <= _mem_budget)
+	{
+		clear_pool();
+		return;
+	}
+	spill(keep);
+}
+
+/// Evict vectors, starting with the one used longest ago, until the
+/// rest fit in the budget. The vectors in `keep` are not evicted.
+/// Must be called with `_mem_mtx` held.
+void OpenclNode::spill(const std::set<const OpenclDataValue*>& keep)
+{
+	// First, forget the vectors that are gone, or were evicted by
+	// someone else, or were resized; this might be enough.
+	for (auto it = _resident.begin(); it != _resident.end(); )
+	{
+		OpenclFloatValuePtr ofv = it->vec.lock();
+		size_t bytes = ofv ? device_bytes(ofv) : 0;
+		_mem_resident -= it->bytes;
+		it->bytes = bytes;
+		_mem_resident += bytes;
+
+		if (nullptr == ofv)
+		{
+			_resident_at.erase(it->key);
+			it = _resident.erase(it);
+		}
+		else
+			it++;
+	}
+
+	size_t evicted = 0;
+	auto it = _resident.end();
+	while (_mem_budget < _mem_resident and it != _resident.begin())
+	{
+		it--;
+		if (0 == it->bytes) continue;
+		OpenclFloatValuePtr ofv = it->vec.lock();
+		if (keep.end() != keep.find(ofv.get())) continue;
+
+		ofv->evict();
+		evicted ++;
+		_mem_spills ++;
+		_mem_spilled_bytes += it->bytes;
+		_mem_resident -= it->bytes;
+		it->bytes = 0;
+		it->spilled = true;
+	}
+
+	if (_mem_budget < _mem_resident)
+		logger().info("OpenclNode: %zu bytes in use, over the budget of %zu\n",
+			_mem_resident, _mem_budget);
+
+	// Evicted buffers went back to the pool; let them go for real.
+	// The pool is left alone if nothing was evicted; that happens when
+	// a job's own vectors are more than the budget.
+	if (0 < evicted) clear_pool();
+}
+
+/// Report memory use, as a FloatValue of
+/// (budget, bytes resident, vectors resident,
+///  spills, bytes spilled, vectors uploaded again).
+ValuePtr OpenclNode::memory_stats(void) const
+{
+	std::lock_guard<std::mutex> lck(_mem_mtx);
+	size_t count = 0;
+	size_t bytes = 0;
+	for (const Resident& res : _resident)
+	{
+		if (0 == res.bytes or res.vec.expired()) continue;
+		count++;
+		bytes += res.bytes;
+	}
+
+	return createFloatValue(std::vector<double>{
+		(double) _mem_budget,
+		(double) bytes,
+		(double) count,
+		(double) _mem_spills,
+		(double) _mem_spilled_bytes,
+		(double) _mem_refills});
+}
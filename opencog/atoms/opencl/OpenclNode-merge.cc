@@ -0,0 +1,461 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-merge.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/util/Logger.h>
+#include <opencog/atoms/core/NumberNode.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Merged launches.
+//
+// Launching a kernel costs some microseconds, no matter how little
+// work it does; for jobs on a few hundred elements, that is most of
+// the time taken. With the URL option `merge=N`, such jobs are held
+// back as they come up for dispatch, and up to N of them, for the same
+// kernel, are run as one launch. The vectors of all of the jobs are
+// laid end to end on the host, sent in one upload per argument, run in
+// one launch, and read back in one download; the results are then
+// copied out to the vectors of each job, and the jobs are reported, in
+// order, as if each had run alone.
+//
+// A kernel that never exits, and polls a work queue on the device,
+// would cost even less per job, but OpenCL does not promise that such
+// a kernel sees the writes made by the host while it runs, and it
+// ties up the device. Merging gets most of the gain, without either.
+//
+// As with splitting, this assumes that work-item `i` only touches
+// element `i`, and that the only scalar is the vector length, which
+// is replaced by the total length. Reductions, matrix jobs, graphs,
+// streams, jobs that are read asynchronously, and jobs on kernels with
+// any other scalar are never merged. Neither are jobs on
+// vectors that have newer data on the device than on the host, since
+// the merged copy is made from the host data, nor jobs that use what
+// an earlier job in the same launch writes. The jobs held back are
+// launched when the next job does not go with them, when anything
+// other than a job is written, and when no one else is waiting for a
+// turn to dispatch; a job is never kept waiting for others that might
+// not come. The URL option `merge-len` caps the number of elements in
+// one launch.
+
+/// The jobs held back, and, once launched, the host copies of their
+/// vectors, and the buffers these were sent in.
+struct OpenclNode::MergeGroup
+{
+	OpenclNode* node;
+	std::string kname;
+	size_t dev;
+
+	// Per kernel argument: the element size, or zero for scalars, and
+	// whether it is an output.
+	std::vector<size_t> esz;
+	std::vector<bool> is_out;
+
+	// The jobs, where each one starts, in elements, and the total.
+	std::vector<OpenclJobValuePtr> jobs;
+	std::vector<size_t> offset;
+	size_t total;
+
+	// The vectors used by the jobs, and the ones written by them.
+	std::set<const OpenclDataValue*> used;
+	std::set<const OpenclDataValue*> written;
+
+	std::vector<std::vector<char>> host;
+	std::vector<cl::Buffer> bufs;
+	std::vector<size_t> buckets;
+	std::vector<size_t> gens;
+
+	// Signalled once the results are copied out; the outputs wait on
+	// this, instead of on a command.
+	cl::UserEvent scattered;
+};
+
+/// Can the job be merged with others?
+bool OpenclNode::can_merge(const OpenclJobValuePtr& ojv) const
+{
+	if (_merge_max < 2) return false;
+	if (ojv->_nd or ojv->_reduction or ojv->_graph or ojv->_feed or
+	    ojv->_read_async or 0 < ojv->_local_size) return false;
+	if (0 == ojv->_dim or _merge_len < ojv->_dim) return false;
+
+	// The merged launch passes the total length in place of each job's
+	// own length. Kernels with any other scalar can't be merged.
+	size_t nscalars = 0;
+	for (const ValuePtr& v : ojv->_args)
+	{
+		if (v->is_type(OPENCL_DATA_VALUE)) continue;
+		if (not v->is_type(CONNECTOR)) return false;
+		const Handle& num = HandleCast(v)->getOutgoingAtom(0);
+		if (not num->is_type(NUMBER_NODE) or
+		    ojv->_dim != (size_t) NumberNodeCast(num)->get_value())
+			return false;
+		nscalars++;
+	}
+	if (1 != nscalars) return false;
+
+	for (const ValuePtr& v : ojv->_args)
+	{
+		if (not v->is_type(OPENCL_DATA_VALUE)) continue;
+		OpenclFloatValuePtr ofv = OpenclFloatValueCast(v);
+		if (0 < ofv->_merge_busy or ofv->host_is_stale() or
+		    ofv->length() < ojv->_dim)
+			return false;
+	}
+	return true;
+}
+
+/// Hold the job back, to be launched together with the next few.
+/// Returns false if it is to be launched on its own.
+bool OpenclNode::merge_job(const OpenclJobValuePtr& ojv)
+{
+	if (not can_merge(ojv))
+	{
+		flush_merge();
+		return false;
+	}
+
+	size_t nargs = ojv->_args.size();
+	std::vector<size_t> esz(nargs, 0);
+	std::vector<bool> is_out(nargs, false);
+	for (size_t pos = 0; pos < nargs; pos++)
+		if (ojv->_args[pos]->is_type(OPENCL_DATA_VALUE))
+			esz[pos] = OpenclFloatValueCast(ojv->_args[pos])->elem_size();
+	for (size_t pos : ojv->_out_pos)
+		is_out[pos] = true;
+
+	// Launch the jobs held back, if this one does not go with them.
+	if (_merging)
+	{
+		const MergeGroup& grp = *_merging;
+		bool fits = grp.kname == ojv->_kname and grp.esz == esz and
+			grp.is_out == is_out and grp.total + ojv->_dim <= _merge_len;
+		for (size_t pos = 0; fits and pos < nargs; pos++)
+		{
+			if (0 == esz[pos]) continue;
+			const OpenclDataValue* dv =
+				OpenclFloatValueCast(ojv->_args[pos]).get();
+			if (0 < grp.written.count(dv) or
+			    (is_out[pos] and 0 < grp.used.count(dv)))
+				fits = false;
+		}
+		if (not fits) flush_merge();
+	}
+
+	if (nullptr == _merging)
+	{
+		_merging = std::make_shared<MergeGroup>();
+		_merging->node = this;
+		_merging->kname = ojv->_kname;
+		_merging->dev = 0;
+		_merging->esz = esz;
+		_merging->is_out = is_out;
+		_merging->total = 0;
+	}
+
+	MergeGroup& grp = *_merging;
+	grp.jobs.push_back(ojv);
+	grp.offset.push_back(grp.total);
+	grp.total += ojv->_dim;
+	for (size_t pos = 0; pos < nargs; pos++)
+	{
+		if (0 == esz[pos]) continue;
+		const OpenclDataValue* dv =
+			OpenclFloatValueCast(ojv->_args[pos]).get();
+		grp.used.insert(dv);
+		if (is_out[pos]) grp.written.insert(dv);
+	}
+
+	if (_merge_max <= grp.jobs.size()) flush_merge();
+	return true;
+}
+
+/// At the end of a turn to dispatch: if no one is waiting for the
+/// next turn, there is nothing more to merge with, so launch now.
+void OpenclNode::end_merge_turn(size_t ticket)
+{
+	if (nullptr == _merging) return;
+	{
+		std::lock_guard<std::mutex> lck(_ticket_mtx);
+		if (ticket + 1 < _next_ticket) return;
+	}
+
+	try
+	{
+		flush_merge();
+	}
+	catch (const std::exception& ex)
+	{
+		logger().warn("OpenclNode: merged launch failed: %s\n", ex.what());
+	}
+}
+
+/// Launch the jobs held back, if any.
+void OpenclNode::flush_merge(void)
+{
+	std::shared_ptr<MergeGroup> grp;
+	grp.swap(_merging);
+	if (nullptr == grp) return;
+
+	// Nothing came along to merge with.
+	if (1 == grp->jobs.size())
+	{
+		launch_job(grp->jobs[0]);
+		return;
+	}
+
+	TraceSpan span(this, "merge");
+	size_t nargs = grp->esz.size();
+	grp->bufs.resize(nargs);
+	grp->buckets.assign(nargs, 0);
+	grp->gens.assign(nargs, 0);
+
+	bool have_slot = false;
+	bool marked = false;
+	try
+	{
+		launch_merged(grp, have_slot, marked);
+	}
+	catch (...)
+	{
+		// Don't leave anyone hanging: the outputs are given back, and
+		// the jobs are reported, as failed jobs are.
+		if (marked)
+		{
+			for (const OpenclJobValuePtr& ojv : grp->jobs)
+				for (size_t pos : ojv->_out_pos)
+					OpenclFloatValueCast(ojv->_args[pos])->_merge_busy --;
+			grp->scattered.setStatus(CL_COMPLETE);
+		}
+		for (size_t pos = 0; pos < nargs; pos++)
+			if (nullptr != grp->bufs[pos]())
+				free_buffer(grp->bufs[pos], grp->buckets[pos], grp->gens[pos],
+					cl::Event());
+		for (const OpenclJobValuePtr& ojv : grp->jobs)
+			report(ojv);
+		if (have_slot) release_slot();
+		throw;
+	}
+}
+
+/// The body of flush_merge(). Once the completion callback is set, it
+/// owns the slot and the buffers; nothing after that may throw.
+void OpenclNode::launch_merged(const std::shared_ptr<MergeGroup>& grp,
+                               bool& have_slot, bool& marked)
+{
+	size_t nargs = grp->esz.size();
+
+	// Lay the vectors end to end. The launch must wait for whatever
+	// the device is still doing with any of them; the results are
+	// copied over the outputs when it's done.
+	std::vector<cl::Event> deps;
+	grp->host.resize(nargs);
+	for (size_t pos = 0; pos < nargs; pos++)
+	{
+		size_t esz = grp->esz[pos];
+		if (0 == esz) continue;
+		grp->host[pos].resize(grp->total * esz);
+		for (size_t j = 0; j < grp->jobs.size(); j++)
+		{
+			const OpenclJobValuePtr& ojv = grp->jobs[j];
+			OpenclFloatValuePtr ofv = OpenclFloatValueCast(ojv->_args[pos]);
+			ofv->materialize();
+			ofv->pack();
+			memcpy(grp->host[pos].data() + grp->offset[j] * esz,
+				ofv->data(), ojv->_dim * esz);
+			ofv->add_dependency(deps);
+		}
+	}
+
+	size_t lane = next_lane();
+	grp->dev = lane_device(lane);
+	cl::CommandQueue& queue = get_queue(lane);
+	{
+		TraceSpan span(this, "wait-slot");
+		acquire_slot();
+		have_slot = true;
+	}
+
+	// The only scalar is the length; see can_merge().
+	cl::Kernel kern = borrow_kernel(grp->kname);
+	std::vector<cl::Event> sent;
+	try
+	{
+		for (size_t pos = 0; pos < nargs; pos++)
+		{
+			size_t esz = grp->esz[pos];
+			if (0 == esz)
+			{
+				kern.setArg(pos, (cl_ulong) grp->total);
+				continue;
+			}
+
+			cl::Event last;
+			grp->bufs[pos] = alloc_buffer(grp->total * esz,
+				grp->buckets[pos], grp->gens[pos], last);
+			std::vector<cl::Event> wait = deps;
+			if (nullptr != last()) wait.push_back(last);
+
+			cl::Event ev;
+			queue.enqueueWriteBuffer(grp->bufs[pos], CL_FALSE, 0,
+				grp->total * esz, grp->host[pos].data(), &wait, &ev);
+			sent.push_back(ev);
+			kern.setArg(pos, grp->bufs[pos]);
+		}
+	}
+	catch (...)
+	{
+		return_kernel(grp->kname, kern);
+		throw;
+	}
+
+	cl::Event run;
+	try
+	{
+		queue.enqueueNDRangeKernel(kern, cl::NullRange,
+			cl::NDRange(grp->total), cl::NullRange, &sent, &run);
+	}
+	catch (...)
+	{
+		return_kernel(grp->kname, kern);
+		throw;
+	}
+	return_kernel(grp->kname, kern);
+
+	std::vector<cl::Event> after{run};
+	std::vector<cl::Event> read;
+	for (size_t pos = 0; pos < nargs; pos++)
+	{
+		if (not grp->is_out[pos]) continue;
+		cl::Event ev;
+		queue.enqueueReadBuffer(grp->bufs[pos], CL_FALSE, 0,
+			grp->total * grp->esz[pos], grp->host[pos].data(),
+			&after, &ev);
+		read.push_back(ev);
+	}
+	cl::Event done = run;
+	if (1 == read.size()) done = read[0];
+	else if (1 < read.size())
+		queue.enqueueMarkerWithWaitList(&read, &done);
+
+	if (_profile)
+	{
+		size_t bytes = 0;
+		double flops = 0.0;
+		for (const OpenclJobValuePtr& ojv : grp->jobs)
+		{
+			bytes += ojv->bytes_moved();
+			flops += ojv->flops();
+		}
+		profile(grp->kname, run, bytes, flops);
+	}
+
+	// Until the results are copied out, the outputs are busy.
+	grp->scattered = cl::UserEvent(_context);
+	for (const OpenclJobValuePtr& ojv : grp->jobs)
+	{
+		ojv->_pending_uploads.clear();
+		for (size_t pos : ojv->_out_pos)
+		{
+			OpenclFloatValuePtr ofv =
+				OpenclFloatValueCast(ojv->_args[pos]);
+			ofv->_merge_busy ++;
+			ofv->mark_host_dirty();
+			ofv->set_last_event(grp->scattered);
+		}
+	}
+	marked = true;
+
+	{
+		std::lock_guard<std::mutex> lck(_inflight_mtx);
+		_dev_load[grp->dev] ++;
+	}
+	std::shared_ptr<MergeGroup>* gp = new std::shared_ptr<MergeGroup>(grp);
+	try
+	{
+		done.setCallback(CL_COMPLETE, merge_done, gp);
+	}
+	catch (...)
+	{
+		delete gp;
+		std::lock_guard<std::mutex> lck(_inflight_mtx);
+		_dev_load[grp->dev] --;
+		throw;
+	}
+
+	// The callback may already have run; a failed flush is harmless.
+	try { queue.flush(); } catch (const cl::Error&) {}
+}
+
+/// Called when the merged launch is done, and its results are back
+/// on the host. These are copied out to the vectors of each job.
+void CL_CALLBACK OpenclNode::merge_done(cl_event ev, cl_int status,
+                                        void* data)
+{
+	std::shared_ptr<MergeGroup>* gp = (std::shared_ptr<MergeGroup>*) data;
+	MergeGroup& grp = **gp;
+	OpenclNode* onp = grp.node;
+	{
+		std::lock_guard<std::mutex> lck(onp->_inflight_mtx);
+		onp->_dev_load[grp.dev] --;
+	}
+	if (CL_COMPLETE != status)
+		logger().warn("OpenclNode: merged jobs failed with status %d\n",
+			status);
+
+	for (size_t j = 0; j < grp.jobs.size(); j++)
+	{
+		const OpenclJobValuePtr& ojv = grp.jobs[j];
+		for (size_t pos : ojv->_out_pos)
+		{
+			OpenclFloatValuePtr ofv = OpenclFloatValueCast(ojv->_args[pos]);
+			size_t esz = grp.esz[pos];
+			if (CL_COMPLETE == status)
+			{
+				memcpy(ofv->data(),
+					grp.host[pos].data() + grp.offset[j] * esz,
+					ojv->_dim * esz);
+				ofv->unpack_range(0, ojv->_dim);
+			}
+			ofv->_merge_busy --;
+		}
+	}
+	grp.scattered.setStatus(CL_COMPLETE);
+
+	cl::Event last(ev, true);
+	for (size_t pos = 0; pos < grp.bufs.size(); pos++)
+		if (nullptr != grp.bufs[pos]())
+			onp->free_buffer(grp.bufs[pos], grp.buckets[pos],
+				grp.gens[pos], last);
+	if (onp->_profile)
+		onp->harvest_profile();
+
+	for (const OpenclJobValuePtr& ojv : grp.jobs)
+		onp->report(ojv);
+	delete gp;
+
+	onp->release_slot();
+}
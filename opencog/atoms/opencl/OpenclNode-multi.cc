@@ -0,0 +1,111 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-multi.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/Logger.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Several devices.
+//
+// An OpenclNode can own several devices, all in one context, so that
+// the buffers are usable on all of them. Jobs are not tied to a
+// device; each goes to whichever device has the least outstanding on
+// it, compared to its size. The size of a device is taken to be the
+// number of compute units times the clock rate. This is crude, as
+// compute units are not the same from vendor to vendor, but it is
+// enough to keep all of the devices busy.
+//
+// Long element-wise jobs are split by range, one part for each lane,
+// with the parts sized in proportion to the devices the lanes are on.
+// With one device and several lanes, the parts run side by side on
+// that one device. Each part gets
+// sub-buffers of the vectors, so that the stock kernels work unchanged:
+// to them, the part is a whole, shorter vector. This assumes that
+// work-item `i` only touches element `i`, which is the case for all
+// of the kernels shipped here, and all of the fused kernels. The URL
+// option `split=0` turns splitting off, for programs where this is
+// not so. Reductions are never split.
+
+/// Measure the devices.
+void OpenclNode::find_weights(void)
+{
+	std::lock_guard<std::mutex> lck(_inflight_mtx);
+	_dev_load.assign(_devices.size(), 0);
+	_dev_weight.clear();
+	for (const cl::Device& dev : _devices)
+	{
+		size_t cus = dev.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>();
+		size_t mhz = dev.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY>();
+		size_t wgt = cus * mhz;
+		_dev_weight.push_back(0 < wgt ? wgt : 1);
+	}
+}
+
+/// The lane to use for the next job: one on the least-loaded device.
+size_t OpenclNode::next_lane(void)
+{
+	size_t ndev = _devices.size();
+	if (ndev <= 1) return _next_lane++ % _num_lanes;
+
+	size_t best = 0;
+	{
+		std::lock_guard<std::mutex> lck(_inflight_mtx);
+		for (size_t d = 1; d < ndev; d++)
+			if (_dev_load[d] * _dev_weight[best] <
+			    _dev_load[best] * _dev_weight[d])
+				best = d;
+	}
+	return device_lane(best);
+}
+
+/// Cut the range [0, dim) into one part per lane, as (start, count)
+/// pairs. The parts start on element boundaries that suit the buffer
+/// alignment of all the devices, for elements as small as two bytes.
+/// Some parts might be empty.
+std::vector<std::pair<size_t, size_t>> OpenclNode::split_range(size_t dim)
+{
+	size_t grain = std::max((size_t) 1, _base_align / 2);
+	size_t total = 0;
+	for (size_t l = 0; l < _num_lanes; l++)
+		total += _dev_weight[lane_device(l)];
+
+	std::vector<std::pair<size_t, size_t>> parts;
+	size_t start = 0;
+	size_t sofar = 0;
+	for (size_t l = 0; l < _num_lanes; l++)
+	{
+		sofar += _dev_weight[lane_device(l)];
+		size_t end = dim;
+		if (l + 1 < _num_lanes)
+		{
+			end = (size_t) (((double) dim) * sofar / total);
+			end = (end / grain) * grain;
+			if (end < start) end = start;
+		}
+		parts.push_back({start, end - start});
+		start = end;
+	}
+	return parts;
+}
@@ -0,0 +1,236 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-pool.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/Logger.h>
+#include <opencog/atoms/value/FloatValue.h>
+
+#include "OpenclNode.h"
+#include "Reductions.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Device buffer pool.
+//
+// Streaming workloads create and destroy vectors at a high rate;
+// every job input is a fresh OpenclFloatValue. Creating and releasing
+// a cl::Buffer for each of these is a round trip to the driver,
+// and for small vectors, this costs more than the actual data
+// transfer. So instead, buffers are recycled here.
+//
+// Buffers are bucketed by size. The bucket sizes are 1, 1.25, 1.5
+// and 1.75 times a power of two, so that no more than a quarter of
+// a buffer is ever wasted. A handed-out buffer may thus be larger
+// than what was asked for; this is harmless, as all transfers and
+// kernels work with the actual vector length.
+
+/// Round up to the nearest bucket size.
+size_t OpenclNode::bucket_size(size_t nbytes)
+{
+	const size_t smallest = 256;
+	if (nbytes <= smallest) return smallest;
+
+	size_t pow = smallest;
+	while (2*pow < nbytes) pow *= 2;
+
+	// Now pow < nbytes <= 2*pow
+	size_t step = pow / 4;
+	return ((nbytes + step - 1) / step) * step;
+}
+
+/// Get a buffer that can hold at least `nbytes`. The bucket size is
+/// returned in `bucket`, and the pool generation in `gen`; both must
+/// be passed back to free_buffer().
+/// If the buffer was recycled, `last` is set to the last command that
+/// used it; the new owner must wait for it before using the buffer.
+cl::Buffer OpenclNode::alloc_buffer(size_t nbytes, size_t& bucket,
+                                    size_t& gen, cl::Event& last)
+{
+	bucket = bucket_size(nbytes);
+	{
+		std::lock_guard<std::mutex> lck(_pool_mtx);
+		_pool_bytes_used += bucket;
+		gen = _pool_gen;
+
+		auto it = _buffer_pool.find(bucket);
+		if (_buffer_pool.end() != it and 0 < it->second.size())
+		{
+			PoolEntry ent = it->second.back();
+			it->second.pop_back();
+			_pool_bytes_idle -= bucket;
+			_pool_hits ++;
+			last = ent.last;
+			return ent.buf;
+		}
+		_pool_misses ++;
+	}
+
+	last = cl::Event();
+	try
+	{
+		return cl::Buffer(_context, CL_MEM_READ_WRITE, bucket);
+	}
+	catch (const cl::Error& e)
+	{
+		if (CL_MEM_OBJECT_ALLOCATION_FAILURE != e.err() and
+		    CL_OUT_OF_RESOURCES != e.err())
+			throw;
+	}
+
+	// Out of device memory. The idle buffers are taking up some of it;
+	// let them go, and try again.
+	clear_pool();
+	return cl::Buffer(_context, CL_MEM_READ_WRITE, bucket);
+}
+
+/// Return a buffer to the pool. If the pool is already holding too
+/// much, or the buffer is from a context since closed, the buffer is
+/// released instead.
+void OpenclNode::free_buffer(const cl::Buffer& buf, size_t bucket,
+                             size_t gen, const cl::Event& last)
+{
+	std::lock_guard<std::mutex> lck(_pool_mtx);
+	_pool_bytes_used -= bucket;
+
+	if (gen != _pool_gen) return;
+	if (_pool_max_idle < _pool_bytes_idle + bucket)
+		return;
+
+	_buffer_pool[bucket].emplace_back(PoolEntry{buf, last, gen});
+	_pool_bytes_idle += bucket;
+}
+
+/// Release all idle buffers.
+void OpenclNode::clear_pool(void)
+{
+	std::lock_guard<std::mutex> lck(_pool_mtx);
+	_buffer_pool.clear();
+	_pool_bytes_idle = 0;
+}
+
+/// Report pool statistics, as a FloatValue of
+/// (hits, misses, bytes in use, bytes idle).
+ValuePtr OpenclNode::pool_stats(void) const
+{
+	std::lock_guard<std::mutex> lck(_pool_mtx);
+	return createFloatValue(std::vector<double>{
+		(double) _pool_hits,
+		(double) _pool_misses,
+		(double) _pool_bytes_used,
+		(double) _pool_bytes_idle});
+}
+
+// ==============================================================
+// Kernel pool.
+//
+// Creating a cl::Kernel is a trip to the driver, and it was being
+// done for every job. The kernels are now created up front, as soon
+// as the program is built, one set per lane, so that each of the
+// dispatch threads can have one without waiting. If more are needed,
+// because many jobs are in the works, they are created on demand, and
+// then kept for later, up to KERNEL_POOL_MAX of each.
+//
+// Kernels belong to the program they were made from. A job might still
+// hold a kernel after the node is closed and opened again, with a new
+// program; such kernels are not put back in the pool.
+
+#define KERNEL_POOL_MAX 16
+
+/// Create kernels for everything in the program.
+void OpenclNode::fill_kernel_pool(void)
+{
+	std::lock_guard<std::mutex> lck(_kernel_mtx);
+	_kernel_pool.clear();
+	try
+	{
+		for (size_t i = 0; i < _num_lanes; i++)
+		{
+			std::vector<cl::Kernel> kerns;
+			_program.createKernels(&kerns);
+			for (const cl::Kernel& k : kerns)
+				_kernel_pool[k.getInfo<CL_KERNEL_FUNCTION_NAME>()].push_back(k);
+		}
+	}
+	catch (const cl::Error& e)
+	{
+		// Not fatal; the kernels will be created as needed.
+		logger().info("OpenclNode: unable to pre-create kernels: %s (%d)\n",
+			e.what(), e.err());
+	}
+}
+
+/// Get a kernel for the exclusive use of the caller, who must hand
+/// it back with return_kernel() when done with it.
+cl::Kernel OpenclNode::borrow_kernel(const std::string& kname)
+{
+	{
+		std::lock_guard<std::mutex> lck(_kernel_mtx);
+		auto it = _kernel_pool.find(kname);
+		if (_kernel_pool.end() != it and 0 < it->second.size())
+		{
+			cl::Kernel kern = it->second.back();
+			it->second.pop_back();
+			_kernel_lent[kern()] = _kernel_gen;
+			return kern;
+		}
+	}
+
+	cl::Kernel kern = make_kernel(kname);
+	std::lock_guard<std::mutex> lck(_kernel_mtx);
+	_kernel_lent[kern()] = _kernel_gen;
+	return kern;
+}
+
+/// Create a new kernel, from whichever program has it.
+cl::Kernel OpenclNode::make_kernel(const std::string& kname)
+{
+	{
+		std::lock_guard<std::mutex> lck(_fused_mtx);
+		auto it = _fused_progs.find(kname);
+		if (_fused_progs.end() != it)
+			return cl::Kernel(it->second, kname.c_str());
+	}
+
+	if (is_reduction_kernel(kname))
+	{
+		build_library();
+		return cl::Kernel(_lib_program, kname.c_str());
+	}
+	return cl::Kernel(_program, kname.c_str());
+}
+
+/// Take back a kernel lent out by borrow_kernel(). Kernels from before
+/// the last close(), and kernels beyond KERNEL_POOL_MAX, are let go.
+void OpenclNode::return_kernel(const std::string& kname,
+                               const cl::Kernel& kern)
+{
+	std::lock_guard<std::mutex> lck(_kernel_mtx);
+	auto it = _kernel_lent.find(kern());
+	if (_kernel_lent.end() == it) return;
+	bool stale = (it->second != _kernel_gen);
+	_kernel_lent.erase(it);
+	if (stale) return;
+
+	std::vector<cl::Kernel>& kerns = _kernel_pool[kname];
+	if (KERNEL_POOL_MAX <= kerns.size()) return;
+	kerns.push_back(kern);
+}
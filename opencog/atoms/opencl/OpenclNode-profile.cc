@@ -0,0 +1,217 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-profile.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Profiling.
+//
+// With the `profile` URL option, the command queues are created with
+// CL_QUEUE_PROFILING_ENABLE, and the device records when each command
+// was queued, submitted, started and ended. The event of each upload,
+// kernel launch and download is put aside when it is enqueued; once
+// the command is done, the times are read off, and added to the
+// entry for the kernel, or for "*-upload-*" or "*-download-*". This
+// is done as jobs finish, in job_done(), and when the stats are asked
+// for; nothing ever waits for an event here. The cost is a lock and
+// a few calls to the driver per command, and so this can be left on.
+//
+// Each entry keeps a histogram of the run times, with four buckets
+// for each power of two nanoseconds, so the percentiles are good to
+// within about 20%.
+
+static constexpr size_t HIST_BUCKETS = 256;
+static constexpr size_t MAX_PENDING = 1024;
+
+static size_t hist_bucket(cl_ulong ns)
+{
+	if (ns < 4) return ns;
+	size_t msb = 63 - __builtin_clzll(ns);
+	return 4*msb + ((ns >> (msb-2)) & 3);
+}
+
+/// The middle of the bucket, in nanoseconds.
+static double bucket_ns(size_t idx)
+{
+	if (idx < 4) return (double) idx;
+	size_t msb = idx / 4;
+	double lo = (double) (((cl_ulong) (4 + idx % 4)) << (msb - 2));
+	double width = (double) (((cl_ulong) 1) << (msb - 2));
+	return lo + 0.5 * width;
+}
+
+/// Put the event aside, to be looked at once the command is done.
+void OpenclNode::profile(const std::string& key, const cl::Event& ev,
+                         size_t bytes, double flops)
+{
+	if (nullptr == ev()) return;
+
+	size_t npend;
+	{
+		std::lock_guard<std::mutex> lck(_prof_mtx);
+		_prof_pending.emplace_back(
+			ProfilePending{key, ev, bytes, flops, trace_now()});
+		npend = _prof_pending.size();
+	}
+
+	// Nothing has looked in a while; catch up.
+	if (MAX_PENDING < npend)
+		harvest_profile();
+}
+
+/// Add one sample. Times are in nanoseconds.
+void OpenclNode::add_sample(const std::string& key, double wait_ns,
+                            double run_ns, size_t bytes,
+                            double flops) const
+{
+	std::lock_guard<std::mutex> lck(_prof_mtx);
+	ProfileEntry& ent = _prof[key];
+	if (ent.hist.empty()) ent.hist.resize(HIST_BUCKETS, 0);
+	ent.count ++;
+	ent.hist[hist_bucket((cl_ulong) run_ns)] ++;
+	ent.wait_ns += wait_ns;
+	ent.run_ns += run_ns;
+	ent.bytes += (double) bytes;
+	ent.flops += flops;
+}
+
+/// Take the times off of the commands that are done. This must not
+/// block; it is called from event callbacks.
+void OpenclNode::harvest_profile(void) const
+{
+	std::vector<ProfilePending> done;
+	{
+		std::lock_guard<std::mutex> lck(_prof_mtx);
+		std::vector<ProfilePending> still;
+		for (ProfilePending& pp : _prof_pending)
+		{
+			cl_int status = CL_QUEUED;
+			clGetEventInfo(pp.ev(), CL_EVENT_COMMAND_EXECUTION_STATUS,
+				sizeof(status), &status, nullptr);
+			if (CL_COMPLETE == status)
+				done.emplace_back(std::move(pp));
+			else if (0 < status)
+				still.emplace_back(std::move(pp));
+		}
+		_prof_pending.swap(still);
+	}
+
+	for (const ProfilePending& pp : done)
+	{
+		cl_ulong queued = 0, submit = 0, start = 0, end = 0;
+		if (CL_SUCCESS != clGetEventProfilingInfo(pp.ev(),
+				CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr) or
+		    CL_SUCCESS != clGetEventProfilingInfo(pp.ev(),
+				CL_PROFILING_COMMAND_SUBMIT, sizeof(submit), &submit, nullptr) or
+		    CL_SUCCESS != clGetEventProfilingInfo(pp.ev(),
+				CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) or
+		    CL_SUCCESS != clGetEventProfilingInfo(pp.ev(),
+				CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr))
+			continue;
+
+		// Some drivers report zero for times they don't keep.
+		if (0 == queued) queued = (0 == submit) ? start : submit;
+		if (end < start or start < queued) continue;
+		add_sample(pp.key, (double) (start - queued),
+			(double) (end - start), pp.bytes, pp.flops);
+
+		// The device clock is not the host clock; the span is placed
+		// relative to when the command was enqueued.
+		if (0 < _trace_max)
+		{
+			uint32_t track = 1;
+			if (0 == pp.key.compare("*-upload-*")) track = 0;
+			else if (0 == pp.key.compare("*-download-*")) track = 2;
+			trace(pp.key, pp.host_ns + (start - queued),
+				pp.host_ns + (end - queued), NO_TICKET, true, track);
+		}
+	}
+}
+
+/// Forget everything measured so far.
+void OpenclNode::clear_profile(void)
+{
+	std::lock_guard<std::mutex> lck(_prof_mtx);
+	_prof.clear();
+}
+
+/// The time below which `frac` of the runs finished, in nanoseconds.
+static double percentile(const std::vector<size_t>& hist, size_t count,
+                         double frac)
+{
+	size_t want = (size_t) (frac * (double) count);
+	size_t seen = 0;
+	for (size_t i = 0; i < hist.size(); i++)
+	{
+		seen += hist[i];
+		if (want < seen) return bucket_ns(i);
+	}
+	return 0.0;
+}
+
+/// Report the profile, as a LinkValue holding, for each kernel, and
+/// for uploads and downloads, a LinkValue of the name, as a
+/// StringValue, and a FloatValue of
+///    (count, median, 90th and 99th percentile run time,
+///     mean run time, mean wait from queued to start,
+///     total bytes, GB/sec, GFLOP/sec)
+/// with the times in microseconds. The rates are over the run time
+/// only. GFLOP/sec is zero, unless the Section says how many flops
+/// each work-item does.
+ValuePtr OpenclNode::profile_stats(void) const
+{
+	if (not _profile)
+		throw RuntimeException(TRACE_INFO,
+			"Profiling is not enabled; use the `profile` URL option: %s\n",
+			get_name().c_str());
+
+	harvest_profile();
+
+	std::lock_guard<std::mutex> lck(_prof_mtx);
+	ValueSeq entries;
+	for (const auto& pr : _prof)
+	{
+		const ProfileEntry& ent = pr.second;
+		double n = (double) ent.count;
+		double run = (0.0 < ent.run_ns) ? ent.run_ns : 1.0;
+		entries.push_back(createLinkValue(ValueSeq{
+			createStringValue(pr.first),
+			createFloatValue(std::vector<double>{
+				n,
+				1.0e-3 * percentile(ent.hist, ent.count, 0.50),
+				1.0e-3 * percentile(ent.hist, ent.count, 0.90),
+				1.0e-3 * percentile(ent.hist, ent.count, 0.99),
+				1.0e-3 * ent.run_ns / n,
+				1.0e-3 * ent.wait_ns / n,
+				ent.bytes,
+				ent.bytes / run,
+				ent.flops / run})}));
+	}
+	return createLinkValue(entries);
+}
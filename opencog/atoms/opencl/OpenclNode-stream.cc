@@ -0,0 +1,190 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-stream.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/util/Logger.h>
+#include <opencog/util/concurrent_queue.h>
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/opencl/types/atom_types.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Streaming input.
+//
+// Sensor pipelines produce an endless series of vectors, and each of
+// these needs to go through the same kernel. Writing a Section for
+// each one, and waiting for the result, costs a full round trip to
+// the device per vector. Instead, a Section can name the stream
+// itself as one of its inputs, e.g.
+//
+//    (Section (Item "vec_mult")
+//       (ConnectorSeq
+//          (Number 0 0 0 0)
+//          (ValueOf (Anchor "sensor") (Predicate "queue"))
+//          (Number 2 2 2 2)))
+//
+// where the ValueOf gives a QueueValue, or else a StreamNode, which
+// is read with *-read-*. The Section is then run once for every item
+// that comes out of the stream, and the jobs are placed on the
+// QueueValue of the OpenclNode as they finish, the same as any other.
+//
+// The items are copied into a few staging vectors, used in rotation,
+// so that the upload of the next item overlaps the kernel working on
+// the current one, and the download of the one before. A staging
+// vector is reused only after the job using it is done. The feeding
+// stops when the stream ends, or when the OpenclNode is closed. On
+// close, a QueueValue being fed from is closed, too, so that a feeder
+// waiting on it is let go. A StreamNode can't be interrupted that way;
+// close() waits for its read to return.
+
+/// If the Section has a streaming input, start feeding it, and
+/// return true. Else return false; the Section is an ordinary job.
+bool OpenclNode::start_stream(const Handle& sect)
+{
+	const HandleSeq& args = sect->getOutgoingAtom(1)->getOutgoingSet();
+	for (const Handle& arg : args)
+	{
+		ValuePtr src;
+		if (arg->is_type(STREAM_NODE))
+			src = arg;
+		else if (arg->is_type(VALUE_OF_LINK))
+		{
+			ValuePtr vp = arg->execute();
+			if (vp and vp->is_type(QUEUE_VALUE))
+				src = vp;
+		}
+		if (nullptr == src) continue;
+
+		StreamFeedPtr feed = std::make_shared<StreamFeed>();
+		feed->sect = sect;
+		feed->from = arg;
+		feed->source = src;
+		feed->staging.resize(_stream_depth);
+		feed->busy.resize(_stream_depth, false);
+
+		std::lock_guard<std::mutex> lck(_stream_mtx);
+		_feeds.push_back(feed);
+		_feeders.emplace_back(&OpenclNode::feed_stream, this, feed);
+		return true;
+	}
+	return false;
+}
+
+/// Get the next item from the stream, or null, if there are no more.
+ValuePtr OpenclNode::next_chunk(const ValuePtr& src)
+{
+	if (src->is_type(QUEUE_VALUE))
+	{
+		try
+		{
+			return QueueValueCast(src)->remove();
+		}
+		catch (const concurrent_queue<ValuePtr>::Canceled&)
+		{
+			return nullptr;
+		}
+	}
+
+	Handle rdkey = getAtomSpace()->add_node(PREDICATE_NODE, "*-read-*");
+	return HandleCast(src)->getValue(rdkey);
+}
+
+/// The feeder thread. Streams that end with something other than a
+/// vector, such as an empty LinkValue, are done.
+void OpenclNode::feed_stream(const StreamFeedPtr& feed)
+{
+	size_t depth = feed->busy.size();
+	try
+	{
+		for (size_t k = 0; not feed->stop; k++)
+		{
+			ValuePtr chunk = next_chunk(feed->source);
+			if (nullptr == chunk or not (chunk->is_type(FLOAT_VALUE) or
+			                             chunk->is_type(NUMBER_NODE)))
+				break;
+
+			// Wait for the staging vector to come free.
+			size_t slot = k % depth;
+			{
+				std::unique_lock<std::mutex> lck(feed->mtx);
+				feed->cv.wait(lck, [&]
+					{ return not feed->busy[slot] or feed->stop; });
+				if (feed->stop) break;
+				feed->busy[slot] = true;
+			}
+
+			OpenclJobValuePtr job = make_job(feed->sect);
+			job->_feed = feed;
+			job->_slot = slot;
+			job->_chunk = chunk;
+			dispatch(job);
+		}
+	}
+	catch (const std::exception& ex)
+	{
+		logger().warn("OpenclNode: stream stopped: %s\n", ex.what());
+	}
+}
+
+/// The job is done with its staging vector.
+void OpenclNode::feed_done(const ValuePtr& vp)
+{
+	if (not vp->is_type(OPENCL_JOB_VALUE)) return;
+	OpenclJobValuePtr ojv = OpenclJobValueCast(vp);
+	if (nullptr == ojv->_feed) return;
+
+	std::lock_guard<std::mutex> lck(ojv->_feed->mtx);
+	ojv->_feed->busy[ojv->_slot] = false;
+	ojv->_feed->cv.notify_all();
+}
+
+/// Stop all of the feeders, and wait for them to finish. A feeder
+/// waiting on an empty QueueValue would never notice, so the queue is
+/// closed. If the last reference to this node was dropped by one of
+/// the feeders, then this runs in that feeder; it can't wait for
+/// itself, and is let go instead. It only looks at its own StreamFeed
+/// from then on, and so quits without touching this node.
+void OpenclNode::stop_streams(void)
+{
+	std::lock_guard<std::mutex> lck(_stream_mtx);
+	for (const StreamFeedPtr& feed : _feeds)
+	{
+		{
+			std::lock_guard<std::mutex> flck(feed->mtx);
+			feed->stop = true;
+			feed->cv.notify_all();
+		}
+		if (feed->source->is_type(QUEUE_VALUE))
+			QueueValueCast(feed->source)->close();
+	}
+	for (std::thread& thr : _feeders)
+	{
+		if (thr.get_id() == std::this_thread::get_id())
+			thr.detach();
+		else
+			thr.join();
+	}
+	_feeders.clear();
+	_feeds.clear();
+}
@@ -0,0 +1,204 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-trace.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#include <opencog/util/exceptions.h>
+#include <opencog/atoms/value/StringValue.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Tracing.
+//
+// The stats in OpenclNode-profile.cc say how long things take, but
+// not when; a stall in the pipeline, e.g. a dispatch thread waiting
+// for its turn while the device sits idle, shows up only on a
+// timeline. With the `trace=N` URL option, spans of time are recorded
+// here, for the host:
+//    enqueue    -- do_write() putting the job on the dispatch queue
+//    queued     -- from then, until a dispatch thread picks it up
+//    wait-open  -- waiting for the device to open; see open()
+//    prepare    -- building the job, or evaluating its arguments
+//    wait-turn  -- waiting for the jobs written earlier to be submitted
+//    submit     -- submitting the job, which is made up of
+//    wait-slot  -- waiting for room in the in-flight window
+//    upload     -- enqueueing the uploads
+//    launch     -- enqueueing the kernel
+//    publish    -- placing the finished job on the QueueValue
+// Each dispatch thread has its own track. For the device, there are
+// tracks for uploads, kernels and downloads, with the spans taken off
+// of the profiling events. The last N spans are kept in a ring.
+//
+// They're had with
+//    (ValueOf clnode (Predicate "*-trace-*"))
+// which gives a StringValue of Chrome trace JSON, or written to a
+// file, with
+//    (SetValue clnode (Predicate "*-trace-*") (StringValue "/tmp/x.json"))
+// Setting it to anything else empties the ring.
+
+/// Nanoseconds since the OpenclNode was made.
+uint64_t OpenclNode::trace_now(void) const
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - _trace_t0).count();
+}
+
+/// Record a span. Host spans go on the track of the calling thread;
+/// device spans go on the given track.
+void OpenclNode::trace(const std::string& name, uint64_t start,
+                       uint64_t end, size_t ticket, bool device,
+                       uint32_t track) const
+{
+	std::lock_guard<std::mutex> lck(_trace_mtx);
+	if (not device)
+	{
+		auto it = _trace_tids.find(std::this_thread::get_id());
+		if (_trace_tids.end() == it)
+			it = _trace_tids.emplace(std::this_thread::get_id(),
+				(uint32_t) _trace_tids.size()).first;
+		track = it->second;
+	}
+
+	TraceEvent evt{name, device, track, start,
+		(start < end) ? end - start : 0, ticket};
+	if (_trace_ring.size() < _trace_max)
+		_trace_ring.emplace_back(std::move(evt));
+	else
+		_trace_ring[_trace_next % _trace_max] = std::move(evt);
+	_trace_next ++;
+}
+
+OpenclNode::TraceSpan::TraceSpan(const OpenclNode* onp,
+                                 const char* what, size_t tkt) :
+	node(onp), name(what), ticket(tkt),
+	start((0 < onp->_trace_max) ? onp->trace_now() : 0)
+{
+}
+
+OpenclNode::TraceSpan::~TraceSpan()
+{
+	if (0 < node->_trace_max)
+		node->trace(name, start, node->trace_now(), ticket);
+}
+
+/// Kernel names are plain identifiers, but be careful anyway.
+static std::string json_escape(const std::string& str)
+{
+	std::string out;
+	for (char c : str)
+	{
+		if ('"' == c or '\\' == c) out += '\\';
+		if ((unsigned char) c < 0x20) continue;
+		out += c;
+	}
+	return out;
+}
+
+static std::string track_name(int pid, uint32_t tid,
+                              const std::string& name)
+{
+	return "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" +
+		std::to_string(pid) + ",\"tid\":" + std::to_string(tid) +
+		",\"args\":{\"name\":\"" + json_escape(name) + "\"}}";
+}
+
+/// The ring, oldest span first, as Chrome trace JSON. Times are in
+/// microseconds.
+ValuePtr OpenclNode::trace_json(void) const
+{
+	if (0 == _trace_max)
+		throw RuntimeException(TRACE_INFO,
+			"Tracing is not enabled; use the `trace` URL option: %s\n",
+			get_name().c_str());
+
+	// Catch the device spans that have finished by now.
+	harvest_profile();
+
+	std::lock_guard<std::mutex> lck(_trace_mtx);
+	std::vector<std::string> items;
+	items.push_back("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+		"\"args\":{\"name\":\"host\"}}");
+	items.push_back("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,"
+		"\"args\":{\"name\":\"device\"}}");
+	for (const auto& pr : _trace_tids)
+		items.push_back(track_name(1, pr.second,
+			"thread " + std::to_string(pr.second)));
+	items.push_back(track_name(2, 0, "uploads"));
+	items.push_back(track_name(2, 1, "kernels"));
+	items.push_back(track_name(2, 2, "downloads"));
+
+	size_t n = _trace_ring.size();
+	size_t first = (n < _trace_max) ? 0 : _trace_next % _trace_max;
+	for (size_t i = 0; i < n; i++)
+	{
+		const TraceEvent& evt = _trace_ring[(first + i) % n];
+		std::ostringstream ss;
+		char ts[64];
+		snprintf(ts, sizeof(ts), "%.3f,\"dur\":%.3f",
+			1.0e-3 * evt.start, 1.0e-3 * evt.dur);
+		ss << "{\"name\":\"" << json_escape(evt.name)
+		   << "\",\"cat\":\"" << (evt.device ? "device" : "host")
+		   << "\",\"ph\":\"X\",\"pid\":" << (evt.device ? 2 : 1)
+		   << ",\"tid\":" << evt.tid
+		   << ",\"ts\":" << ts;
+		if (NO_TICKET != evt.ticket)
+			ss << ",\"args\":{\"ticket\":" << evt.ticket << "}";
+		ss << "}";
+		items.push_back(ss.str());
+	}
+
+	std::string json = "{\"traceEvents\":[\n";
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		json += items[i];
+		json += (i + 1 < items.size()) ? ",\n" : "\n";
+	}
+	json += "],\"displayTimeUnit\":\"ns\"}\n";
+	return createStringValue(json);
+}
+
+/// Write the trace to the file named by the StringValue, or, given
+/// anything else, empty the ring.
+void OpenclNode::dump_trace(const ValuePtr& vp)
+{
+	if (not vp->is_type(STRING_VALUE))
+	{
+		std::lock_guard<std::mutex> lck(_trace_mtx);
+		_trace_ring.clear();
+		_trace_next = 0;
+		return;
+	}
+
+	const std::string& path = StringValueCast(vp)->value()[0];
+	ValuePtr json = trace_json();
+
+	std::ofstream out(path);
+	if (not out.is_open())
+		throw RuntimeException(TRACE_INFO,
+			"Unable to write the trace to \"%s\"\n", path.c_str());
+	out << StringValueCast(json)->value()[0];
+}
@@ -0,0 +1,228 @@
+/*
+ * opencog/atoms/opencl/OpenclNode-tune.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+#include <opencog/util/Logger.h>
+
+#include "OpenclNode.h"
+
+using namespace opencog;
+
+// ==============================================================
+// Work-group size autotuning.
+//
+// Left to itself, the driver picks some work-group size, and it's not
+// always a good one. So, for each kernel, and each vector length
+// (rounded down to a power of two), a few candidate sizes are tried
+// out: the driver's own choice, and multiples of the preferred
+// work-group size multiple, up to the largest that the kernel allows.
+//
+// The candidates are tried on the actual jobs, as they come in, and
+// not in some separate benchmark run: kernels might accumulate into
+// their outputs, and so can't be run more than once per job. Each job
+// is timed with the profiling info on its launch event. Once every
+// candidate has been tried a few times, the fastest one is used from
+// then on. The winners are saved in a file next to the cached program
+// binary, so that this is done only once per device.
+//
+// Only work-group sizes that divide the vector length are ever used,
+// so that the global size never has to be padded: kernels that don't
+// check the index against the vector length would otherwise run off
+// the end of their buffers. Lengths that no candidate divides are left
+// to the driver.
+//
+// The event callback only records the times; the winners are written
+// out later, by the dispatch thread, so that the callback thread never
+// waits on file I/O.
+
+// Number of times each candidate is timed. The fastest time is kept.
+#define TUNE_TRIALS 3
+
+// Maximum number of candidates, including the driver's choice.
+#define TUNE_CANDIDATES 8
+
+/// Vector lengths are grouped by the power of two below them.
+static size_t dim_bucket(size_t dim)
+{
+	size_t bucket = 0;
+	while (dim >>= 1) bucket++;
+	return bucket;
+}
+
+/// Return the local work-group size to use for the kernel, or zero,
+/// to let the driver decide. If the launch is to be timed, `trial`
+/// is set to the candidate number; otherwise, it is set to NO_TRIAL.
+size_t OpenclNode::pick_local_size(const std::string& kname,
+                                   const cl::Kernel& kern, size_t dim,
+                                   size_t& bucket, size_t& trial)
+{
+	trial = NO_TRIAL;
+	if (not _autotune) return 0;
+
+	// Results decided since the last launch.
+	if (_tune_dirty.exchange(false))
+		save_tuning();
+
+	bucket = dim_bucket(dim);
+	std::lock_guard<std::mutex> lck(_tune_mtx);
+	TuneEntry& ent = _tune[{kname, bucket}];
+
+	if (ent.decided)
+		return (0 < ent.winner and 0 == dim % ent.winner) ? ent.winner : 0;
+
+	if (0 == ent.candidates.size())
+	{
+		size_t mult = kern.getWorkGroupInfo<
+			CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(_device);
+		size_t maxwg = kern.getWorkGroupInfo<
+			CL_KERNEL_WORK_GROUP_SIZE>(_device);
+		if (0 == mult) mult = 1;
+
+		// Work-groups much larger than the vector are pointless.
+		ent.candidates.push_back(0);
+		for (size_t loc = mult; loc <= maxwg; loc *= 2)
+		{
+			if (TUNE_CANDIDATES <= ent.candidates.size()) break;
+			if (mult < loc and (dim < loc/2)) break;
+			ent.candidates.push_back(loc);
+		}
+		ent.best_ns.resize(ent.candidates.size(), 0.0);
+		ent.samples.resize(ent.candidates.size(), 0);
+	}
+
+	// A single candidate means there's nothing to decide.
+	if (1 == ent.candidates.size())
+	{
+		ent.decided = true;
+		ent.winner = 0;
+		return 0;
+	}
+
+	// Candidates that don't divide this length can't be timed on it;
+	// they count as tried, and as the slowest, so that tuning still
+	// finishes. The default, zero, always fits.
+	size_t ncand = ent.candidates.size();
+	for (size_t tries = 0; tries < ncand; tries++)
+	{
+		size_t next = ent.launches++ % ncand;
+		size_t loc = ent.candidates[next];
+		if (0 == loc or 0 == dim % loc)
+		{
+			trial = next;
+			return loc;
+		}
+		if (0 == ent.samples[next])
+			ent.best_ns[next] = std::numeric_limits<double>::infinity();
+		ent.samples[next] = std::max(ent.samples[next], (size_t) TUNE_TRIALS);
+	}
+	return 0;
+}
+
+/// Record the time taken by a timed launch. Called from the event
+/// callback, once the kernel has finished.
+void OpenclNode::tune_result(const std::string& kname, size_t bucket,
+                             size_t trial, cl_event ev)
+{
+	cl_ulong start = 0;
+	cl_ulong end = 0;
+	if (CL_SUCCESS != clGetEventProfilingInfo(ev,
+			CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) or
+	    CL_SUCCESS != clGetEventProfilingInfo(ev,
+			CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr))
+		return;
+	double ns = (double) (end - start);
+
+	{
+		std::lock_guard<std::mutex> lck(_tune_mtx);
+		TuneEntry& ent = _tune[{kname, bucket}];
+		if (ent.decided or ent.candidates.size() <= trial) return;
+
+		if (0 == ent.samples[trial] or ns < ent.best_ns[trial])
+			ent.best_ns[trial] = ns;
+		ent.samples[trial] ++;
+
+		size_t best = 0;
+		for (size_t i = 0; i < ent.candidates.size(); i++)
+		{
+			if (ent.samples[i] < TUNE_TRIALS) return;
+			if (ent.best_ns[i] < ent.best_ns[best]) best = i;
+		}
+
+		ent.decided = true;
+		ent.winner = ent.candidates[best];
+		logger().info("OpenclNode: work-group size for %s at 2^%zu is %zu\n",
+			kname.c_str(), bucket, ent.winner);
+	}
+
+	// Saved by the dispatch thread; see pick_local_size().
+	_tune_dirty = true;
+}
+
+/// Load the tuning results for the current program and device.
+void OpenclNode::load_tuning(void)
+{
+	if (not _autotune or 0 == _tune_path.size()) return;
+
+	std::ifstream tfile(_tune_path);
+	if (not tfile.is_open()) return;
+
+	std::lock_guard<std::mutex> lck(_tune_mtx);
+	std::string line;
+	while (std::getline(tfile, line))
+	{
+		std::istringstream iss(line);
+		std::string kname;
+		size_t bucket, local;
+		if (not (iss >> kname >> bucket >> local)) continue;
+
+		TuneEntry& ent = _tune[{kname, bucket}];
+		ent.decided = true;
+		ent.winner = local;
+	}
+}
+
+/// Save the tuning results. The file is written under a temporary
+/// name and then renamed, so that a reader never sees half a file.
+void OpenclNode::save_tuning(void)
+{
+	if (0 == _tune_path.size()) return;
+
+	std::lock_guard<std::mutex> lck(_tune_mtx);
+	std::string tmp_path = _tune_path + ".tmp";
+	{
+		std::ofstream tfile(tmp_path);
+		if (not tfile.is_open()) return;
+
+		for (const auto& it : _tune)
+		{
+			if (not it.second.decided) continue;
+			tfile << it.first.first << " " << it.first.second
+			      << " " << it.second.winner << "\n";
+		}
+	}
+	std::rename(tmp_path.c_str(), _tune_path.c_str());
+}
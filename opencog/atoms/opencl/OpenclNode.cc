@@ -20,6 +20,8 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 
@@ -28,6 +30,7 @@
 #include <opencog/util/oc_assert.h>
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/value/BoolValue.h>
 #include <opencog/atoms/value/ValueFactory.h>
 
 #include <opencog/opencl/types/atom_types.h>
@@ -36,19 +39,103 @@
 #include "OpenclJobValue.h"
 #include "OpenclNode.h"
 #include "GenIDL.h"
+#include "NativeKernels.h"
+#include "Reductions.h"
 
 using namespace opencog;
 
 OpenclNode::OpenclNode(const std::string&& str) :
 	StreamNode(OPENCL_NODE, std::move(str)),
-	_dispatch_queue(this, &OpenclNode::queue_job, 1)
+	_cache_max(0),
+	_cache_hits(0),
+	_cache_misses(0),
+	_cache_evictions(0),
+	_have_lib(false),
+	_num_lanes(1),
+	_queues_per_dev(1),
+	_out_of_order(false),
+	_next_lane(0),
+	_next_read(0),
+	_zero_copy(false),
+	_use_svm(false),
+	_svm_fine(false),
+	_pool_max_idle(0),
+	_pool_hits(0),
+	_pool_misses(0),
+	_pool_bytes_idle(0),
+	_pool_bytes_used(0),
+	_pool_gen(0),
+	_kernel_gen(0),
+	_base_align(1),
+	_job_cache_max(0),
+	_autotune(false),
+	_tune_dirty(false),
+	_stream_depth(1),
+	_mem_budget(0),
+	_mem_resident(0),
+	_mem_spills(0),
+	_mem_spilled_bytes(0),
+	_mem_refills(0),
+	_profile(false),
+	_trace_max(0),
+	_trace_next(0),
+	_open_async(false),
+	_open_done(false),
+	_next_ticket(0),
+	_now_serving(0),
+	_max_inflight(1),
+	_num_inflight(0),
+	_split_min(0),
+	_merge_max(0),
+	_merge_len(0)
 {
 	init();
 }
 
 OpenclNode::OpenclNode(Type t, const std::string&& str) :
 	StreamNode(t, std::move(str)),
-	_dispatch_queue(this, &OpenclNode::queue_job, 1)
+	_cache_max(0),
+	_cache_hits(0),
+	_cache_misses(0),
+	_cache_evictions(0),
+	_have_lib(false),
+	_num_lanes(1),
+	_queues_per_dev(1),
+	_out_of_order(false),
+	_next_lane(0),
+	_next_read(0),
+	_zero_copy(false),
+	_use_svm(false),
+	_svm_fine(false),
+	_pool_max_idle(0),
+	_pool_hits(0),
+	_pool_misses(0),
+	_pool_bytes_idle(0),
+	_pool_bytes_used(0),
+	_pool_gen(0),
+	_kernel_gen(0),
+	_base_align(1),
+	_job_cache_max(0),
+	_autotune(false),
+	_tune_dirty(false),
+	_stream_depth(1),
+	_mem_budget(0),
+	_mem_resident(0),
+	_mem_spills(0),
+	_mem_spilled_bytes(0),
+	_mem_refills(0),
+	_profile(false),
+	_trace_max(0),
+	_trace_next(0),
+	_open_async(false),
+	_open_done(false),
+	_next_ticket(0),
+	_now_serving(0),
+	_max_inflight(1),
+	_num_inflight(0),
+	_split_min(0),
+	_merge_max(0),
+	_merge_len(0)
 {
 	if (not nameserver().isA(t, OPENCL_NODE))
 		throw RuntimeException(TRACE_INFO,
@@ -59,12 +146,19 @@ OpenclNode::OpenclNode(Type t, const std::string&& str) :
 
 OpenclNode::~OpenclNode()
 {
+	// Stop the feeders and the dispatch threads before anything
+	// else goes away.
+	if (_opener.joinable())
+		_opener.join();
+	stop_streams();
+	_dispatch_queue.reset();
+	drain();
 }
 
 #define BAD_URL \
 	throw RuntimeException(TRACE_INFO, \
 		"Unsupported URL \"%s\"\n" \
-		"\tExpecting 'opencl://platform:device/file/path/kernel.cl'", \
+		"\tExpecting 'opencl://platform:device/file/path/kernel.cl[?opts]'", \
 		url.c_str());
 
 /// Validate the OpenCL URL
@@ -94,19 +188,135 @@ void OpenclNode::init(void)
 		_sdev = url.substr(pos, devend-pos);
 		pos = devend;
 	}
-	_filepath = url.substr(pos);
+
+	// Everything after a question mark are options.
+	size_t qpos = url.find('?', pos);
+	_filepath = url.substr(pos, qpos-pos);
+	if (std::string::npos != qpos)
+		parse_options(url.substr(qpos+1));
 
 	// What kind of file is it? Source or SPV?
-	pos = url.find_last_of('.');
+	pos = _filepath.find_last_of('.');
 	if (std::string::npos == pos) BAD_URL;
 
-	_is_spv = (url.substr(pos) == ".spv");
+	_is_spv = (_filepath.substr(pos) == ".spv");
+	_native = (0 == _splat.compare("native"));
+
+	// Maximum number of jobs that can be running on the device
+	// at the same time.
+	_max_inflight = get_size_option("inflight", 4);
+	if (0 == _max_inflight) _max_inflight = 1;
+
+	// Number of queue lanes, and whether the queues are allowed
+	// to run commands out of order. With several devices, this is
+	// the number of lanes for each device.
+	_queues_per_dev = get_size_option("queues", 1);
+	if (0 == _queues_per_dev) _queues_per_dev = 1;
+	_num_lanes = _queues_per_dev;
+	_out_of_order = (0 != get_size_option("ooo", 0));
+
+	// Shortest element-wise job to split across several lanes.
+	_split_min = get_size_option("split", 1024*1024);
+
+	// Short jobs to run as one launch; see OpenclNode-merge.cc
+	_merge_max = get_size_option("merge", 0);
+	_merge_len = get_size_option("merge-len", 16384);
+
+	// Upper limit on the size of the program cache on disk, in MiB.
+	_cache_max = get_size_option("cache-size", 256) * 1024 * 1024;
+
+	// Time everything; see OpenclNode-profile.cc
+	_profile = (0 != get_size_option("profile", 0));
+
+	// Keep a timeline; see OpenclNode-trace.cc
+	_trace_max = get_size_option("trace", 0);
+	_trace_t0 = std::chrono::steady_clock::now();
+	if (0 < _trace_max) _profile = true;
+
+	// Open in the background; see open().
+	_open_async = (0 != get_size_option("async", 0));
+
+	// Number of staging vectors for streaming inputs.
+	_stream_depth = get_size_option("stream-depth", 3);
+	if (0 == _stream_depth) _stream_depth = 1;
+
+	// Upper limit on the number of bytes held idle in the buffer pool.
+	_pool_max_idle = get_size_option("pool-max", 64*1024*1024);
+
+	// Device memory budget, in MiB; zero means pick one at open().
+	_mem_budget = get_size_option("memory", 0) * 1024 * 1024;
+
+	// Number of built jobs to keep around for reuse.
+	_job_cache_max = get_size_option("jobs", 256);
+
+	// Work-group size tuning.
+	_autotune = (0 != get_size_option("tune", 1));
+
+	// One dispatch thread per lane.
+	_dispatch_queue.reset(new async_caller<OpenclNode, Dispatch>(
+		this, &OpenclNode::queue_job, _num_lanes));
+}
+
+/// Parse options of the form `key1=val1&key2=val2`. A key without
+/// a value is taken to be a flag, and is given the value "1".
+void OpenclNode::parse_options(const std::string& query)
+{
+	size_t pos = 0;
+	while (pos < query.size())
+	{
+		size_t amp = query.find('&', pos);
+		if (std::string::npos == amp) amp = query.size();
+
+		std::string kv = query.substr(pos, amp-pos);
+		pos = amp + 1;
+		if (0 == kv.size()) continue;
+
+		size_t eq = kv.find('=');
+		if (std::string::npos == eq)
+			_options[kv] = "1";
+		else
+			_options[kv.substr(0, eq)] = kv.substr(eq+1);
+	}
+}
+
+size_t OpenclNode::get_size_option(const std::string& key,
+                                   size_t dflt) const
+{
+	const auto& it = _options.find(key);
+	if (_options.end() == it) return dflt;
+
+	try
+	{
+		return std::stoul(it->second);
+	}
+	catch (const std::exception& ex)
+	{
+		throw RuntimeException(TRACE_INFO,
+			"Expecting a number for option \"%s\" in URL \"%s\"\n",
+			key.c_str(), get_name().c_str());
+	}
 }
 
 // ==============================================================
 
+/// Find the platform, and the device or devices on it. A device of
+/// `*` takes all of the devices on the platform. A comma-separated
+/// list takes one device for each item in the list; the same
+/// substring can be given more than once, to get several identical
+/// devices. All of the devices must be on the same platform.
 void OpenclNode::find_device(void)
 {
+	std::vector<std::string> wanted;
+	bool take_all = (0 == _sdev.compare("*"));
+	size_t pos = 0;
+	while (not take_all)
+	{
+		size_t comma = _sdev.find(',', pos);
+		wanted.push_back(_sdev.substr(pos, comma-pos));
+		if (std::string::npos == comma) break;
+		pos = comma + 1;
+	}
+
 	std::vector<cl::Platform> platforms;
 	cl::Platform::get(&platforms);
 
@@ -118,20 +328,37 @@ void OpenclNode::find_device(void)
 
 		std::vector<cl::Device> devices;
 		plat.getDevices(CL_DEVICE_TYPE_ALL, &devices);
-		for (const cl::Device& dev: devices)
+
+		std::vector<bool> taken(devices.size(), take_all);
+		size_t found = 0;
+		for (const std::string& want : wanted)
 		{
-			std::string dname = dev.getInfo<CL_DEVICE_NAME>();
-			if (dname.find(_sdev) == std::string::npos)
-				continue;
+			for (size_t i = 0; i < devices.size(); i++)
+			{
+				if (taken[i]) continue;
+				std::string dname = devices[i].getInfo<CL_DEVICE_NAME>();
+				if (dname.find(want) == std::string::npos)
+					continue;
+				taken[i] = true;
+				found ++;
+				break;
+			}
+		}
+		if (not take_all and found < wanted.size()) continue;
+
+		_devices.clear();
+		for (size_t i = 0; i < devices.size(); i++)
+			if (taken[i]) _devices.push_back(devices[i]);
+		if (0 == _devices.size()) continue;
 
-			_platform = plat;
-			_device = dev;
+		_platform = plat;
+		_device = _devices[0];
 
+		for (const cl::Device& dev : _devices)
 			logger().info("OpenclNode: Using platform '%s' and device '%s'\n",
-				pname.c_str(), dname.c_str());
+				pname.c_str(), dev.getInfo<CL_DEVICE_NAME>().c_str());
 
-			return;
-		}
+		return;
 	}
 
 	throw RuntimeException(TRACE_INFO,
@@ -141,7 +368,8 @@ void OpenclNode::find_device(void)
 
 // ==============================================================
 
-void OpenclNode::build_program(void)
+/// Read in the source code named in the URL.
+std::string OpenclNode::read_source(void)
 {
 	// Copy in source code. Must be a better way!?
 	std::ifstream srcfm(_filepath);
@@ -152,47 +380,101 @@ void OpenclNode::build_program(void)
 		throw RuntimeException(TRACE_INFO,
 			"Unable to find source file in URL \"%s\"\n",
 			get_name().c_str());
+	return src;
+}
 
-	// Try to load from binary cache first.
-	// This can reduce startup time from seconds to milliseconds.
+void OpenclNode::build_program(void)
+{
+	std::string src = read_source();
+	_program = compile_source(src);
+
+	// Work-group sizes and kernel signatures are kept next to the
+	// binary.
 	std::string cache_path = get_cache_path(src);
-	bool loaded_from_cache = load_cached_binary(cache_path);
+	std::string base = cache_path.substr(0, cache_path.rfind('.'));
+	_tune_path = base + ".wgs";
 
-	if (not loaded_from_cache)
-	{
-		// No cache hit - compile from source
-		logger().info("OpenclNode: Compiling kernel from source (this may take a while)...\n");
+	// This must be done regardless of cache hit, as it creates Atomese
+	// for the kernel signatures. If the driver doesn't say what they
+	// are, then fall back to reading them off the source.
+	if (not describe_program(_program, base + ".idl"))
+		describe_program(src);
+}
 
-		cl::Program::Sources sources;
-		sources.push_back(src);
+/// Build the interface definitions for the kernels, from the source.
+void OpenclNode::describe_program(const std::string& src)
+{
+	GenIDL gidl;
+	publish_interfaces(gidl.gen_idl(src));
+}
 
-		_program = cl::Program(_context, sources);
+/// Build the interface definitions for the kernels of a built program.
+/// This needs no source, and so works for SPV files, too. Returns
+/// false if the signatures are neither in the cache, nor available
+/// from the driver.
+bool OpenclNode::describe_program(cl::Program& prog,
+                                  const std::string& idl_path)
+{
+	std::vector<KernelDecl> decls;
+	if (not load_cached_decls(idl_path, decls))
+	{
+		if (not get_kernel_decls(prog, decls))
+			return false;
+		if (1 == _devices.size())
+			save_decls_to_cache(idl_path, decls);
+	}
 
-		// Compile
-		try
-		{
-			// Specifying flags causes exception.
-			// program.build("-cl-std=CL1.2");
-			_program.build("");
-		}
-		catch (const cl::Error& e)
+	GenIDL gidl;
+	publish_interfaces(gidl.gen_idl(decls));
+	return true;
+}
+
+/// Read the argument types of each kernel off a built program. This
+/// only works if the program was built with -cl-kernel-arg-info, and
+/// even then, not all drivers keep the info for programs loaded from
+/// a binary. Returns false if it's not there.
+bool OpenclNode::get_kernel_decls(cl::Program& prog,
+                                  std::vector<KernelDecl>& decls)
+{
+	try
+	{
+		std::vector<cl::Kernel> kerns;
+		prog.createKernels(&kerns);
+		for (const cl::Kernel& k : kerns)
 		{
-			logger().info("OpenclNode failed compile >>%s<<\n",
-				_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_device).c_str());
-			throw RuntimeException(TRACE_INFO,
-				"Unable to compile source file in URL \"%s\"\n",
-					get_name().c_str());
+			KernelDecl decl;
+			decl.name = k.getInfo<CL_KERNEL_FUNCTION_NAME>();
+			cl_uint nargs = k.getInfo<CL_KERNEL_NUM_ARGS>();
+			for (cl_uint i = 0; i < nargs; i++)
+			{
+				// The type name is e.g. "float*" or "ulong". Anything
+				// in constant memory is read-only, same as const.
+				std::string ptype = k.getArgInfo<CL_KERNEL_ARG_TYPE_NAME>(i);
+				cl_kernel_arg_type_qualifier tq =
+					k.getArgInfo<CL_KERNEL_ARG_TYPE_QUALIFIER>(i);
+				cl_kernel_arg_address_qualifier aq =
+					k.getArgInfo<CL_KERNEL_ARG_ADDRESS_QUALIFIER>(i);
+				if ((tq & CL_KERNEL_ARG_TYPE_CONST) or
+				    CL_KERNEL_ARG_ADDRESS_CONSTANT == aq)
+					ptype = "const " + ptype;
+				decl.param_types.push_back(ptype);
+			}
+			decls.push_back(decl);
 		}
-
-		// Save to cache for next time
-		save_binary_to_cache(cache_path);
 	}
+	catch (const cl::Error& e)
+	{
+		logger().info("OpenclNode: No kernel argument info: %s (%d)\n",
+			e.what(), e.err());
+		decls.clear();
+		return false;
+	}
+	return 0 < decls.size();
+}
 
-	// Build the interface definitions for the kernels.
-	// This must be done regardless of cache hit, as it creates Atomese
-	// for the kernel signatures.
-	GenIDL gidl;
-	HandleSeq ifcs = gidl.gen_idl(src);
+/// Record the interface definitions, and publish them.
+void OpenclNode::publish_interfaces(const HandleSeq& ifcs)
+{
 	HandleSeq asif;
 	AtomSpace *as = getAtomSpace();
 	for (const Handle& h : ifcs)
@@ -215,9 +497,8 @@ void OpenclNode::build_program(void)
 
 // ==============================================================
 
-/// Load an SPV file.
-// XXX TODO: we need some way of extracting the programming
-// interfaces; not sure how to do this right now.
+/// Load an SPV file. There is no source to describe the kernels
+/// with; the signatures come from the kernel argument info.
 void OpenclNode::load_program(void)
 {
 	// Copy in SPV file. Must be a better way!?
@@ -230,7 +511,213 @@ void OpenclNode::load_program(void)
 			"Unable to find SPV file in URL \"%s\"\n",
 			get_name().c_str());
 
-	_program = cl::Program(_context, spv);
+	std::string cache_path = get_cache_dir() + "/" + compute_hash(spv) + ".bin";
+	std::string base = cache_path.substr(0, cache_path.rfind('.'));
+	_tune_path = base + ".wgs";
+
+	bool one_dev = (1 == _devices.size());
+	if (not one_dev or not load_cached_binary(cache_path, _program))
+		build_spv(spv, cache_path);
+
+	if (not describe_program(_program, base + ".idl"))
+		logger().warn("OpenclNode: Unable to get the kernel signatures for %s;"
+			" the driver does not provide kernel argument info.\n",
+			get_name().c_str());
+}
+
+/// Build SPIR-V, and cache the result.
+void OpenclNode::build_spv(const std::string& spv,
+                           const std::string& cache_path)
+{
+	bool one_dev = (1 == _devices.size());
+
+	// SPIR-V is intermediate language, not source, and must be
+	// given to clCreateProgramWithIL.
+	std::vector<char> il(spv.begin(), spv.end());
+	_program = cl::Program(_context, il);
+	try
+	{
+		_program.build("-cl-kernel-arg-info");
+	}
+	catch (const cl::Error& e)
+	{
+		logger().info("OpenclNode failed build >>%s<<\n",
+			_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_device).c_str());
+		throw RuntimeException(TRACE_INFO,
+			"Unable to build SPV file for \"%s\"\n",
+				get_name().c_str());
+	}
+
+	if (one_dev)
+		save_binary_to_cache(cache_path, _program);
+}
+
+// ==============================================================
+
+/// Compile OpenCL C source code. Try to load from binary cache first.
+/// This can reduce startup time from seconds to milliseconds.
+cl::Program OpenclNode::compile_source(const std::string& src)
+{
+	// The cache holds binaries for one device only.
+	cl::Program prog;
+	std::string cache_path = get_cache_path(src);
+	bool one_dev = (1 == _devices.size());
+	if (one_dev and load_cached_binary(cache_path, prog))
+		return prog;
+
+	// No cache hit - compile from source
+	logger().info("OpenclNode: Compiling kernel from source (this may take a while)...\n");
+
+	cl::Program::Sources sources;
+	sources.push_back(src);
+
+	prog = cl::Program(_context, sources);
+
+	// Compile
+	try
+	{
+		// Specifying flags causes exception.
+		// program.build("-cl-std=CL1.2");
+		prog.build(get_build_options(src).c_str());
+	}
+	catch (const cl::Error& e)
+	{
+		logger().info("OpenclNode failed compile >>%s<<\n",
+			prog.getBuildInfo<CL_PROGRAM_BUILD_LOG>(_device).c_str());
+		throw RuntimeException(TRACE_INFO,
+			"Unable to compile kernel source for \"%s\"\n",
+				get_name().c_str());
+	}
+
+	// Save to cache for next time
+	if (one_dev)
+		save_binary_to_cache(cache_path, prog);
+	return prog;
+}
+
+/// Compile the built-in reduction library. This is not done until
+/// someone asks for a reduction, as not everyone will. It might be
+/// called from several dispatch threads at once.
+void OpenclNode::build_library(void)
+{
+	std::lock_guard<std::mutex> lck(_lib_mtx);
+	if (_have_lib) return;
+
+	_lib_program = compile_source(reduction_source());
+	_have_lib = true;
+}
+
+/// Make the reductions known, alongside the kernels of the program.
+void OpenclNode::add_library_interfaces(void)
+{
+	AtomSpace *as = getAtomSpace();
+	Handle descr = as->add_node(PREDICATE_NODE, "*-description-*");
+
+	HandleSeq asif;
+	ValuePtr prev = getValue(descr);
+	if (prev and prev->is_type(CHOICE_LINK))
+		asif = HandleCast(prev)->getOutgoingSet();
+
+	for (const Handle& h : reduction_idl())
+	{
+		Handle has = as->add_atom(h);
+		_kernel_interfaces.insert({
+			has->getOutgoingAtom(0),
+			has->getOutgoingAtom(1)});
+		if (asif.end() == std::find(asif.begin(), asif.end(), has))
+			asif.emplace_back(has);
+	}
+
+	Handle choice = as->add_link(CHOICE_LINK, std::move(asif));
+	setValue(descr, choice);
+}
+
+// ==============================================================
+
+/// Create the command queues for each lane.
+void OpenclNode::make_queues(void)
+{
+	size_t ndev = _devices.size();
+	std::vector<cl_command_queue_properties> dprops(ndev, 0);
+	for (size_t d = 0; _out_of_order and d < ndev; d++)
+	{
+		cl_command_queue_properties have =
+			_devices[d].getInfo<CL_DEVICE_QUEUE_PROPERTIES>();
+		if (have & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+			dprops[d] |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+		else
+			logger().info("OpenclNode: device does not support "
+				"out-of-order queues; using in-order queues.\n");
+	}
+
+	_num_lanes = _queues_per_dev * ndev;
+	_compute_queues.clear();
+	_xfer_queues.clear();
+	_read_queues.clear();
+	for (size_t i = 0; i < _num_lanes; i++)
+	{
+		const cl::Device& dev = _devices[lane_device(i)];
+		cl_command_queue_properties props = dprops[lane_device(i)];
+
+		// Autotuning needs to know how long the kernels take.
+		if (_profile)
+			props |= CL_QUEUE_PROFILING_ENABLE;
+		cl_command_queue_properties cprops = props;
+		if (_autotune)
+			cprops |= CL_QUEUE_PROFILING_ENABLE;
+
+		_compute_queues.emplace_back(_context, dev, cprops);
+		_xfer_queues.emplace_back(_context, dev, props);
+		_read_queues.emplace_back(_context, dev, props);
+	}
+}
+
+/// Decide whether buffers should be SVM, or should alias host memory.
+void OpenclNode::pick_memory_mode(void)
+{
+	if (0 != get_size_option("svm", 0))
+	{
+		// OpenCL 1.x devices don't know the query, and fail it.
+		// The version string is "OpenCL <major>.<minor> ..."
+		std::string ver = _device.getInfo<CL_DEVICE_VERSION>();
+		cl_device_svm_capabilities caps = 0;
+		if (7 < ver.size() and '2' <= ver[7] and
+		    CL_SUCCESS != clGetDeviceInfo(_device(),
+		                    CL_DEVICE_SVM_CAPABILITIES,
+		                    sizeof(caps), &caps, nullptr))
+			caps = 0;
+		_svm_fine = (0 != (caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER));
+		_use_svm = _svm_fine or
+			(0 != (caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER));
+
+		if (_use_svm)
+		{
+			logger().info("OpenclNode: using %s-grained SVM\n",
+				_svm_fine ? "fine" : "coarse");
+			return;
+		}
+		logger().info("OpenclNode: device does not support SVM; "
+			"using plain buffers\n");
+	}
+
+	const auto& it = _options.find("zerocopy");
+	if (_options.end() != it)
+	{
+		_zero_copy = (0 != get_size_option("zerocopy", 0));
+		return;
+	}
+
+	// CL_DEVICE_HOST_UNIFIED_MEMORY is deprecated in OpenCL 2.0, and
+	// the C++ bindings hide it; but it remains the most direct answer,
+	// and is supported by every driver we've seen.
+	cl_bool unified = CL_FALSE;
+	cl_int rc = clGetDeviceInfo(_device(), CL_DEVICE_HOST_UNIFIED_MEMORY,
+		sizeof(unified), &unified, nullptr);
+	_zero_copy = (CL_SUCCESS == rc and CL_TRUE == unified);
+
+	if (_zero_copy)
+		logger().info("OpenclNode: device has unified memory; "
+			"using zero-copy buffers\n");
 }
 
 // ==============================================================
@@ -249,18 +736,108 @@ void OpenclNode::open(const ValuePtr& out_type)
 			"Expecting the type to be a FloatValue or NumberNode; got %s\n",
 			out_type->to_string().c_str());
 
+	// In the async mode, the device is opened and the program built
+	// in a thread of its own, and we return right away. Jobs may be
+	// written at once; they wait in the dispatch threads until the
+	// program is ready.
+	_open_done = false;
+	_open_error.clear();
+	if (_open_async)
+	{
+		_qvp = createQueueValue();
+		_ready = createQueueValue();
+		_opener = std::thread(&OpenclNode::finish_open, this);
+		return;
+	}
+
+	connect();
+	_open_done = true;
+	_qvp = createQueueValue();
+	_ready = createQueueValue();
+}
+
+/// The part of open() that can run in the background.
+void OpenclNode::finish_open(void)
+{
+	try
+	{
+		connect();
+	}
+	catch (const std::exception& ex)
+	{
+		std::lock_guard<std::mutex> lck(_open_mtx);
+		_open_error = ex.what();
+		if (0 == _open_error.size()) _open_error = "unknown error";
+		logger().warn("OpenclNode: Unable to open %s: %s\n",
+			get_name().c_str(), _open_error.c_str());
+	}
+
+	std::lock_guard<std::mutex> lck(_open_mtx);
+	_open_done = true;
+	_open_cv.notify_all();
+}
+
+/// Block until open() is done. Throws, if it failed.
+void OpenclNode::wait_open(void)
+{
+	std::unique_lock<std::mutex> lck(_open_mtx);
+	_open_cv.wait(lck, [this] { return (bool) _open_done; });
+	if (0 < _open_error.size())
+		throw RuntimeException(TRACE_INFO,
+			"Unable to open %s: %s\n",
+			get_name().c_str(), _open_error.c_str());
+}
+
+/// Report whether open() is done, as a BoolValue. Throws, if it
+/// failed.
+ValuePtr OpenclNode::open_status(void) const
+{
+	std::lock_guard<std::mutex> lck(_open_mtx);
+	if (0 < _open_error.size())
+		throw RuntimeException(TRACE_INFO,
+			"Unable to open %s: %s\n",
+			get_name().c_str(), _open_error.c_str());
+	return createBoolValue((bool) _open_done);
+}
+
+/// Create the device context and the queues, and build the program.
+void OpenclNode::connect(void)
+{
+	// No OpenCL at all; the kernels run on the host. The program
+	// is only read, so that its kernels can be described.
+	if (_native)
+	{
+		logger().info("OpenclNode: Using native kernels (%s)\n",
+			native_isa());
+		if (not _is_spv)
+			describe_program(read_source());
+		add_library_interfaces();
+		return;
+	}
+
 	// Try to create the OpenCL device
 	find_device();
-	_context = cl::Context(_device);
-	_queue = cl::CommandQueue(_context, _device);
+	_context = cl::Context(_devices);
+	make_queues();
+	find_weights();
+	pick_memory_mode();
+
+	// The alignment is reported in bits. Sub-buffers must suit all
+	// of the devices.
+	_base_align = 1;
+	for (const cl::Device& dev : _devices)
+		_base_align = std::max(_base_align,
+			(size_t) dev.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN>() / 8);
+	find_budget();
 
 	// Try to load source or spv file
 	if (_is_spv)
 		load_program();
 	else
 		build_program();
-
-	_qvp = createQueueValue();
+	add_library_interfaces();
+	fill_kernel_pool();
+	load_tuning();
 }
 
 bool OpenclNode::connected(void) const
@@ -270,9 +847,47 @@ bool OpenclNode::connected(void) const
 
 void OpenclNode::close(const ValuePtr& ignore)
 {
+	// Let everything that is still running on the device finish,
+	// so that the results can be placed in the queue before it
+	// is closed. Streams stop feeding first.
+	if (_opener.joinable())
+		_opener.join();
+	stop_streams();
+	_dispatch_queue->flush_queue();
+	drain();
+	if (_tune_dirty.exchange(false))
+		save_tuning();
+
 	if (_qvp)
 		_qvp->close();
 	_qvp = nullptr;
+	if (_ready)
+		_ready->close();
+	_ready = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lck(_job_mtx);
+		_job_cache.clear();
+	}
+	{
+		std::lock_guard<std::mutex> lck(_kernel_mtx);
+		_kernel_pool.clear();
+		_kernel_gen++;
+	}
+	{
+		std::lock_guard<std::mutex> lck(_pool_mtx);
+		_pool_gen++;
+	}
+	{
+		std::lock_guard<std::mutex> lck(_lib_mtx);
+		_have_lib = false;
+		_lib_program = cl::Program();
+	}
+	{
+		std::lock_guard<std::mutex> lck(_fused_mtx);
+		_fused_progs.clear();
+	}
+	clear_pool();
 
 	// XXX more to do here. FIXME
 	// One of the TODO's is to crawl over the icoming set, look for
@@ -290,6 +905,67 @@ ValuePtr OpenclNode::stream(void) const
 	return _qvp;
 }
 
+ValuePtr OpenclNode::getValue(const Handle& key) const
+{
+	if (key->is_type(PREDICATE_NODE))
+	{
+		const std::string& msg = key->get_name();
+		if (0 == msg.compare("*-buffer-pool-*"))
+			return pool_stats();
+		if (0 == msg.compare("*-read-async-*") and _ready)
+			return _ready;
+		if (0 == msg.compare("*-cache-stats-*"))
+			return cache_stats();
+		if (0 == msg.compare("*-ready-*"))
+			return open_status();
+		if (0 == msg.compare("*-memory-*"))
+			return memory_stats();
+		if (0 == msg.compare("*-stats-*"))
+			return profile_stats();
+		if (0 == msg.compare("*-trace-*"))
+			return trace_json();
+	}
+	return StreamNode::getValue(key);
+}
+
+/// Messages, in addition to the usual StreamNode messages:
+///    *-read-async-* -- run a Section, or download vectors, without
+///        waiting; see OpenclNode-async.cc
+///    *-evict-* -- move vectors off the device; see OpenclNode-memory.cc
+///    *-stats-* -- clear the profile; see OpenclNode-profile.cc
+///    *-trace-* -- write the trace to a file; see OpenclNode-trace.cc
+void OpenclNode::setValue(const Handle& key, const ValuePtr& value)
+{
+	if (key->is_type(PREDICATE_NODE))
+	{
+		const std::string& msg = key->get_name();
+		if (0 == msg.compare("*-evict-*"))
+		{
+			evict_value(value);
+			return;
+		}
+		if (0 == msg.compare("*-trace-*"))
+		{
+			dump_trace(value);
+			return;
+		}
+		if (0 == msg.compare("*-stats-*"))
+		{
+			clear_profile();
+			return;
+		}
+		if (0 == msg.compare("*-read-async-*"))
+		{
+			if (not connected())
+				throw RuntimeException(TRACE_INFO,
+					"Device not open! %s\n", get_name().c_str());
+			read_async(value);
+			return;
+		}
+	}
+	StreamNode::setValue(key, value);
+}
+
 ValuePtr OpenclNode::read(void) const
 {
 	if (not connected())
@@ -301,46 +977,391 @@ ValuePtr OpenclNode::read(void) const
 
 // ==============================================================
 
+/// Place an item on the dispatch queue. The ticket is taken under
+/// the same lock as the enqueue, so that tickets appear on the queue
+/// in increasing order. This is what prevents a dispatch thread from
+/// waiting on a turn that is stuck behind it in the queue.
+void OpenclNode::dispatch(const ValuePtr& vp)
+{
+	TraceSpan span(this, "enqueue");
+	uint64_t when = (0 < _trace_max) ? trace_now() : 0;
+	std::lock_guard<std::mutex> lck(_ticket_mtx);
+	_dispatch_queue->enqueue(Dispatch{vp, _next_ticket++, when});
+}
+
+/// Block until it is the turn of `ticket` to talk to the device.
+void OpenclNode::wait_turn(size_t ticket)
+{
+	std::unique_lock<std::mutex> lck(_turn_mtx);
+	_turn_cv.wait(lck, [&] { return _now_serving == ticket; });
+}
+
+void OpenclNode::end_turn(void)
+{
+	std::lock_guard<std::mutex> lck(_turn_mtx);
+	_now_serving ++;
+	_turn_cv.notify_all();
+}
+
 // This job handler runs in a different thread than the main thread.
 // It uploads vectors to the GPU, and uploads and runs kernels.
 // Status results are placed on the QueueValue, where the main thread
 // can get at it.
 //
-// There are some open design questions about the sharing of queues
-// and events. it might be wise to share a single `cl::Event` event
-// handler, just to serialize things. If nothing else, then at least
-// save to overhead of running the ctors and dtors. Same consideration
-// for the queue.
-void OpenclNode::queue_job(const ValuePtr& vp)
+// There may be several of these threads. Jobs are built concurrently,
+// but are then submitted to the device strictly in the order in which
+// they were written. Submitting is cheap, since it never waits for
+// the GPU, so there is little contention over the turn.
+void OpenclNode::queue_job(const Dispatch& dsp)
+{
+	if (0 < _trace_max)
+		trace("queued", dsp.when, trace_now(), dsp.ticket);
+
+	try
+	{
+		{
+			TraceSpan span(this, "wait-open", dsp.ticket);
+			wait_open();
+		}
+		TraceSpan span(this, "prepare", dsp.ticket);
+		prepare_job(dsp.vp);
+	}
+	catch (...)
+	{
+		// Give up our turn, else everyone behind us hangs.
+		wait_turn(dsp.ticket);
+		end_merge_turn(dsp.ticket);
+		end_turn();
+		feed_done(dsp.vp);
+		throw;
+	}
+
+	{
+		TraceSpan span(this, "wait-turn", dsp.ticket);
+		wait_turn(dsp.ticket);
+	}
+	try
+	{
+		TraceSpan span(this, "submit", dsp.ticket);
+		submit_job(dsp.vp);
+		end_merge_turn(dsp.ticket);
+	}
+	catch (...)
+	{
+		end_merge_turn(dsp.ticket);
+		end_turn();
+		feed_done(dsp.vp);
+		throw;
+	}
+	end_turn();
+}
+
+/// Launch one job, on the next lane.
+void OpenclNode::launch_job(const OpenclJobValuePtr& ojv)
+{
+	size_t lane = next_lane();
+	ojv->restore_evicted(get_handle());
+	keep_resident(ojv);
+	{
+		TraceSpan span(this, "wait-slot");
+		acquire_slot();
+	}
+	{
+		TraceSpan span(this, "upload");
+		ojv->upload_inputs(get_xfer_queue(lane));
+	}
+	{
+		TraceSpan span(this, "launch");
+		ojv->run(get_queue(lane));
+	}
+	if (_profile)
+		profile(ojv->_kname, ojv->_run_event,
+			ojv->bytes_moved(), ojv->flops());
+	in_flight(ojv, ojv->_run_event, lane);
+}
+
+/// The part of the job that can run concurrently with other jobs.
+void OpenclNode::prepare_job(const ValuePtr& vp)
 {
 	if (vp->is_type(OPENCL_JOB_VALUE))
 	{
 		OpenclJobValuePtr ojv = OpenclJobValueCast(vp);
 
 		// Build the kernel if not yet built. This is deferred from
-		// do_write() to ensure all OpenCL kernel object creation
-		// happens in this single dispatch thread, avoiding per-thread
-		// OpenCL initialization overhead.
+		// do_write() so that the OpenCL kernel object creation
+		// happens in the dispatch threads, avoiding per-thread
+		// OpenCL initialization overhead in the writer threads.
+		// Jobs for Sections seen before only need their arguments
+		// evaluated. They are bound in submit_job(), in order.
+		if (ojv->_proto)
+		{
+			ojv->_fresh = ojv->eval_args();
+			return;
+		}
+
 		if (not ojv->is_built())
+		{
 			ojv->build(ojv->get_opencl_node());
+			cache_job(ojv);
+		}
+	}
+}
 
-		ojv->upload_inputs(get_handle());
-		ojv->run(get_handle());
-		_event_handler.wait();
-		_qvp->add(ojv);
+// Nothing here waits for the GPU. Uploads are enqueued without
+// blocking, the kernel launch waits on the uploads via an event
+// wait-list, and the completion callback on the launch event places
+// the job on the QueueValue. Thus, the copy-in for the next job can
+// overlap with the running of this one. The only place where this
+// thread blocks is in acquire_slot(), when too many jobs are already
+// in flight.
+void OpenclNode::submit_job(const ValuePtr& vp)
+{
+	// Native jobs are run right here, and are done when this returns.
+	// Vectors and batches of vectors have nowhere to go.
+	if (_native)
+	{
+		if (vp->is_type(OPENCL_JOB_VALUE))
+		{
+			OpenclJobValuePtr ojv = OpenclJobValueCast(vp);
+			auto start = std::chrono::steady_clock::now();
+			ojv->run_native();
+			if (_profile)
+			{
+				std::chrono::duration<double, std::nano> ns =
+					std::chrono::steady_clock::now() - start;
+				add_sample(ojv->_kname, 0.0, ns.count(),
+					ojv->bytes_moved(), ojv->flops());
+			}
+		}
+		report(vp);
+		return;
+	}
+
+	if (vp->is_type(OPENCL_JOB_VALUE))
+	{
+		OpenclJobValuePtr ojv = OpenclJobValueCast(vp);
+		if (ojv->_proto)
+			ojv->rebind(ojv->get_opencl_node());
+
+		// Short jobs may be held back, to run with the next few.
+		if (merge_job(ojv)) return;
+		launch_job(ojv);
 		return;
 	}
 
+	// Anything else must come after the jobs being held back.
+	flush_merge();
+	size_t lane = next_lane();
+
 	// If told to write a vector, then we upload that vector data
 	// to the GPU.
 	if (vp->is_type(OPENCL_DATA_VALUE))
 	{
 		OpenclFloatValuePtr ofv = OpenclFloatValueCast(vp);
-		ofv->send_buffer(get_handle());
-		_event_handler.wait();
-		_qvp->add(ofv);
+		ofv->set_context(get_handle());  // In case open() was busy.
+		keep_resident(ofv);
+		cl::Event done;
+		acquire_slot();
+		ofv->send_buffer(get_xfer_queue(lane), done);
+		in_flight(ofv, done, lane);
 		return;
 	}
+
+	// A batch of vectors, all sent together.
+	if (vp->is_type(LINK_VALUE))
+	{
+		bind_batch(vp);  // In case open() was busy.
+		cl::Event done;
+		acquire_slot();
+		try
+		{
+			send_batch(vp, get_xfer_queue(lane), done);
+		}
+		catch (...)
+		{
+			release_slot();
+			throw;
+		}
+		in_flight(vp, done, lane);
+		return;
+	}
+}
+
+// ==============================================================
+// Cache of built jobs.
+
+/// Return the cached job for the Section, or null, if there is none.
+OpenclJobValuePtr OpenclNode::find_job(const Handle& sect)
+{
+	std::lock_guard<std::mutex> lck(_job_mtx);
+	auto it = _job_cache.find(sect);
+	if (_job_cache.end() == it) return nullptr;
+	return it->second;
+}
+
+/// Create a job for the Section. If this Section was run before, the
+/// new job reuses the kernel of the earlier one, and only rebinds the
+/// arguments.
+OpenclJobValuePtr OpenclNode::make_job(const Handle& sect)
+{
+	OpenclJobValuePtr proto = find_job(sect);
+	if (proto)
+		return createOpenclJobValue(proto);
+
+	OpenclJobValuePtr kern = createOpenclJobValue(sect);
+	kern->set_opencl_node(get_handle());
+	return kern;
+}
+
+void OpenclNode::cache_job(const OpenclJobValuePtr& ojv)
+{
+	// Native jobs have no kernel worth keeping.
+	if (0 == _job_cache_max or _native) return;
+
+	std::lock_guard<std::mutex> lck(_job_mtx);
+	if (_job_cache.end() != _job_cache.find(ojv->_definition)) return;
+
+	// Crude, but good enough: workloads that run the same few
+	// Sections over and over won't ever get here.
+	if (_job_cache_max <= _job_cache.size())
+		_job_cache.erase(_job_cache.begin());
+	_job_cache.emplace(ojv->_definition, ojv);
+}
+
+// ==============================================================
+// Management of the in-flight window.
+
+/// Block until there is room for one more job on the device.
+void OpenclNode::acquire_slot(void)
+{
+	std::unique_lock<std::mutex> lck(_inflight_mtx);
+	_inflight_cv.wait(lck,
+		[this] { return _num_inflight < _max_inflight; });
+	_num_inflight ++;
+}
+
+void OpenclNode::release_slot(void)
+{
+	std::lock_guard<std::mutex> lck(_inflight_mtx);
+	_num_inflight --;
+	_inflight_cv.notify_all();
+}
+
+/// Block until everything in flight has completed.
+void OpenclNode::drain(void)
+{
+	std::unique_lock<std::mutex> lck(_inflight_mtx);
+	_inflight_cv.wait(lck, [this] { return 0 == _num_inflight; });
+}
+
+// The OpenCL event callback needs a plain pointer to pass around.
+// This holds the node, and a reference to the value, keeping it
+// alive until the device is done with it.
+namespace opencog {
+struct InFlight
+{
+	OpenclNode* node;
+	ValuePtr vp;
+	size_t dev;
+};
+}
+
+/// Arrange for `vp` to be placed on the QueueValue when the `done`
+/// event completes. The caller must have called acquire_slot() first.
+void OpenclNode::in_flight(const ValuePtr& vp, cl::Event& done,
+                           size_t lane)
+{
+	size_t dev = lane_device(lane);
+	{
+		std::lock_guard<std::mutex> lck(_inflight_mtx);
+		_dev_load[dev] ++;
+	}
+
+	InFlight* ifl = new InFlight{this, vp, dev};
+	try
+	{
+		done.setCallback(CL_COMPLETE, job_done, ifl);
+	}
+	catch (const cl::Error& e)
+	{
+		delete ifl;
+		{
+			std::lock_guard<std::mutex> lck(_inflight_mtx);
+			_dev_load[dev] --;
+		}
+		release_slot();
+		throw RuntimeException(TRACE_INFO,
+			"Unable to set completion callback: %s (%d)\n",
+			e.what(), e.err());
+	}
+
+	// Push the work out to the device. Jobs would be started anyway,
+	// but not necessarily right away, without a flush.
+	get_xfer_queue(lane).flush();
+	get_queue(lane).flush();
+}
+
+/// Place a finished job on the QueueValue. Jobs in a graph are
+/// reported all together, by the last one to finish. Dropping the
+/// sinks breaks the reference cycle between them and the graph.
+void OpenclNode::report(const ValuePtr& vp)
+{
+	ValuePtr done = vp;
+	if (vp->is_type(OPENCL_JOB_VALUE))
+	{
+		OpenclJobValuePtr ojv = OpenclJobValueCast(vp);
+		if (ojv->_graph)
+		{
+			done = nullptr;
+			if (0 == --ojv->_graph->pending)
+				std::swap(done, ojv->_graph->sinks);
+		}
+
+		// Jobs written with *-read-async-* are reported only once
+		// their outputs are downloaded.
+		else if (ojv->_read_async)
+		{
+			done = nullptr;
+			read_async(vp);
+		}
+	}
+
+	if (done and _qvp)
+	{
+		TraceSpan span(this, "publish");
+		_qvp->add(done);
+	}
+	feed_done(vp);
+}
+
+/// OpenCL event callback. This runs in a thread owned by the OpenCL
+/// implementation. It must not make any blocking OpenCL calls.
+void CL_CALLBACK OpenclNode::job_done(cl_event ev, cl_int status,
+                                      void* data)
+{
+	InFlight* ifl = (InFlight*) data;
+	OpenclNode* onp = ifl->node;
+	{
+		std::lock_guard<std::mutex> lck(onp->_inflight_mtx);
+		onp->_dev_load[ifl->dev] --;
+	}
+
+	if (ifl->vp->is_type(OPENCL_JOB_VALUE))
+	{
+		OpenclJobValuePtr ojv = OpenclJobValueCast(ifl->vp);
+		if (CL_COMPLETE == status and NO_TRIAL != ojv->_tune_trial)
+			onp->tune_result(ojv->_kname, ojv->_tune_bucket,
+				ojv->_tune_trial, ev);
+	}
+	if (CL_COMPLETE != status)
+		logger().warn("OpenclNode: job failed with status %d\n", status);
+	if (onp->_profile)
+		onp->harvest_profile();
+
+	onp->report(ifl->vp);
+	delete ifl;
+
+	onp->release_slot();
 }
 
 // ==============================================================
@@ -361,30 +1382,54 @@ void OpenclNode::do_write(const ValuePtr& vp)
 	// Ready-to-go. Dispatch.
 	if (vp->is_type(OPENCL_JOB_VALUE))
 	{
-		_dispatch_queue.enqueue(vp);
+		dispatch(vp);
 		return;
 	}
 
 	// There's a chance that vectors haven't been attached yet.
-	// Do that now with set_context.
+	// Do that now with set_context. If there's no context yet,
+	// because open() is still busy, this is put off until
+	// prepare_job().
 	if (vp->is_type(OPENCL_DATA_VALUE))
 	{
 		OpenclFloatValuePtr ofv = OpenclFloatValueCast(vp);
-		ofv->set_context(get_handle());
-		_dispatch_queue.enqueue(vp);
+		if (not _native and _open_done)
+			ofv->set_context(get_handle());
+		dispatch(vp);
 		return;
 	}
 
 	if (vp->is_type(SECTION))
 	{
+		// Sections with a streaming input get a feeder of their own.
+		if (start_stream(HandleCast(vp)))
+			return;
+
 		// Create the job but DON'T build it yet. Building creates
 		// cl::Kernel objects which triggers OpenCL per-thread initialization.
 		// By deferring build() to queue_job(), all OpenCL kernel object
-		// creation happens in the single dispatch thread, eliminating
-		// the per-thread initialization overhead in CogServer.
-		OpenclJobValuePtr kern = createOpenclJobValue(HandleCast(vp));
-		kern->set_opencl_node(get_handle());
-		_dispatch_queue.enqueue(kern);
+		// creation happens in the dispatch threads, eliminating the
+		// per-thread initialization overhead in CogServer.
+		//
+		dispatch(make_job(HandleCast(vp)));
+		return;
+	}
+
+	// A graph of jobs.
+	if (vp->is_type(LINK_VALUE) and 0 < LinkValueCast(vp)->size() and
+	    LinkValueCast(vp)->value()[0]->is_type(SECTION))
+	{
+		write_graph(vp);
+		return;
+	}
+
+	// A batch of vectors, to be sent all at once. The batch as a
+	// whole is placed on the QueueValue, when they've all arrived.
+	if (vp->is_type(LINK_VALUE))
+	{
+		if (not _native and _open_done)
+			bind_batch(vp);
+		dispatch(vp);
 		return;
 	}
 
@@ -23,10 +23,25 @@
 #ifndef _OPENCOG_OPENCL_NODE_H
 #define _OPENCOG_OPENCL_NODE_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
 #include <opencog/util/async_method_caller.h>
 #include <opencog/atoms/value/QueueValue.h>
 #include <opencog/atoms/sensory/StreamNode.h>
+#include <opencog/atoms/opencl/FusedKernel.h>
+#include <opencog/atoms/opencl/GenIDL.h>
 #include <opencog/atoms/opencl/OpenclFloatValue.h>
+#include <opencog/atoms/opencl/OpenclJobValue.h>
+#include <opencog/atoms/opencl/Reductions.h>
 #include <opencog/atoms/opencl/opencl-headers.h>
 
 namespace opencog
@@ -48,30 +63,88 @@ class OpenclNode
 protected:
 	void init(void);
 
-	// URL specifying platform and device.
+	// URL specifying platform and device. The device may also be a
+	// comma-separated list of substrings, or a `*` for all devices.
 	std::string _splat; // platform substring
 	std::string _sdev;  // device substring
 	std::string _filepath; // path to cl, clcpp or spv file
 	bool _is_spv; // true if a *.spv file
 
-	// Actual platform and device to connect to.
+	// True for the `native` platform: no OpenCL, the kernels are
+	// run on the host instead. See NativeKernels.h
+	bool _native;
+
+	// Options passed in the query part of the URL, for example
+	// 'opencl://:/path/kernel.cl?inflight=8'
+	std::map<std::string, std::string> _options;
+	void parse_options(const std::string&);
+	size_t get_size_option(const std::string&, size_t) const;
+
+	// Actual platform and devices to connect to. All of the devices
+	// share one context. The first is the primary device; it is the
+	// one that all the single-device parts of the code work with.
 	void find_device(void);
 	cl::Platform _platform;
 	cl::Device _device;
+	std::vector<cl::Device> _devices;
 	const cl::Device& get_device(void) { return _device; }
 
 	// Program loading and compilation.
+	std::string read_source(void);
 	void build_program(void);
+	void describe_program(const std::string&);
+	bool describe_program(cl::Program&, const std::string& idl_path);
+	bool get_kernel_decls(cl::Program&, std::vector<KernelDecl>&);
+	void publish_interfaces(const HandleSeq&);
 	void load_program(void);
+	void build_spv(const std::string& spv, const std::string& cache_path);
+	cl::Program compile_source(const std::string&);
 	cl::Program _program;
 	const cl::Program& get_program(void) { return _program; }
 
-	// Binary caching for faster startup.
+	// Binary caching for faster startup. At most `_cache_max` bytes
+	// are kept on disk, for all devices together.
 	std::string get_cache_dir(void) const;
 	std::string get_cache_path(const std::string& src) const;
+	std::string get_build_options(const std::string& src) const;
 	std::string compute_hash(const std::string& data) const;
-	bool load_cached_binary(const std::string& cache_path);
-	void save_binary_to_cache(const std::string& cache_path);
+	bool load_cached_binary(const std::string& cache_path, cl::Program&);
+	void save_binary_to_cache(const std::string& cache_path,
+	                          const cl::Program&);
+	bool load_cached_decls(const std::string& idl_path,
+	                       std::vector<KernelDecl>&);
+	void save_decls_to_cache(const std::string& idl_path,
+	                         const std::vector<KernelDecl>&);
+	void evict_cache(void);
+	size_t _cache_max;
+	std::atomic<size_t> _cache_hits;
+	std::atomic<size_t> _cache_misses;
+	std::atomic<size_t> _cache_evictions;
+	ValuePtr cache_stats(void) const;
+
+	// The built-in library of reductions. This is a program of its
+	// own, compiled the first time that one of its kernels is needed.
+	// See Reductions.h
+	std::mutex _lib_mtx;
+	bool _have_lib;
+	cl::Program _lib_program;
+	void build_library(void);
+	void add_library_interfaces(void);
+
+	// Kernels generated from Atomese arithmetic, by the Lambda they
+	// were generated from, and the programs holding them, by kernel
+	// name. Sums are run as reductions; `red` describes the stages.
+	// The descriptions outlive close(); the programs do not.
+	// See FusedKernel.h
+	struct FusedEntry
+	{
+		FusedKernel kern;
+		Reduction red;
+	};
+	std::mutex _fused_mtx;
+	std::map<Handle, FusedEntry> _fused;
+	std::map<std::string, cl::Program> _fused_progs;
+	const FusedEntry& get_fused(const Handle&);
 
 	// List of interfaces provided by the program.
 	// Its a bunch of kernels, described in Atomese.
@@ -82,17 +155,376 @@ protected:
 	cl::Context _context;
 	const cl::Context& get_context(void) { return _context; }
 
-	// Async I/O queue to the execution context.
-	// (TODO: I guess we could have several of these per context!?)
-	cl::CommandQueue _queue;
-	cl::CommandQueue& get_queue(void) { return _queue; }
+	// Async I/O queues to the execution context. These are organized
+	// into `_num_lanes` lanes; each lane has one queue for running
+	// kernels, and another for moving data. Jobs are dealt out to the
+	// lanes round-robin, so that independent jobs can run concurrently
+	// on the device. Jobs that share data are kept in proper order by
+	// the events recorded on the data; see OpenclDataValue.
+	//
+	// With several devices, there are `_queues_per_dev` lanes for
+	// each; lane `i` is on device `i % _devices.size()`. Jobs go to
+	// the device with the least work outstanding on it, for its size.
+	// See OpenclNode-multi.cc
+	size_t _num_lanes;
+	size_t _queues_per_dev;
+	bool _out_of_order;
+	std::vector<cl::CommandQueue> _compute_queues;
+	std::vector<cl::CommandQueue> _xfer_queues;
+	std::atomic<size_t> _next_lane;
+	void make_queues(void);
+	size_t next_lane(void);
+	size_t lane_device(size_t lane) const { return lane % _devices.size(); }
+	size_t device_lane(size_t dev) {
+		return (_next_lane++ % _queues_per_dev) * _devices.size() + dev; }
+	cl::CommandQueue& get_queue(size_t lane) { return _compute_queues[lane]; }
+	cl::CommandQueue& get_xfer_queue(size_t lane) { return _xfer_queues[lane]; }
+
+	// Queues for reading data back to the host. These are shared by
+	// all of the OpenclDataValues in this context, and are kept apart
+	// from the kernel queues, so that reads don't get stuck behind
+	// long-running kernels. There is one per lane.
+	std::vector<cl::CommandQueue> _read_queues;
+	std::atomic<size_t> _next_read;
+	cl::CommandQueue& get_read_queue(void) {
+		return _read_queues[_next_read++ % _read_queues.size()]; }
+
+	// Zero-copy mode. On integrated GPUs and CPU devices, the host and
+	// the device share the same memory, and so buffers are created to
+	// use the host memory of the vector directly. Data is then kept
+	// coherent with map/unmap, instead of being copied. This is chosen
+	// automatically, if the device reports unified memory, or can be
+	// forced on or off with the `zerocopy` URL option.
+	bool _zero_copy;
+	void pick_memory_mode(void);
+
+	// Shared Virtual Memory, for OpenCL 2.0 and newer. With the `svm`
+	// URL option, vector storage on the device is obtained with
+	// clSVMAlloc, and bound to kernels as a plain pointer. Fine-grained
+	// SVM is used if the device has it, else coarse-grained.
+	bool _use_svm;
+	bool _svm_fine;
+
+	// Pool of device buffers, bucketed by size. When an OpenclDataValue
+	// is destroyed, its buffer goes back to the pool, and is reused for
+	// later values. This avoids a buffer create and release for every
+	// vector, in every job. Each idle buffer is kept together with the
+	// last command that used it, so that a new owner can wait for it.
+	// Buffers belong to the context they were made in; close() starts
+	// a new `_pool_gen`, and buffers from an old one are not pooled.
+	struct PoolEntry
+	{
+		cl::Buffer buf;
+		cl::Event last;
+		size_t gen;
+	};
+	mutable std::mutex _pool_mtx;
+	std::map<size_t, std::vector<PoolEntry>> _buffer_pool;
+	size_t _pool_max_idle;
+	size_t _pool_hits;
+	size_t _pool_misses;
+	size_t _pool_bytes_idle;
+	size_t _pool_bytes_used;
+	size_t _pool_gen;
+	static size_t bucket_size(size_t);
+	cl::Buffer alloc_buffer(size_t, size_t&, size_t&, cl::Event&);
+	void free_buffer(const cl::Buffer&, size_t, size_t, const cl::Event&);
+	void clear_pool(void);
+	ValuePtr pool_stats(void) const;
+
+	// Pool of kernel objects, by kernel name. A kernel holds its own
+	// argument bindings, so each job needs to have one to itself, for
+	// as long as it is binding and launching. Kernels are created up
+	// front, when the program is loaded, and are handed back when the
+	// job is done with them. Kernels that are lent out are remembered
+	// in `_kernel_lent`, along with the `_kernel_gen` that they were
+	// lent in; close() starts a new generation, and kernels from an old
+	// one are dropped when handed back.
+	std::mutex _kernel_mtx;
+	std::map<std::string, std::vector<cl::Kernel>> _kernel_pool;
+	std::map<cl_kernel, size_t> _kernel_lent;
+	size_t _kernel_gen;
+	void fill_kernel_pool(void);
+	cl::Kernel borrow_kernel(const std::string&);
+	cl::Kernel make_kernel(const std::string&);
+	void return_kernel(const std::string&, const cl::Kernel&);
+
+	// Work-group size autotuning, per kernel and vector length.
+	// Enabled by default; the `tune=0` URL option turns it off.
+	// `_tune_dirty` is set when a new winner is yet to be saved.
+	// See OpenclNode-tune.cc for details.
+	struct TuneEntry
+	{
+		std::vector<size_t> candidates;
+		std::vector<double> best_ns;
+		std::vector<size_t> samples;
+		size_t launches = 0;
+		bool decided = false;
+		size_t winner = 0;
+	};
+	static constexpr size_t NO_TRIAL = (size_t) -1;
+	bool _autotune;
+	std::string _tune_path;
+	std::atomic<bool> _tune_dirty;
+	std::mutex _tune_mtx;
+	std::map<std::pair<std::string, size_t>, TuneEntry> _tune;
+	size_t pick_local_size(const std::string&, const cl::Kernel&,
+	                       size_t, size_t&, size_t&);
+	void tune_result(const std::string&, size_t, size_t, cl_event);
+	void load_tuning(void);
+	void save_tuning(void);
+
+	// Batches of vectors, written as a LinkValue, are laid out in one
+	// shared buffer, and sent with one write. `_base_align` is the
+	// alignment, in bytes, that the device wants for sub-buffers.
+	// See OpenclNode-batch.cc for details.
+	size_t _base_align;
+	void bind_batch(const ValuePtr&);
+	void send_batch(const ValuePtr&, cl::CommandQueue&, cl::Event&);
+	bool send_parent(const std::vector<OpenclFloatValuePtr>&,
+	                 cl::CommandQueue&, std::vector<cl::Event>&);
+	static void CL_CALLBACK free_staging(cl_event, cl_int, void*);
+
+	// Jobs that have been built, keyed by the Section they were built
+	// from. When the same Section is written again, the new job reuses
+	// the kernel and the arguments of the cached one, instead of being
+	// built from scratch. At most `_job_cache_max` are kept.
+	std::mutex _job_mtx;
+	std::map<Handle, OpenclJobValuePtr> _job_cache;
+	size_t _job_cache_max;
+	OpenclJobValuePtr find_job(const Handle&);
+	void cache_job(const OpenclJobValuePtr&);
+	OpenclJobValuePtr make_job(const Handle&);
+
+	// Graphs of jobs, written as a LinkValue of Sections. The jobs are
+	// put in dependency order, and dispatched one by one; the ordering
+	// on the device follows from the buffers that they share.
+	// See OpenclNode-graph.cc
+	struct JobIO
+	{
+		HandleSet ins;
+		HandleSet outs;
+	};
+	JobIO job_io(const Handle&);
+	void write_graph(const ValuePtr&);
 
-	cl::Event _event_handler;
-	cl::Event& get_handler(void) { return _event_handler; }
+	// Streaming input. A Section with a StreamNode, or a QueueValue,
+	// as one of its inputs is run over and over, once for each item
+	// that arrives, by a feeder thread of its own. There are
+	// `_stream_depth` staging vectors per stream, used in rotation.
+	// See OpenclNode-stream.cc
+	size_t _stream_depth;
+	std::mutex _stream_mtx;
+	std::vector<StreamFeedPtr> _feeds;
+	std::vector<std::thread> _feeders;
+	bool start_stream(const Handle&);
+	void feed_stream(const StreamFeedPtr&);
+	ValuePtr next_chunk(const ValuePtr&);
+	void feed_done(const ValuePtr&);
+	void stop_streams(void);
 
-	// Jobs run in their own thread, so that the GPU doesn't block us.
-	void queue_job(const ValuePtr&);
-	async_caller<OpenclNode, ValuePtr> _dispatch_queue;
+	// Reads that don't wait. Finished reads are placed on `_ready`.
+	// See OpenclNode-async.cc
+	QueueValuePtr _ready;
+	static void get_fetchable(const ValuePtr&,
+	                          std::vector<OpenclFloatValuePtr>&);
+	void read_async(const ValuePtr&);
+	static void CL_CALLBACK fetch_done(cl_event, cl_int, void*);
+
+	// Moving vectors off the device. See OpenclNode-memory.cc
+	void evict_value(const ValuePtr&);
+
+	// Device memory budget. Vectors used by jobs are kept in order of
+	// last use, most recent first. When they take up more than
+	// `_mem_budget` bytes, the ones used longest ago are moved back to
+	// the host, and are uploaded again when next used. The budget is
+	// set by the `memory` URL option, else it's a part of the global
+	// memory of the smallest device. Vectors that are gone are put on
+	// `_mem_dead` as they go, and are taken off the list on the next
+	// submit; the vector destructor can't take `_mem_mtx`, as it might
+	// run while that is held.
+	struct Resident
+	{
+		const OpenclDataValue* key;
+		std::weak_ptr<OpenclFloatValue> vec;
+		size_t bytes;
+		bool spilled;
+	};
+	mutable std::mutex _mem_mtx;
+	std::list<Resident> _resident;
+	std::map<const OpenclDataValue*, std::list<Resident>::iterator> _resident_at;
+	size_t _mem_budget;
+	size_t _mem_resident;
+	size_t _mem_spills;
+	size_t _mem_spilled_bytes;
+	size_t _mem_refills;
+	std::mutex _dead_mtx;
+	std::vector<const OpenclDataValue*> _mem_dead;
+	void find_budget(void);
+	static size_t device_bytes(const OpenclFloatValuePtr&);
+	void forget_resident(const OpenclDataValue*);
+	void prune_resident(void);
+	void touch_resident(const OpenclFloatValuePtr&);
+	void keep_resident(const ValuePtr&);
+	void spill(const std::set<const OpenclDataValue*>&);
+	ValuePtr memory_stats(void) const;
+
+	// Profiling. With the `profile` URL option, every upload, kernel
+	// and download is timed by the device, and the times are gathered
+	// up by kernel name, or by the kind of transfer. The events are put
+	// on `_prof_pending` when the command is enqueued, and are looked
+	// at later, once done, so that nothing waits for them.
+	// See OpenclNode-profile.cc
+	struct ProfileEntry
+	{
+		size_t count = 0;
+		std::vector<size_t> hist;
+		double wait_ns = 0;
+		double run_ns = 0;
+		double bytes = 0;
+		double flops = 0;
+	};
+	struct ProfilePending
+	{
+		std::string key;
+		cl::Event ev;
+		size_t bytes;
+		double flops;
+		uint64_t host_ns;
+	};
+	bool _profile;
+	mutable std::mutex _prof_mtx;
+	mutable std::map<std::string, ProfileEntry> _prof;
+	mutable std::vector<ProfilePending> _prof_pending;
+	void profile(const std::string&, const cl::Event&, size_t, double);
+	void add_sample(const std::string&, double, double, size_t,
+	                double) const;
+	void harvest_profile(void) const;
+	void clear_profile(void);
+	ValuePtr profile_stats(void) const;
+
+	// Tracing. With `trace=N`, the last N spans of time, spent in the
+	// dispatch threads, and on the device, are kept in a ring. They
+	// can be had as Chrome trace JSON, to look at with Perfetto or
+	// chrome://tracing. Device spans come from the profiling events,
+	// and so tracing turns on profiling, too. See OpenclNode-trace.cc
+	struct TraceEvent
+	{
+		std::string name;
+		bool device;
+		uint32_t tid;
+		uint64_t start;
+		uint64_t dur;
+		size_t ticket;
+	};
+	static constexpr size_t NO_TICKET = (size_t) -1;
+	size_t _trace_max;
+	std::chrono::steady_clock::time_point _trace_t0;
+	mutable std::mutex _trace_mtx;
+	mutable std::vector<TraceEvent> _trace_ring;
+	mutable size_t _trace_next;
+	mutable std::map<std::thread::id, uint32_t> _trace_tids;
+	uint64_t trace_now(void) const;
+	void trace(const std::string&, uint64_t, uint64_t, size_t,
+	           bool = false, uint32_t = 0) const;
+	ValuePtr trace_json(void) const;
+	void dump_trace(const ValuePtr&);
+
+	// Times the host code from here to the end of the scope.
+	struct TraceSpan
+	{
+		const OpenclNode* node;
+		const char* name;
+		size_t ticket;
+		uint64_t start;
+		TraceSpan(const OpenclNode*, const char*, size_t = NO_TICKET);
+		~TraceSpan();
+	};
+
+	// Warm-up. With `async=1`, open() returns at once, and the device
+	// is opened and the program built by `_opener`. Jobs wait for it
+	// in the dispatch threads, in wait_open().
+	bool _open_async;
+	std::atomic<bool> _open_done;
+	std::string _open_error;
+	mutable std::mutex _open_mtx;
+	std::condition_variable _open_cv;
+	std::thread _opener;
+	void connect(void);
+	void finish_open(void);
+	void wait_open(void);
+	ValuePtr open_status(void) const;
+
+	// Jobs run in their own threads, so that the GPU doesn't block us.
+	// There is one dispatch thread per lane. Each item on the dispatch
+	// queue carries a ticket, so that the dispatch threads hand work
+	// to the device in the same order that it was written, even though
+	// the jobs are built concurrently.
+	struct Dispatch
+	{
+		ValuePtr vp;
+		size_t ticket;
+		uint64_t when;
+	};
+	std::mutex _ticket_mtx;
+	size_t _next_ticket;
+	size_t _now_serving;
+	std::mutex _turn_mtx;
+	std::condition_variable _turn_cv;
+	void wait_turn(size_t);
+	void end_turn(void);
+
+	void dispatch(const ValuePtr&);
+	void queue_job(const Dispatch&);
+	void prepare_job(const ValuePtr&);
+	void submit_job(const ValuePtr&);
+	std::unique_ptr<async_caller<OpenclNode, Dispatch>> _dispatch_queue;
+
+	// Pipelined dispatch. The dispatch thread does not wait for jobs
+	// to finish; instead, each job is chained to its uploads with
+	// event wait-lists, and an event callback places the completed
+	// job on the QueueValue. At most `_max_inflight` jobs may be
+	// outstanding on the device at any given time; the dispatch thread
+	// blocks only when this window is full.
+	size_t _max_inflight;
+	size_t _num_inflight;
+	std::mutex _inflight_mtx;
+	std::condition_variable _inflight_cv;
+	void acquire_slot(void);
+	void release_slot(void);
+	void drain(void);
+	void in_flight(const ValuePtr&, cl::Event&, size_t);
+	void report(const ValuePtr&);
+	static void CL_CALLBACK job_done(cl_event, cl_int, void*);
+
+	// The number of jobs outstanding on each device, and the size of
+	// each device, in compute units. These are guarded by the same
+	// lock as the in-flight window. Element-wise jobs at least
+	// `_split_min` long are split across all of the lanes, in
+	// proportion to the size of their devices. See OpenclNode-multi.cc
+	std::vector<size_t> _dev_load;
+	std::vector<size_t> _dev_weight;
+	size_t _split_min;
+	void find_weights(void);
+	std::vector<std::pair<size_t, size_t>> split_range(size_t);
+
+	// Merged launches. Short element-wise jobs, written one after the
+	// other for the same kernel, are held back and run as one launch,
+	// laid end to end, instead of paying the launch overhead for each.
+	// At most `_merge_max` jobs, with at most `_merge_len` elements in
+	// all, go into one launch. `_merging` is only touched by whoever
+	// holds the current dispatch ticket. See OpenclNode-merge.cc
+	struct MergeGroup;
+	size_t _merge_max;
+	size_t _merge_len;
+	std::shared_ptr<MergeGroup> _merging;
+	bool can_merge(const OpenclJobValuePtr&) const;
+	bool merge_job(const OpenclJobValuePtr&);
+	void flush_merge(void);
+	void launch_merged(const std::shared_ptr<MergeGroup>&, bool&, bool&);
+	void end_merge_turn(size_t);
+	static void CL_CALLBACK merge_done(cl_event, cl_int, void*);
+	void launch_job(const OpenclJobValuePtr&);
 
 	QueueValuePtr _qvp;
 	virtual void open(const ValuePtr&);
@@ -108,6 +540,24 @@ public:
 	OpenclNode(Type t, const std::string&&);
 	virtual ~OpenclNode();
 
+	// Status reporting, in addition to the usual StreamNode messages.
+	//    (Predicate "*-buffer-pool-*") -- FloatValue holding pool hits,
+	//        misses, bytes in use and bytes sitting idle in the pool.
+	//    (Predicate "*-read-async-*") -- QueueValue holding the results
+	//        of asynchronous reads, as they arrive.
+	//    (Predicate "*-cache-stats-*") -- FloatValue holding program
+	//        cache hits, misses and evictions.
+	virtual ValuePtr getValue(const Handle&) const;
+
+	// Messages, in addition to the usual StreamNode messages.
+	//    (Predicate "*-read-async-*") -- run the given Section, or
+	//        download the given vectors, without waiting.
+	//    (Predicate "*-evict-*") -- move the given vectors off the
+	//        device, back to the host.
+	//    (Predicate "*-stats-*") -- clear the profile.
+	//    (Predicate "*-trace-*") -- write the trace to the given file.
+	virtual void setValue(const Handle&, const ValuePtr&);
+
 	static Handle factory(const Handle&);
 };
 
@@ -0,0 +1,303 @@
+/*
+ * opencog/atoms/opencl/Reductions.cc
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/opencl/Reductions.h>
+
+using namespace opencog;
+
+static const Reduction reductions[] =
+{
+	{"reduce_sum",    "rsum_partial",   "rsum_final",  1, 1},
+	{"reduce_dot",    "rdot_partial",   "rsum_final",  1, 2},
+	{"reduce_max",    "rmax_partial",   "rmax_final",  1, 1},
+	{"reduce_norm",   "rsumsq_partial", "rsqrt_final", 1, 1},
+	{"reduce_cosine", "rcos_partial",   "rcos_final",  3, 2},
+};
+
+const Reduction* opencog::find_reduction(const std::string& name)
+{
+	for (const Reduction& red : reductions)
+		if (0 == name.compare(red.name)) return &red;
+	return nullptr;
+}
+
+/// True if the kernel is one of the stages of some reduction.
+bool opencog::is_reduction_kernel(const std::string& kname)
+{
+	for (const Reduction& red : reductions)
+		if (0 == kname.compare(red.stage1) or 0 == kname.compare(red.stage2))
+			return true;
+	return false;
+}
+
+// All of the first-stage kernels have the signature
+//    (global double *part, global const double *a, [b,]
+//     local double *scratch, const unsigned long n)
+// and write `width` partial results per work-group to `part`. The
+// second-stage kernels have the signature
+//    (global double *out, global const double *part,
+//     local double *scratch, const unsigned long ngroups)
+// and are run as a single work-group. The work-group size must be a
+// power of two.
+static const std::string preamble = R"(
+#if defined(cl_khr_fp64)
+#  pragma OPENCL EXTENSION cl_khr_fp64: enable
+#elif defined(cl_amd_fp64)
+#  pragma OPENCL EXTENSION cl_amd_fp64: enable
+#else
+#  error double precision is not supported
+#endif
+
+#if defined(cl_khr_subgroups)
+#  pragma OPENCL EXTENSION cl_khr_subgroups: enable
+#  define HAVE_SUBGROUPS 1
+#elif defined(__opencl_c_subgroups)
+#  define HAVE_SUBGROUPS 1
+#endif
+
+// Reduce across the work-group. The result is returned to work-item 0.
+// The leading barrier allows the scratch area to be reused right away.
+#ifdef HAVE_SUBGROUPS
+#define GROUP_REDUCE(NAME, OP, SGOP)                                 \
+double NAME(double v, local double *scratch)                        \
+{                                                                   \
+	barrier(CLK_LOCAL_MEM_FENCE);                                   \
+	v = SGOP(v);                                                    \
+	if (0 == get_sub_group_local_id())                              \
+		scratch[get_sub_group_id()] = v;                            \
+	barrier(CLK_LOCAL_MEM_FENCE);                                   \
+	if (0 == get_local_id(0))                                       \
+	{                                                               \
+		v = scratch[0];                                             \
+		for (uint i = 1; i < get_num_sub_groups(); i++)             \
+			v = OP(v, scratch[i]);                                  \
+	}                                                               \
+	return v;                                                       \
+}
+#else
+#define GROUP_REDUCE(NAME, OP, SGOP)                                 \
+double NAME(double v, local double *scratch)                        \
+{                                                                   \
+	size_t lid = get_local_id(0);                                   \
+	barrier(CLK_LOCAL_MEM_FENCE);                                   \
+	scratch[lid] = v;                                               \
+	barrier(CLK_LOCAL_MEM_FENCE);                                   \
+	for (size_t s = get_local_size(0)/2; 0 < s; s >>= 1)            \
+	{                                                               \
+		if (lid < s)                                                \
+			scratch[lid] = OP(scratch[lid], scratch[lid+s]);        \
+		barrier(CLK_LOCAL_MEM_FENCE);                               \
+	}                                                               \
+	return scratch[0];                                              \
+}
+#endif
+
+#define ADD(a,b) ((a)+(b))
+GROUP_REDUCE(group_sum, ADD, sub_group_reduce_add)
+GROUP_REDUCE(group_max, fmax, sub_group_reduce_max)
+)";
+
+static const std::string kernels = R"(
+// ------------------------------------------------------------------
+// First stage.
+
+kernel void rsum_partial(global double *part,
+                         global const double *a,
+                         local double *scratch,
+                         const unsigned long n)
+{
+	double acc = 0.0;
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0))
+		acc += a[i];
+	acc = group_sum(acc, scratch);
+	if (0 == get_local_id(0)) part[get_group_id(0)] = acc;
+}
+
+kernel void rdot_partial(global double *part,
+                         global const double *a,
+                         global const double *b,
+                         local double *scratch,
+                         const unsigned long n)
+{
+	double acc = 0.0;
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0))
+		acc += a[i] * b[i];
+	acc = group_sum(acc, scratch);
+	if (0 == get_local_id(0)) part[get_group_id(0)] = acc;
+}
+
+kernel void rsumsq_partial(global double *part,
+                           global const double *a,
+                           local double *scratch,
+                           const unsigned long n)
+{
+	double acc = 0.0;
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0))
+		acc += a[i] * a[i];
+	acc = group_sum(acc, scratch);
+	if (0 == get_local_id(0)) part[get_group_id(0)] = acc;
+}
+
+kernel void rmax_partial(global double *part,
+                         global const double *a,
+                         local double *scratch,
+                         const unsigned long n)
+{
+	double acc = -INFINITY;
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0))
+		acc = fmax(acc, a[i]);
+	acc = group_max(acc, scratch);
+	if (0 == get_local_id(0)) part[get_group_id(0)] = acc;
+}
+
+// Three partial sums: a.b, a.a and b.b
+kernel void rcos_partial(global double *part,
+                         global const double *a,
+                         global const double *b,
+                         local double *scratch,
+                         const unsigned long n)
+{
+	double ab = 0.0;
+	double aa = 0.0;
+	double bb = 0.0;
+	for (size_t i = get_global_id(0); i < n; i += get_global_size(0))
+	{
+		ab += a[i] * b[i];
+		aa += a[i] * a[i];
+		bb += b[i] * b[i];
+	}
+	ab = group_sum(ab, scratch);
+	aa = group_sum(aa, scratch);
+	bb = group_sum(bb, scratch);
+	if (0 == get_local_id(0))
+	{
+		size_t g = get_group_id(0);
+		part[3*g] = ab;
+		part[3*g+1] = aa;
+		part[3*g+2] = bb;
+	}
+}
+
+// ------------------------------------------------------------------
+// Second stage.
+
+kernel void rsum_final(global double *out,
+                       global const double *part,
+                       local double *scratch,
+                       const unsigned long ngroups)
+{
+	double acc = 0.0;
+	for (size_t i = get_local_id(0); i < ngroups; i += get_local_size(0))
+		acc += part[i];
+	acc = group_sum(acc, scratch);
+	if (0 == get_local_id(0)) out[0] = acc;
+}
+
+kernel void rsqrt_final(global double *out,
+                        global const double *part,
+                        local double *scratch,
+                        const unsigned long ngroups)
+{
+	double acc = 0.0;
+	for (size_t i = get_local_id(0); i < ngroups; i += get_local_size(0))
+		acc += part[i];
+	acc = group_sum(acc, scratch);
+	if (0 == get_local_id(0)) out[0] = sqrt(acc);
+}
+
+kernel void rmax_final(global double *out,
+                       global const double *part,
+                       local double *scratch,
+                       const unsigned long ngroups)
+{
+	double acc = -INFINITY;
+	for (size_t i = get_local_id(0); i < ngroups; i += get_local_size(0))
+		acc = fmax(acc, part[i]);
+	acc = group_max(acc, scratch);
+	if (0 == get_local_id(0)) out[0] = acc;
+}
+
+kernel void rcos_final(global double *out,
+                       global const double *part,
+                       local double *scratch,
+                       const unsigned long ngroups)
+{
+	double ab = 0.0;
+	double aa = 0.0;
+	double bb = 0.0;
+	for (size_t i = get_local_id(0); i < ngroups; i += get_local_size(0))
+	{
+		ab += part[3*i];
+		aa += part[3*i+1];
+		bb += part[3*i+2];
+	}
+	ab = group_sum(ab, scratch);
+	aa = group_sum(aa, scratch);
+	bb = group_sum(bb, scratch);
+	if (0 == get_local_id(0))
+		out[0] = (0.0 < aa*bb) ? ab / sqrt(aa*bb) : 0.0;
+}
+)";
+
+/// The pragmas and the group_sum() and group_max() helpers, for use
+/// by other programs that reduce; see FusedKernel.cc
+const std::string& opencog::reduction_preamble(void)
+{
+	return preamble;
+}
+
+const std::string& opencog::reduction_source(void)
+{
+	static const std::string source = preamble + kernels;
+	return source;
+}
+
+/// The interface of a reduction taking `num_inputs` vectors, in the
+/// same format as those made by GenIDL.
+Handle opencog::reduction_iface(size_t num_inputs)
+{
+	Handle fv_type = createNode(TYPE_NODE, "FloatValue");
+	HandleSeq cons{createLink(CONNECTOR, fv_type,
+		createNode(SEX_NODE, "reduce"))};
+
+	Handle in_cnctr = createLink(CONNECTOR, fv_type,
+		createNode(SEX_NODE, "input"));
+	for (size_t i = 0; i < num_inputs; i++)
+		cons.push_back(in_cnctr);
+
+	cons.push_back(createLink(CONNECTOR, fv_type,
+		createNode(SEX_NODE, "scalar")));
+	return createLink(std::move(cons), CONNECTOR_SEQ);
+}
+
+/// Interface descriptions for all of the reductions.
+HandleSeq opencog::reduction_idl(void)
+{
+	HandleSeq sects;
+	for (const Reduction& red : reductions)
+		sects.push_back(createLink(SECTION,
+			createNode(ITEM_NODE, red.name),
+			reduction_iface(red.num_inputs)));
+	return sects;
+}
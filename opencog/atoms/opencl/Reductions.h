@@ -0,0 +1,84 @@
+/*
+ * opencog/atoms/opencl/Reductions.h
+ *
+ * Copyright (C) 2026 Linas Vepstas
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_OPENCL_REDUCTIONS_H
+#define _OPENCOG_OPENCL_REDUCTIONS_H
+
+#include <string>
+#include <opencog/atoms/base/Handle.h>
+
+namespace opencog
+{
+
+/** \addtogroup grp_atomspace
+ *  @{
+ */
+
+/**
+ * Built-in library of reductions: kernels that take one or two long
+ * vectors, and return a single number. These are
+ *
+ *     reduce_sum     -- sum of all elements of a vector
+ *     reduce_dot     -- dot product of two vectors
+ *     reduce_max     -- largest element of a vector
+ *     reduce_norm    -- Euclidean (L2) length of a vector
+ *     reduce_cosine  -- cosine of the angle between two vectors
+ *
+ * They are called from Atomese just like any other kernel, e.g.
+ *
+ *     (Section
+ *         (Item "reduce_dot")
+ *         (ConnectorSeq
+ *             (Number 0)            ; result goes here
+ *             (Number 1 2 3 4 5)
+ *             (Number 1 1 1 2 2)))
+ *
+ * The interface of these marks the result with (Sex "reduce"); its
+ * length is one, and does not count when the vector length is found.
+ *
+ * Each reduction runs in two stages. In the first, each work-group
+ * reduces its part of the vectors to one partial result. In the
+ * second, a single work-group reduces the partial results. Within a
+ * work-group, the reduction is a tree in local memory, or uses
+ * sub-group operations, if the device has them. Only the final
+ * result ever goes back to the host.
+ */
+struct Reduction
+{
+	const char* name;     // Name, as used in Atomese
+	const char* stage1;   // First-stage kernel
+	const char* stage2;   // Second-stage kernel
+	size_t width;         // Number of partial results per work-group
+	size_t num_inputs;    // Number of input vectors
+};
+
+const Reduction* find_reduction(const std::string&);
+bool is_reduction_kernel(const std::string&);
+const std::string& reduction_source(void);
+const std::string& reduction_preamble(void);
+Handle reduction_iface(size_t num_inputs);
+HandleSeq reduction_idl(void);
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_OPENCL_REDUCTIONS_H
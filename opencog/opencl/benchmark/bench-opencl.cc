@@ -0,0 +1,369 @@
+/**
+ * bench-opencl.cc
+ *
+ * Throughput benchmark for the Atomese OpenCL path.
+ *
+ * The same job, an element-wise product of two vectors, is run two
+ * ways: first with the raw OpenCL API, as in the scaffolding demos,
+ * and then through an OpenclNode, with the vectors in the AtomSpace.
+ * The difference is the cost of the Atomese layer. Vector sizes,
+ * numbers of jobs, and the number of jobs written before waiting for
+ * the results (the batch) are swept over. Results are written out as
+ * CSV, one line per run, so that they can be compared from one build
+ * to the next. See README.md
+ *
+ * Copyright (c) 2026 Linas Vepstas
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/atoms/value/FloatValue.h>
+#include <opencog/atoms/value/LinkValue.h>
+#include <opencog/atoms/value/StringValue.h>
+#include <opencog/atoms/opencl/OpenclFloatValue.h>
+#include <opencog/atoms/opencl/opencl-headers.h>
+#include <opencog/opencl/types/atom_types.h>
+
+using namespace opencog;
+
+// One line of results.
+struct Result
+{
+	const char* api;
+	size_t size;
+	size_t jobs;
+	size_t batch;
+	double seconds;
+	double upload_us;
+	double kernel_us;
+	double download_us;
+	double overhead_us;
+};
+
+static double now(void)
+{
+	return std::chrono::duration<double>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::vector<size_t> parse_list(const char* arg)
+{
+	std::vector<size_t> vals;
+	std::string str(arg);
+	size_t pos = 0;
+	while (pos < str.size())
+	{
+		size_t comma = str.find(',', pos);
+		if (std::string::npos == comma) comma = str.size();
+		vals.push_back((size_t) atof(str.substr(pos, comma-pos).c_str()));
+		pos = comma + 1;
+	}
+	return vals;
+}
+
+// ---------------------------------------------------------------
+// Raw OpenCL, as in the scaffolding demos.
+
+static cl::Device pick_device(const std::string& plat,
+                              const std::string& dev)
+{
+	std::vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+	for (const cl::Platform& p : platforms)
+	{
+		if (p.getInfo<CL_PLATFORM_NAME>().find(plat) == std::string::npos)
+			continue;
+		std::vector<cl::Device> devices;
+		p.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		for (const cl::Device& d : devices)
+			if (d.getInfo<CL_DEVICE_NAME>().find(dev) != std::string::npos)
+				return d;
+	}
+	fprintf(stderr, "No OpenCL device matching \"%s:%s\"\n",
+		plat.c_str(), dev.c_str());
+	exit(1);
+}
+
+static double elapsed_us(const cl::Event& ev)
+{
+	cl_ulong start = ev.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	cl_ulong end = ev.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+	return 1.0e-3 * (double) (end - start);
+}
+
+static Result run_raw(cl::Device& dev, cl::Context& ctxt,
+                      cl::Program& prog, size_t size, size_t jobs,
+                      size_t batch)
+{
+	size_t nbytes = size * sizeof(double);
+	std::vector<double> a(size, 2.0);
+	std::vector<double> b(size, 3.0);
+	std::vector<double> prod(size);
+
+	cl::CommandQueue queue(ctxt, dev, CL_QUEUE_PROFILING_ENABLE);
+	cl::Buffer veca(ctxt, CL_MEM_READ_ONLY, nbytes);
+	cl::Buffer vecb(ctxt, CL_MEM_READ_ONLY, nbytes);
+	cl::Buffer vecprod(ctxt, CL_MEM_READ_WRITE, nbytes);
+
+	cl::Kernel kernel(prog, "vec_mult");
+	kernel.setArg(0, vecprod);
+	kernel.setArg(1, veca);
+	kernel.setArg(2, vecb);
+	kernel.setArg(3, (cl_ulong) size);
+
+	Result res{"raw", size, jobs, batch, 0, 0, 0, 0, 0};
+	double start = now();
+	for (size_t done = 0; done < jobs; )
+	{
+		std::vector<cl::Event> up, run, down;
+		for (size_t i = 0; i < batch and done < jobs; i++, done++)
+		{
+			up.emplace_back();
+			queue.enqueueWriteBuffer(veca, CL_FALSE, 0, nbytes,
+				a.data(), nullptr, &up.back());
+			up.emplace_back();
+			queue.enqueueWriteBuffer(vecb, CL_FALSE, 0, nbytes,
+				b.data(), nullptr, &up.back());
+			run.emplace_back();
+			queue.enqueueNDRangeKernel(kernel, cl::NullRange,
+				cl::NDRange(size), cl::NullRange, nullptr, &run.back());
+		}
+
+		// The product is read once per batch, as in run_atomese().
+		down.emplace_back();
+		queue.enqueueReadBuffer(vecprod, CL_FALSE, 0, nbytes,
+			prod.data(), nullptr, &down.back());
+		queue.finish();
+
+		for (const cl::Event& ev : up) res.upload_us += elapsed_us(ev);
+		for (const cl::Event& ev : run) res.kernel_us += elapsed_us(ev);
+		for (const cl::Event& ev : down) res.download_us += elapsed_us(ev);
+	}
+	res.seconds = now() - start;
+
+	if (6.0 != prod[size-1])
+		fprintf(stderr, "Raw result is wrong: %f\n", prod[size-1]);
+
+	// Two uploads per job.
+	res.upload_us /= (double) jobs;
+	res.kernel_us /= (double) jobs;
+	res.download_us /= (double) jobs;
+	return res;
+}
+
+// ---------------------------------------------------------------
+// The same thing, through an OpenclNode.
+
+// Mean run time, in microseconds, of the named entry of *-stats-*
+static double stage_us(const ValuePtr& stats, const std::string& name)
+{
+	for (const ValuePtr& ent : LinkValueCast(stats)->value())
+	{
+		const ValueSeq& pr = LinkValueCast(ent)->value();
+		if (StringValueCast(pr[0])->value()[0] != name) continue;
+		const std::vector<double>& nums = FloatValueCast(pr[1])->value();
+		return nums[0] * nums[4];
+	}
+	return 0.0;
+}
+
+static Result run_atomese(AtomSpacePtr& as, const Handle& clnode,
+                          size_t size, size_t jobs, size_t batch)
+{
+	Handle write = as->add_node(PREDICATE_NODE, "*-write-*");
+	Handle read = as->add_node(PREDICATE_NODE, "*-read-*");
+	Handle stats = as->add_node(PREDICATE_NODE, "*-stats-*");
+
+	Handle anchor = as->add_node(ANCHOR_NODE, "bench");
+	Handle ka = as->add_node(PREDICATE_NODE, "a");
+	Handle kb = as->add_node(PREDICATE_NODE, "b");
+	Handle kprod = as->add_node(PREDICATE_NODE, "prod");
+
+	std::vector<double> a(size, 2.0);
+	std::vector<double> b(size, 3.0);
+	anchor->setValue(kprod, createOpenclFloatValue(size));
+
+	Handle sect = as->add_link(SECTION,
+		as->add_node(ITEM_NODE, "vec_mult"),
+		as->add_link(CONNECTOR_SEQ,
+			as->add_link(VALUE_OF_LINK, anchor, kprod),
+			as->add_link(VALUE_OF_LINK, anchor, ka),
+			as->add_link(VALUE_OF_LINK, anchor, kb)));
+
+	clnode->setValue(stats, createFloatValue(0.0));
+
+	Result res{"atomese", size, jobs, batch, 0, 0, 0, 0, 0};
+	double start = now();
+	for (size_t done = 0; done < jobs; )
+	{
+		size_t n = 0;
+		for (; n < batch and done < jobs; n++, done++)
+		{
+			// Fresh inputs, as a stream of data would have.
+			anchor->setValue(ka, createOpenclFloatValue(a));
+			anchor->setValue(kb, createOpenclFloatValue(b));
+			clnode->setValue(write, sect);
+		}
+		for (size_t i = 0; i < n; i++)
+			clnode->getValue(read);
+
+		// Look at the product, so that it is downloaded.
+		FloatValueCast(anchor->getValue(kprod))->value();
+	}
+	res.seconds = now() - start;
+
+	const std::vector<double>& prod =
+		FloatValueCast(anchor->getValue(kprod))->value();
+	if (6.0 != prod[size-1])
+		fprintf(stderr, "Atomese result is wrong: %f\n", prod[size-1]);
+
+	ValuePtr sv = clnode->getValue(stats);
+	res.upload_us = stage_us(sv, "*-upload-*") / (double) jobs;
+	res.kernel_us = stage_us(sv, "vec_mult") / (double) jobs;
+	res.download_us = stage_us(sv, "*-download-*") / (double) jobs;
+	return res;
+}
+
+// ---------------------------------------------------------------
+
+static void print_header(FILE* fh)
+{
+	fprintf(fh, "api,size,jobs,batch,seconds,jobs_per_sec,us_per_job,"
+		"upload_us,kernel_us,download_us,overhead_us\n");
+}
+
+static void print_result(FILE* fh, const Result& res)
+{
+	double us = 1.0e6 * res.seconds / (double) res.jobs;
+	fprintf(fh, "%s,%zu,%zu,%zu,%.6f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f\n",
+		res.api, res.size, res.jobs, res.batch, res.seconds,
+		(double) res.jobs / res.seconds, us,
+		res.upload_us, res.kernel_us, res.download_us, res.overhead_us);
+	fflush(fh);
+}
+
+static void usage(const char* prog)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  -p NAME    OpenCL platform name, or part of it\n"
+		"  -d NAME    OpenCL device name, or part of it\n"
+		"  -k FILE    kernel source; default vec-mult.cl\n"
+		"  -s LIST    vector sizes; default 1e2,1e3,...,1e8\n"
+		"  -j LIST    numbers of jobs; default 100\n"
+		"  -b LIST    batch sizes; default 1,8,32\n"
+		"  -o FILE    also write the CSV to FILE\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+	std::string plat, dev;
+	std::string kfile = "vec-mult.cl";
+	std::vector<size_t> sizes{100, 1000, 10000, 100000,
+		1000000, 10000000, 100000000};
+	std::vector<size_t> jobs{100};
+	std::vector<size_t> batches{1, 8, 32};
+	const char* outfile = nullptr;
+
+	int c;
+	while (-1 != (c = getopt(argc, argv, "p:d:k:s:j:b:o:h")))
+	{
+		switch (c)
+		{
+			case 'p': plat = optarg; break;
+			case 'd': dev = optarg; break;
+			case 'k': kfile = optarg; break;
+			case 's': sizes = parse_list(optarg); break;
+			case 'j': jobs = parse_list(optarg); break;
+			case 'b': batches = parse_list(optarg); break;
+			case 'o': outfile = optarg; break;
+			default: usage(argv[0]);
+		}
+	}
+
+	// The kernel file must be given as an absolute path to the
+	// OpenclNode.
+	char* kpath = realpath(kfile.c_str(), nullptr);
+	if (nullptr == kpath)
+	{
+		fprintf(stderr, "Can't find the kernel file \"%s\"\n", kfile.c_str());
+		exit(1);
+	}
+	kfile = kpath;
+	free(kpath);
+
+	FILE* csv = nullptr;
+	if (outfile) csv = fopen(outfile, "w");
+	print_header(stdout);
+	if (csv) print_header(csv);
+
+	// The raw baseline.
+	cl::Device ocldev = pick_device(plat, dev);
+	fprintf(stderr, "Will use: %s\n", ocldev.getInfo<CL_DEVICE_NAME>().c_str());
+	cl::Context ctxt(ocldev);
+
+	std::ifstream kstream(kfile);
+	std::string src((std::istreambuf_iterator<char>(kstream)),
+		std::istreambuf_iterator<char>());
+	cl::Program prog(ctxt, src);
+	prog.build();
+
+	// Three vectors per job; skip sizes that won't fit.
+	size_t max_alloc = ocldev.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+	size_t global = ocldev.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+
+	AtomSpacePtr as = createAtomSpace();
+	Handle open = as->add_node(PREDICATE_NODE, "*-open-*");
+	Handle ftype = as->add_node(TYPE_NODE, "FloatValue");
+
+	for (size_t batch : batches)
+	{
+		// One node per batch size, with room for the whole batch to
+		// be in flight.
+		std::string url = "opencl://" + plat + ":" + dev + kfile +
+			"?profile=1&tune=0&inflight=" +
+			std::to_string(std::max(batch, (size_t) 1));
+		Handle clnode = as->add_node(OPENCL_NODE, std::move(url));
+		clnode->setValue(open, ftype);
+
+		for (size_t size : sizes)
+		{
+			size_t nbytes = size * sizeof(double);
+			if (0 == size or max_alloc < nbytes or global < 4 * nbytes)
+			{
+				fprintf(stderr, "Skipping size %zu; it doesn't fit\n", size);
+				continue;
+			}
+			for (size_t njobs : jobs)
+			{
+				if (0 == njobs or 0 == batch) continue;
+				Result raw = run_raw(ocldev, ctxt, prog, size, njobs, batch);
+				Result ato = run_atomese(as, clnode, size, njobs, batch);
+				ato.overhead_us = 1.0e6 * (ato.seconds - raw.seconds) /
+					(double) njobs;
+
+				print_result(stdout, raw);
+				print_result(stdout, ato);
+				if (csv)
+				{
+					print_result(csv, raw);
+					print_result(csv, ato);
+				}
+			}
+		}
+	}
+
+	if (csv) fclose(csv);
+	return 0;
+}
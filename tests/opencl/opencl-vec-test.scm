@@ -70,6 +70,16 @@
 (format #t "Result out-m1=~A" out-m1)
 (test-assert "mult one" (equal? (FloatValue 2 4 6 8 10) out-m1))
 
+; ---------------------------------------------------------------
+; Run the very same Section again. This reuses the job built above.
+(cog-execute! kernel-runner)
+(define kern-m2
+	(cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(define out-m2 (cog-value-ref (cog-value-ref kern-m2 1) 0))
+(format #t "Result out-m2=~A" out-m2)
+(test-assert "mult again" (equal? (FloatValue 2 4 6 8 10) out-m2))
+(test-assert "mult fresh output" (not (eq? out-m1 out-m2)))
+
 ; ---------------------------------------------------------------
 ; Run it again, different data
 (define krun-2
@@ -112,6 +122,204 @@
 (test-assert "mult five"
 	(equal? (FloatValue 3 5 7 9 11 11 11 11 11 11 11) out-m5))
 
+; ---------------------------------------------------------------
+; Fixed work-group size. The global size gets padded to 8.
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "vec_add")
+			(ConnectorSeq
+				(Number 0 0 0 0 0)
+				(Number 1 2 3 4 5)
+				(Number 2 3 4 5 6)
+				(Connector (Predicate "work-group-size") (Number 4))))))
+(define kern-m6
+	(cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(define out-m6 (cog-value-ref (cog-value-ref kern-m6 1) 0))
+(format #t "Result out-m6=~A" out-m6)
+(test-assert "wgs add" (equal? (FloatValue 3 5 7 9 11) out-m6))
+
+; ---------------------------------------------------------------
+; Single precision. Small integers survive the round trip exactly.
+(define krun-4
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "vec_mult_f32")
+			(ConnectorSeq
+				(Number 0 0 0 0 0)
+				(Number 1 2 3 4 5)
+				(Number 2 3 4 5 6)))))
+
+(cog-execute! krun-4)
+(define kern-m7
+	(cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(define args-m7 (cog-value-ref kern-m7 1))
+(define out-m7 (cog-value-ref args-m7 0))
+(format #t "Result out-m7=~A" out-m7)
+(test-assert "f32 type" (equal? 'OpenclFloat32Value (cog-type out-m7)))
+(test-assert "mult f32"
+	(equal? (list 2.0 6.0 12.0 20.0 30.0) (cog-value->list out-m7)))
+
+; ---------------------------------------------------------------
+; Matrix product, on a 2-D range. A 2x3 matrix times a 3x2 matrix;
+; the result is stored with a stride of 3, so one column is padding.
+(cog-execute!
+	(SetValue clnode (Predicate "*-write-*")
+		(Section
+			(Item "mat_mult_f32")
+			(ConnectorSeq
+				(Connector (Number 2 2 3) (Number 0))
+				(Connector (Number 2 3) (Number 1 2 3 4 5 6))
+				(Connector (Number 3 2) (Number 7 8 9 10 11 12))
+				(Connector (Number 2)) (Connector (Number 2)) (Connector (Number 3))
+				(Connector (Number 3)) (Connector (Number 2)) (Connector (Number 3))))))
+(define mat-out (cog-value-ref (cog-value-ref
+	(cog-execute! (ValueOf clnode (Predicate "*-read-*"))) 1) 0))
+(format #t "Result mat-out=~A" mat-out)
+(test-assert "mat mult"
+	(equal? (list 58.0 64.0 0.0 139.0 154.0 0.0) (cog-value->list mat-out)))
+
+; ---------------------------------------------------------------
+; Write several vectors in one batch; they come back as one batch.
+; None are all zeros, so that none are lazy, and all go in the one
+; write to their shared buffer.
+(define bat-a (OpenclFloatValue 1 2 3 4))
+(define bat-b (OpenclFloatValue 5 6 7 8))
+(define bat-sum (OpenclFloatValue 9 9 9 9))
+(cog-set-value! clnode (Predicate "*-write-*")
+	(LinkValue bat-a bat-b bat-sum))
+(define batch-back (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(test-assert "batch type" (cog-subtype? 'LinkValue (cog-type batch-back)))
+(test-assert "batch size" (equal? 3 (length (cog-value->list batch-back))))
+(test-assert "batch members" (equal? (list bat-a bat-b bat-sum)
+	(cog-value->list batch-back)))
+
+; Use the batch-written vectors in a kernel.
+(cog-set-value! (Anchor "batch") (Predicate "a") bat-a)
+(cog-set-value! (Anchor "batch") (Predicate "b") bat-b)
+(cog-set-value! (Anchor "batch") (Predicate "sum") bat-sum)
+(cog-set-value! clnode (Predicate "*-write-*")
+	(Section (Item "vec_add")
+		(ConnectorSeq
+			(ValueOf (Anchor "batch") (Predicate "sum"))
+			(ValueOf (Anchor "batch") (Predicate "a"))
+			(ValueOf (Anchor "batch") (Predicate "b")))))
+(cog-execute! (ValueOf clnode (Predicate "*-read-*")))
+(test-assert "batch add"
+	(equal? (list 6.0 8.0 10.0 12.0) (cog-value->list bat-sum)))
+(test-assert "batch inputs"
+	(equal? (list 1.0 2.0 3.0 4.0 5.0 6.0 7.0 8.0)
+		(append (cog-value->list bat-a) (cog-value->list bat-b))))
+
+; ---------------------------------------------------------------
+; Reductions from the built-in library. Only the one number comes back.
+(define (run-reduce kname . vecs)
+	(cog-execute!
+		(SetValue clnode (Predicate "*-write-*")
+			(Section (Item kname) (ConnectorSeq (Number 0) vecs))))
+	(define res (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+	(cog-value-ref (cog-value-ref res 1) 0))
+
+(define dot-out (run-reduce "reduce_dot" (Number 1 2 3 4 5) (Number 1 1 1 2 2)))
+(format #t "Result dot=~A" dot-out)
+(test-assert "dot size" (equal? 1 (length (cog-value->list dot-out))))
+(test-assert "dot" (equal? 24.0 (cog-value-ref dot-out 0)))
+
+; Run it again; this time the job is cached.
+(test-assert "dot again" (equal? 24.0 (cog-value-ref
+	(run-reduce "reduce_dot" (Number 1 2 3 4 5) (Number 1 1 1 2 2)) 0)))
+
+(test-assert "sum" (equal? 15.0 (cog-value-ref
+	(run-reduce "reduce_sum" (Number 1 2 3 4 5)) 0)))
+(test-assert "max" (equal? 7.0 (cog-value-ref
+	(run-reduce "reduce_max" (Number 1 -2 7 4 5)) 0)))
+(test-assert "norm" (equal? 5.0 (cog-value-ref
+	(run-reduce "reduce_norm" (Number 3 4)) 0)))
+(test-assert "cosine" (< (abs (- (cog-value-ref
+	(run-reduce "reduce_cosine" (Number 1 2 3) (Number 2 4 6)) 0) 1.0)) 1e-12))
+
+; Long enough to need many work-groups.
+(define long-len 100000)
+(cog-set-value! (Anchor "reduce") (Predicate "ones")
+	(FloatValue (make-list long-len 1)))
+(test-assert "long sum" (equal? (exact->inexact long-len) (cog-value-ref
+	(run-reduce "reduce_sum" (ValueOf (Anchor "reduce") (Predicate "ones")))
+	0)))
+
+; ---------------------------------------------------------------
+; Kernels generated from Atomese arithmetic.
+(define (run-fused body out . vecs)
+	(cog-execute!
+		(SetValue clnode (Predicate "*-write-*")
+			(Section
+				(Lambda (VariableList (Variable "a") (Variable "b")) body)
+				(ConnectorSeq out vecs))))
+	(define res (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+	(cog-value-ref (cog-value-ref res 1) 0))
+
+(define fused-out
+	(run-fused (Plus (Times (Variable "a") (Variable "b")) (Number 1))
+		(Number 0 0 0 0 0) (Number 1 2 3 4 5) (Number 2 2 2 2 2)))
+(format #t "Result fused=~A" fused-out)
+(test-assert "fused mult add"
+	(equal? (list 3.0 5.0 7.0 9.0 11.0) (cog-value->list fused-out)))
+
+(define fused-div
+	(run-fused (Divide (Minus (Variable "a") (Variable "b")) (Number 2))
+		(Number 0 0 0) (Number 3 5 7) (Number 1 1 1)))
+(test-assert "fused divide"
+	(equal? (list 1.0 2.0 3.0) (cog-value->list fused-div)))
+
+(define fused-dot
+	(run-fused (Accumulate (Times (Variable "a") (Variable "b")))
+		(Number 0) (Number 1 2 3 4 5) (Number 1 1 1 2 2)))
+(format #t "Result fused dot=~A" fused-dot)
+(test-assert "fused dot" (equal? 24.0 (cog-value-ref fused-dot 0)))
+
+; ---------------------------------------------------------------
+; A graph of jobs: (a*b) + c, with a*b kept on the device. The
+; Sections are given consumer first; they get sorted.
+(cog-set-value! (Anchor "graph") (Predicate "prod")
+	(OpenclFloatValue 0 0 0 0))
+(cog-set-value! (Anchor "graph") (Predicate "sum")
+	(OpenclFloatValue 0 0 0 0))
+(define prod-loc (ValueOf (Anchor "graph") (Predicate "prod")))
+(define sum-loc (ValueOf (Anchor "graph") (Predicate "sum")))
+
+(cog-set-value! clnode (Predicate "*-write-*")
+	(LinkValue
+		(Section (Item "vec_add")
+			(ConnectorSeq sum-loc prod-loc (Number 10 20 30 40)))
+		(Section (Item "vec_mult")
+			(ConnectorSeq prod-loc (Number 1 2 3 4) (Number 2 2 2 2)))))
+
+(define graph-res (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(test-assert "graph type" (cog-subtype? 'LinkValue (cog-type graph-res)))
+(test-assert "graph sinks" (equal? 1 (length (cog-value->list graph-res))))
+(define graph-out
+	(cog-value-ref (cog-value-ref (cog-value-ref graph-res 0) 1) 0))
+(format #t "Result graph=~A" graph-out)
+(test-assert "graph add"
+	(equal? (list 12.0 24.0 36.0 48.0) (cog-value->list graph-out)))
+
+; Both Sections read and write the accumulator; they run in the
+; order given, and are not taken to be a cycle.
+(cog-set-value! (Anchor "graph") (Predicate "acc")
+	(OpenclFloatValue 1 1 1 1))
+(define acc-loc (ValueOf (Anchor "graph") (Predicate "acc")))
+(cog-set-value! clnode (Predicate "*-write-*")
+	(LinkValue
+		(Section (Item "vec_add")
+			(ConnectorSeq acc-loc acc-loc (Number 1 2 3 4)))
+		(Section (Item "vec_mult")
+			(ConnectorSeq acc-loc acc-loc (Number 10 10 10 10)))))
+(define acc-graph (cog-execute! (ValueOf clnode (Predicate "*-read-*"))))
+(test-assert "graph acc sinks"
+	(equal? 1 (length (cog-value->list acc-graph))))
+(test-assert "graph acc"
+	(equal? (list 20.0 30.0 40.0 50.0)
+		(cog-value->list (cog-value (Anchor "graph") (Predicate "acc")))))
+
 ; ---------------------------------------------------------------
 ; Initialize the accumulator
 (define vec-size 130)
@@ -192,5 +400,264 @@
 (test-assert "accn lo bound" (< (- 0.5 accdev) vmean))
 (test-assert "accn hi bound" (> (+ 0.5 accdev) vmean))
 
+; Evict the accumulator to the host; nothing is lost, and the next
+; run puts it back on the device.
+(cog-execute! (SetValue clnode (Predicate "*-evict-*") accum-location))
+(define evsum (fold + 0 (cog-value->list
+	(cog-execute! accum-location))))
+(test-assert "evict keeps data" (< (abs (- evsum vsum)) 0.01))
+(cog-execute! run-kernel)
+(define evn (cog-value-ref (cog-value-ref (cog-execute! get-status) 1) 0))
+(define evrun (fold + 0 (cog-value->list evn)))
+(test-assert "run after evict" (< vsum evrun))
+
+(define mem-stats (cog-execute! (ValueOf clnode (Predicate "*-memory-*"))))
+(test-assert "memory stats" (equal? 6 (length (cog-value->list mem-stats))))
+(test-assert "memory budget" (< 0 (cog-value-ref mem-stats 0)))
+(test-assert "memory resident" (< 0 (cog-value-ref mem-stats 2)))
+
+; A budget of 1 MiB holds only one of two 640 KB vectors. Running on
+; the second moves the first off the device; running on the first
+; again brings it back, with nothing lost.
+(define memnode (OpenclNode (string-concatenate (list clurl "?memory=1"))))
+(cog-execute!
+   (SetValue memnode (Predicate "*-open-*") (Type 'FloatValue)))
+(define mem-len 80000)
+(cog-set-value! (Anchor "budget") (Predicate "a")
+	(OpenclFloatValue (make-list mem-len 1)))
+(cog-set-value! (Anchor "budget") (Predicate "b")
+	(OpenclFloatValue (make-list mem-len 1)))
+(define (mem-double name)
+	(define vec (ValueOf (Anchor "budget") (Predicate name)))
+	(cog-execute!
+		(SetValue memnode (Predicate "*-write-*")
+			(Section (Item "vec_add") (ConnectorSeq vec vec vec))))
+	(cog-execute! (ValueOf memnode (Predicate "*-read-*"))))
+(mem-double "a")
+(mem-double "b")
+(mem-double "a")
+(define mem-a (cog-value->list
+	(cog-value (Anchor "budget") (Predicate "a"))))
+(test-assert "spill keeps data" (equal? (* 4.0 mem-len) (fold + 0 mem-a)))
+(define spill-stats (cog-execute! (ValueOf memnode (Predicate "*-memory-*"))))
+(test-assert "memory spilled" (< 0 (cog-value-ref spill-stats 3)))
+(test-assert "memory reloaded" (< 0 (cog-value-ref spill-stats 5)))
+
+; ---------------------------------------------------------------
+; Close and open again, with a vector from before still alive. Once
+; it is gone, its buffer, from the old context, must not be pooled
+; and handed to a vector in the new one.
+(define reonode (OpenclNode (string-concatenate (list clurl "?pool-max=1048576"))))
+(define (reo-add)
+	(define vec (ValueOf (Anchor "reopen") (Predicate "vec")))
+	(cog-execute!
+		(SetValue reonode (Predicate "*-write-*")
+			(Section (Item "vec_add") (ConnectorSeq vec vec (Number 1 2 3 4)))))
+	(cog-execute! (ValueOf reonode (Predicate "*-read-*")))
+	(cog-value->list (cog-value (Anchor "reopen") (Predicate "vec"))))
+
+(cog-execute!
+   (SetValue reonode (Predicate "*-open-*") (Type 'FloatValue)))
+(cog-set-value! (Anchor "reopen") (Predicate "vec") (OpenclFloatValue 1 1 1 1))
+(test-assert "reopen before" (equal? (list 2.0 3.0 4.0 5.0) (reo-add)))
+
+(cog-set-value! reonode (Predicate "*-close-*") (BoolValue #t))
+(cog-execute!
+   (SetValue reonode (Predicate "*-open-*") (Type 'FloatValue)))
+(cog-set-value! (Anchor "reopen") (Predicate "vec") (OpenclFloatValue 5 5 5 5))
+(gc)
+(test-assert "reopen after" (equal? (list 6.0 7.0 8.0 9.0) (reo-add)))
+(cog-set-value! (Anchor "reopen") (Predicate "vec") (OpenclFloatValue 7 7 7 7))
+(gc)
+(test-assert "reopen again" (equal? (list 8.0 9.0 10.0 11.0) (reo-add)))
+(cog-set-value! reonode (Predicate "*-close-*") (BoolValue #t))
+
+; ---------------------------------------------------------------
+; A stream as an input: the Section is run once for each vector that
+; comes out of the queue.
+(define strnode (OpenclNode (string-concatenate (list clurl "?stream-depth=2"))))
+(cog-execute!
+   (SetValue strnode (Predicate "*-open-*") (Type 'FloatValue)))
+(cog-set-value! (Anchor "sensor") (Predicate "queue")
+	(QueueValue (FloatValue 1 2 3) (FloatValue 4 5 6) (FloatValue 7 8 9)))
+(cog-execute!
+	(SetValue strnode (Predicate "*-write-*")
+		(Section
+			(Item "vec_mult")
+			(ConnectorSeq
+				(Number 0 0 0)
+				(ValueOf (Anchor "sensor") (Predicate "queue"))
+				(Number 2 2 2)))))
+(define (str-read)
+	(cog-value-ref (cog-value-ref
+		(cog-execute! (ValueOf strnode (Predicate "*-read-*"))) 1) 0))
+(define str-outs (list (str-read) (str-read) (str-read)))
+(test-assert "stream jobs" (lset= equal? str-outs
+	(list (FloatValue 2 4 6) (FloatValue 8 10 12) (FloatValue 14 16 18))))
+
+; The feeder is now waiting on the empty queue; closing must not hang.
+(cog-set-value! strnode (Predicate "*-close-*") (BoolValue #t))
+(test-assert "stream closed" #t)
+
+; ---------------------------------------------------------------
+; Short jobs written back to back may be run as one launch; each one
+; still gets its own results.
+(define mrgnode (OpenclNode (string-concatenate (list clurl "?merge=4"))))
+(cog-execute!
+   (SetValue mrgnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+(define (mrg-mult scale)
+	(cog-execute!
+		(SetValue mrgnode (Predicate "*-write-*")
+			(Section
+				(Item "vec_mult")
+				(ConnectorSeq
+					(Number 0 0 0)
+					(Number 1 2 3)
+					(Number scale scale scale))))))
+
+(mrg-mult 2)
+(mrg-mult 3)
+(mrg-mult 4)
+(define (mrg-read)
+	(cog-value-ref (cog-value-ref
+		(cog-execute! (ValueOf mrgnode (Predicate "*-read-*"))) 1) 0))
+(define mrg-outs (list (mrg-read) (mrg-read) (mrg-read)))
+(test-assert "merged jobs" (lset= equal? mrg-outs
+	(list (FloatValue 2 4 6) (FloatValue 3 6 9) (FloatValue 4 8 12))))
+
+; ---------------------------------------------------------------
+; Long jobs are split across the lanes, even on one device. Each part
+; runs on a sub-buffer; together, they make up the whole result.
+(define splnode (OpenclNode (string-concatenate (list clurl
+	"?split=1024&queues=2"))))
+(cog-execute!
+   (SetValue splnode (Predicate "*-open-*") (Type 'FloatValue)))
+(define spl-len 100000)
+(cog-set-value! (Anchor "split") (Predicate "sum")
+	(OpenclFloatValue (make-list spl-len 0)))
+(cog-execute!
+	(SetValue splnode (Predicate "*-write-*")
+		(Section (Item "vec_add")
+			(ConnectorSeq
+				(ValueOf (Anchor "split") (Predicate "sum"))
+				(FloatValue (iota spl-len))
+				(FloatValue (make-list spl-len 1))))))
+(cog-execute! (ValueOf splnode (Predicate "*-read-*")))
+(define spl-out (cog-value->list (cog-value (Anchor "split") (Predicate "sum"))))
+(test-assert "split add" (equal? spl-out
+	(map (lambda (i) (exact->inexact (+ i 1))) (iota spl-len))))
+
+; Short ones are not.
+(cog-execute!
+	(SetValue splnode (Predicate "*-write-*")
+		(Section (Item "vec_add")
+			(ConnectorSeq (Number 0 0 0) (Number 1 2 3) (Number 1 1 1)))))
+(define spl-short (cog-value-ref (cog-value-ref
+	(cog-execute! (ValueOf splnode (Predicate "*-read-*"))) 1) 0))
+(test-assert "split short" (equal? (FloatValue 2 3 4) spl-short))
+(cog-set-value! splnode (Predicate "*-close-*") (BoolValue #t))
+
+; ---------------------------------------------------------------
+; Reads that don't wait. Finished reads land on a queue; closing the
+; node drains the downloads, and then closes the queue.
+(define asynode (OpenclNode clurl))
+(cog-execute!
+   (SetValue asynode (Predicate "*-open-*") (Type 'FloatValue)))
+(define async-q
+	(cog-execute! (ValueOf asynode (Predicate "*-read-async-*"))))
+(test-assert "async queue" (cog-subtype? 'QueueValue (cog-type async-q)))
+
+(cog-execute!
+	(SetValue asynode (Predicate "*-read-async-*")
+		(Section
+			(Item "vec_mult")
+			(ConnectorSeq (Number 0 0 0) (Number 1 2 3) (Number 5 5 5)))))
+(define async-vec (OpenclFloatValue 7 8 9))
+(cog-set-value! asynode (Predicate "*-read-async-*") async-vec)
+
+(cog-set-value! asynode (Predicate "*-close-*") (BoolValue #t))
+(define async-done (cog-value->list async-q))
+(test-assert "async count" (equal? 2 (length async-done)))
+(define async-job (find (lambda (v)
+	(cog-subtype? 'SectionValue (cog-type v))) async-done))
+(test-assert "async job" async-job)
+(test-assert "async mult" (equal? (list 5.0 10.0 15.0)
+	(cog-value->list (cog-value-ref (cog-value-ref async-job 1) 0))))
+(test-assert "async vector" (member async-vec async-done))
+(test-assert "async vector data"
+	(equal? (list 7.0 8.0 9.0) (cog-value->list async-vec)))
+
+; ---------------------------------------------------------------
+; The program cache on disk. It is kept under $HOME; use an empty one,
+; so that the first build is sure to miss. HOME is put back, and the
+; directory removed, even if a test throws.
+(define old-home (getenv "HOME"))
+(define cache-home (string-append "/tmp/opencl-cache-test-"
+	(number->string (getpid)) "-" (number->string (current-time))))
+
+(define (cache-stats opts)
+	(define node (OpenclNode (string-concatenate (list clurl opts))))
+	(cog-execute!
+		(SetValue node (Predicate "*-open-*") (Type 'FloatValue)))
+	(define stats (cog-value->list
+		(cog-execute! (ValueOf node (Predicate "*-cache-stats-*")))))
+	(cog-set-value! node (Predicate "*-close-*") (BoolValue #t))
+	stats)
+
+(dynamic-wind
+	(lambda ()
+		(mkdir cache-home)
+		(setenv "HOME" cache-home))
+	(lambda ()
+		; With no room, the binary is deleted as soon as it is saved ...
+		(define cache-none (cache-stats "?cache-size=0"))
+		(format #t "Cache stats, no room: ~A\n" cache-none)
+		(test-assert "cache miss" (equal? 1.0 (second cache-none)))
+		(test-assert "cache evict" (< 0 (third cache-none)))
+
+		; ... so the next build misses again, and this time it is kept ...
+		(test-assert "cache miss again"
+			(equal? (list 0.0 1.0 0.0) (cache-stats "?cache-size=16")))
+
+		; ... and is found by the next node.
+		(test-assert "cache hit"
+			(equal? (list 1.0 0.0 0.0) (cache-stats "?cache-size=16&jobs=8"))))
+	(lambda ()
+		(setenv "HOME" old-home)
+		(system* "rm" "-rf" cache-home)))
+
+; ---------------------------------------------------------------
+; The same kernels, run on the CPU, with no OpenCL at all.
+(define natnode (OpenclNode (string-concatenate (list
+	"opencl://native:" curloc "/vec-kernel.cl?profile=1&trace=64"))))
+(cog-execute!
+   (SetValue natnode (Predicate "*-open-*") (Type 'FloatValue)))
+
+(cog-execute!
+	(SetValue natnode (Predicate "*-write-*")
+		(Section (Item "vec_mult")
+			(ConnectorSeq (Number 0 0 0) (Number 1 2 3) (Number 4 5 6)))))
+(define nat-mult (cog-value-ref (cog-value-ref
+	(cog-execute! (ValueOf natnode (Predicate "*-read-*"))) 1) 0))
+(test-assert "native mult" (equal? (FloatValue 4 10 18) nat-mult))
+
+(cog-execute!
+	(SetValue natnode (Predicate "*-write-*")
+		(Section (Item "reduce_dot")
+			(ConnectorSeq (Number 0) (Number 1 2 3 4 5) (Number 1 1 1 2 2)))))
+(define nat-dot (cog-value-ref (cog-value-ref
+	(cog-execute! (ValueOf natnode (Predicate "*-read-*"))) 1) 0))
+(test-assert "native dot" (equal? 24.0 (cog-value-ref nat-dot 0)))
+
+; Both kernels were timed.
+(define nat-stats (cog-execute! (ValueOf natnode (Predicate "*-stats-*"))))
+(test-assert "native stats" (equal? 2 (length (cog-value->list nat-stats))))
+
+; And show up on the timeline.
+(define nat-trace (cog-value-ref
+	(cog-execute! (ValueOf natnode (Predicate "*-trace-*"))) 0))
+(test-assert "native trace" (string-contains nat-trace "\"submit\""))
+
 (test-end tname)
 (opencog-test-end)